@@ -0,0 +1,77 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_ALIGNED_H_INCLUDED
+#define ISAI_KOHRIS_ALIGNED_H_INCLUDED
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace isai
+{
+
+  // alignment of hot storage - one cache line (also widest simd register)
+  constexpr std::size_t cache_line_size = 64u;
+
+  // minimal allocator returning over-aligned memory blocks
+  template < typename T, std::size_t Alignment = cache_line_size >
+  class aligned_allocator_t
+  {
+  public:
+    using value_type = T;
+
+    template < typename U >
+    struct rebind
+    {
+      using other = aligned_allocator_t< U, Alignment >;
+    };
+
+    aligned_allocator_t() noexcept = default;
+
+    template < typename U >
+    explicit aligned_allocator_t(
+      aligned_allocator_t< U, Alignment > const & ) noexcept
+    {
+    }
+
+    T *allocate( std::size_t count )
+    {
+      return static_cast< T * >( ::operator new(
+        count * sizeof( T ), std::align_val_t{ Alignment } ) );
+    }
+
+    void deallocate( T *ptr, std::size_t ) noexcept
+    {
+      ::operator delete( ptr, std::align_val_t{ Alignment } );
+    }
+
+    template < typename U >
+    bool operator==( aligned_allocator_t< U, Alignment > const & ) const
+      noexcept
+    {
+      return true;
+    }
+
+    template < typename U >
+    bool operator!=( aligned_allocator_t< U, Alignment > const & ) const
+      noexcept
+    {
+      return false;
+    }
+  };
+
+  // wrapper occupying whole cache line(s) - prevents false sharing of
+  // per-thread slots stored next to each other
+  template < typename T >
+  struct alignas( cache_line_size ) cache_padded_t
+  {
+    T value;
+  };
+
+  // vector with cache line aligned storage
+  template < typename T >
+  using aligned_vector_t = std::vector< T, aligned_allocator_t< T > >;
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_ALIGNED_H_INCLUDED
@@ -0,0 +1,861 @@
+#include "csv.h"
+#include "dataset.h"
+#include "index.h"
+#include "kohnet.h"
+#include "nearest.h"
+#include "numa.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// benchmark suite - every result is printed as one json object per line
+// (bench name and parameters, then timings and checksum), so that runs can
+// be compared by scripts; all inputs come from fixed seeds, so checksums
+// must match between runs and only timings may differ
+//
+// usage: kohris_bench [--quick] [name filter]
+
+namespace
+{
+
+  using clock_type = std::chrono::steady_clock;
+
+  constexpr auto bench_seed = std::uint32_t{ 5489u };
+
+  double elapsed_us( clock_type::time_point since )
+  {
+    return std::chrono::duration< double, std::micro >( clock_type::now() -
+                                                        since )
+      .count();
+  }
+
+  struct timing_t
+  {
+    double median_us;
+    double min_us;
+  };
+
+  // times given number of calls (after one warm-up call)
+  template < typename F >
+  timing_t measure( std::size_t repeats, F &&f )
+  {
+    f();
+    auto times = std::vector< double >{};
+    for ( auto r = std::size_t{ 0 }; r < repeats; r++ )
+    {
+      auto start = clock_type::now();
+      f();
+      times.emplace_back( elapsed_us( start ) );
+    }
+    std::sort( times.begin(), times.end() );
+    return timing_t{ times[ times.size() / 2u ], times[ 0 ] };
+  }
+
+  // single result line
+  class record_t
+  {
+  public:
+    explicit record_t( char const *bench ) :
+      m_text( std::string{ "{\"bench\":\"" } + bench + "\"" )
+    {
+    }
+
+    record_t &text( char const *key, char const *value )
+    {
+      m_text += std::string{ ",\"" } + key + "\":\"" + value + "\"";
+      return *this;
+    }
+
+    record_t &count( char const *key, std::size_t value )
+    {
+      m_text += std::string{ ",\"" } + key + "\":" + std::to_string( value );
+      return *this;
+    }
+
+    record_t &value( char const *key, double value )
+    {
+      char buf[ 32 ];
+      std::snprintf( buf, sizeof( buf ), "%.9g", value );
+      m_text += std::string{ ",\"" } + key + "\":" + buf;
+      return *this;
+    }
+
+    // timing of whole call and of one of ops_per_call operations in it
+    record_t &timing( timing_t const &t, std::size_t ops_per_call = 1u )
+    {
+      auto ops = static_cast< double >( ops_per_call );
+      return value( "median_us", t.median_us / ops )
+        .value( "min_us", t.min_us / ops );
+    }
+
+    void print() const
+    {
+      std::printf( "%s}\n", m_text.c_str() );
+      std::fflush( stdout );
+    }
+
+  private:
+    std::string m_text;
+  };
+
+  struct options_t
+  {
+    bool is_quick = false;
+    std::string filter = std::string{};
+
+    bool is_enabled( char const *bench ) const
+    {
+      return std::strstr( bench, filter.c_str() ) != nullptr;
+    }
+  };
+
+  template < typename T >
+  char const *type_name()
+  {
+    return sizeof( T ) == sizeof( float ) ? "float" : "double";
+  }
+
+  std::vector< std::size_t > thread_counts( options_t const &options )
+  {
+    auto hw = std::max( std::size_t{ std::thread::hardware_concurrency() },
+                        std::size_t{ 1 } );
+    auto res = options.is_quick ? std::vector< std::size_t >{ 1u, hw }
+                                : std::vector< std::size_t >{ 1u, 2u, 4u, hw };
+    std::sort( res.begin(), res.end() );
+    res.erase( std::unique( res.begin(), res.end() ), res.end() );
+    return res;
+  }
+
+  template < typename T >
+  isai::basic_hidden_layer_t< T, isai::iris_dimension >
+  make_layer( std::size_t count, T radius )
+  {
+    auto layer = isai::basic_hidden_layer_t< T, isai::iris_dimension >{ count };
+    for ( auto i = std::size_t{ 0 }; i < count; i++ )
+    {
+      layer.store(
+        i,
+        isai::basic_kohonen_neuron_t< T, isai::iris_dimension >{ radius }
+          .weights() );
+    }
+    return layer;
+  }
+
+  template < typename T >
+  std::vector< isai::basic_features_t< T, isai::iris_dimension > >
+  make_queries( std::size_t count, T radius )
+  {
+    using neuron_type = isai::basic_kohonen_neuron_t< T, isai::iris_dimension >;
+    auto res = std::vector< typename neuron_type::features_type >{};
+    for ( auto q = std::size_t{ 0 }; q < count; q++ )
+    {
+      res.emplace_back( neuron_type{ radius }.weights() );
+    }
+    return res;
+  }
+
+  // winner search of network - instruction set, hidden layer size and
+  // threads (each one scanning its shard of hidden layer)
+  template < typename T >
+  void bench_find_winner( options_t const &options )
+  {
+    constexpr auto query_count = std::size_t{ 256 };
+    auto sizes = options.is_quick
+                   ? std::vector< std::size_t >{ 10000u, 100000u }
+                   : std::vector< std::size_t >{ 10000u, 100000u, 1000000u };
+
+    for ( auto size : sizes )
+    {
+      for ( auto level :
+            { isai::simd_level_t::scalar, isai::simd_level_t::avx2,
+              isai::simd_level_t::avx512 } )
+      {
+        for ( auto threads : thread_counts( options ) )
+        {
+          isai::prng_t::reseed( bench_seed );
+          auto settings = isai::knc_settings_t{};
+          settings.hidden_layer_size = size;
+          settings.simd_level = level;
+          settings.thread_count = threads;
+          auto network =
+            isai::basic_kohonen_network_t< T, isai::iris_dimension >{
+              settings };
+          auto queries = make_queries(
+            query_count,
+            static_cast< T >( settings.normalization_sphere_radius ) );
+
+          auto checksum = std::size_t{ 0 };
+          auto t = measure( 5u, [&]() {
+            checksum = 0u;
+            for ( auto &&q : queries )
+            {
+              checksum += network.find_winner( q );
+            }
+          } );
+
+          record_t{ "find_winner" }
+            .text( "type", type_name< T >() )
+            .text( "simd", isai::simd_level_to_string(
+                             isai::resolve_simd_level( level ) ) )
+            .count( "neurons", size )
+            .count( "threads", threads )
+            .timing( t, query_count )
+            .count( "checksum", checksum )
+            .print();
+        }
+      }
+    }
+  }
+
+  // batch winner search - blocked kernel against the same queries searched
+  // one by one (checksums of both must match)
+  template < typename T >
+  void bench_find_winners( options_t const &options )
+  {
+    constexpr auto query_count = std::size_t{ 256 };
+    constexpr auto radius = T{ 4 };
+    auto sizes = options.is_quick
+                   ? std::vector< std::size_t >{ 10000u, 100000u }
+                   : std::vector< std::size_t >{ 10000u, 100000u, 1000000u };
+
+    for ( auto size : sizes )
+    {
+      isai::prng_t::reseed( bench_seed );
+      auto layer = make_layer( size, radius );
+      auto queries = make_queries( query_count, radius );
+      auto winners = std::vector< isai::basic_winner_t< T > >( query_count );
+
+      for ( auto level :
+            { isai::simd_level_t::scalar, isai::simd_level_t::avx2,
+              isai::simd_level_t::avx512 } )
+      {
+        auto kernel =
+          isai::get_winner_kernel< T, isai::iris_dimension >( level );
+        auto block_kernel =
+          isai::get_block_winner_kernel< T, isai::iris_dimension >( level );
+        for ( auto is_blocked : { false, true } )
+        {
+          auto checksum = std::size_t{ 0 };
+          auto t = measure( 5u, [&]() {
+            if ( is_blocked )
+            {
+              block_kernel( layer, 0u, layer.padded_size(), queries.data(),
+                            query_count, winners.data() );
+            }
+            else
+            {
+              for ( auto q = std::size_t{ 0 }; q < query_count; q++ )
+              {
+                winners[ q ] =
+                  kernel( layer, 0u, layer.padded_size(), queries[ q ] );
+              }
+            }
+            checksum = 0u;
+            for ( auto &&w : winners )
+            {
+              checksum += w.index;
+            }
+          } );
+
+          record_t{ "find_winners" }
+            .text( "type", type_name< T >() )
+            .text( "simd", isai::simd_level_to_string(
+                             isai::resolve_simd_level( level ) ) )
+            .text( "kernel", is_blocked ? "blocked" : "single" )
+            .count( "neurons", size )
+            .timing( t, query_count )
+            .count( "checksum", checksum )
+            .print();
+        }
+      }
+    }
+  }
+
+  // winner update - move towards input followed by normalization
+  template < typename T >
+  void bench_adjust_to( options_t const & )
+  {
+    using neuron_type = isai::basic_kohonen_neuron_t< T, isai::iris_dimension >;
+    constexpr auto count = std::size_t{ 4096 };
+    constexpr auto radius = T{ 4 };
+
+    isai::prng_t::reseed( bench_seed );
+    auto initial = std::vector< neuron_type >{};
+    for ( auto i = std::size_t{ 0 }; i < count; i++ )
+    {
+      initial.emplace_back( radius );
+    }
+    auto inputs = make_queries( count, radius );
+
+    auto neurons = initial;
+    auto t = measure( 20u, [&]() {
+      neurons = initial;
+      for ( auto i = std::size_t{ 0 }; i < count; i++ )
+      {
+        neurons[ i ].adjust_to( inputs[ i ], T( 0.3 ) );
+      }
+    } );
+
+    auto checksum = 0.0;
+    for ( auto &&n : neurons )
+    {
+      checksum += static_cast< double >( n[ 0 ] );
+    }
+    record_t{ "adjust_to" }
+      .text( "type", type_name< T >() )
+      .count( "count", count )
+      .timing( t, count )
+      .value( "checksum", checksum )
+      .print();
+  }
+
+  // projection of raw features onto normalization sphere
+  template < typename T >
+  void bench_normalize_stereographic( options_t const & )
+  {
+    using features_type = isai::basic_features_t< T, isai::iris_dimension >;
+    constexpr auto count = std::size_t{ 4096 };
+
+    auto eng = std::mt19937{ bench_seed };
+    auto dist = std::uniform_real_distribution< double >{ -8.0, 8.0 };
+    auto raw = std::vector< features_type >( count );
+    for ( auto &&f : raw )
+    {
+      for ( auto d = std::size_t{ 0 }; d + 1u < isai::iris_dimension; d++ )
+      {
+        f[ d ] = static_cast< T >( dist( eng ) );
+      }
+    }
+
+    auto features = raw;
+    auto t = measure( 20u, [&]() {
+      features = raw;
+      for ( auto &&f : features )
+      {
+        isai::normalize_stereographic( f, T{ 4 } );
+      }
+    } );
+
+    auto checksum = 0.0;
+    for ( auto &&f : features )
+    {
+      checksum += static_cast< double >( f[ isai::iris_dimension - 1u ] );
+    }
+    record_t{ "normalize_stereographic" }
+      .text( "type", type_name< T >() )
+      .count( "count", count )
+      .timing( t, count )
+      .value( "checksum", checksum )
+      .print();
+  }
+
+  // nearest pair search behind coalescing - full rescan, and refresh after
+  // interval of training: every alive neuron drifted (little, as when
+  // converging, or more), one percent of them (the winners) took full steps
+  // and closest pair was merged
+  void bench_coalesce( options_t const &options )
+  {
+    using neuron_type =
+      isai::basic_kohonen_neuron_t< isai::scalar_t, isai::iris_dimension >;
+
+    constexpr auto radius = isai::scalar_t{ 4 };
+    constexpr auto winner_alpha = isai::scalar_t( 0.3 );
+    auto sizes = options.is_quick
+                   ? std::vector< std::size_t >{ 1000u, 2000u }
+                   : std::vector< std::size_t >{ 1000u, 4000u, 10000u };
+
+    for ( auto size : sizes )
+    {
+      isai::prng_t::reseed( bench_seed );
+      auto const initial = make_layer( size, radius );
+      auto layer = initial;
+      auto nearest = isai::nearest_pairs_t{ size };
+      auto is_alive = std::vector< bool >( size, true );
+      auto alive = [&]( std::size_t ix ) { return bool( is_alive[ ix ] ); };
+
+      auto full_pair = std::pair< std::size_t, std::size_t >{};
+      auto t = measure( 3u, [&]() {
+        nearest.reset( size );
+        nearest.refresh( layer, alive );
+        full_pair = nearest.mutual_pairs( 1u ).front();
+      } );
+      record_t{ "coalesce" }
+        .text( "phase", "full" )
+        .count( "neurons", size )
+        .timing( t )
+        .count( "checksum", full_pair.first * size + full_pair.second )
+        .print();
+
+      auto winners = std::max( size / 100u, std::size_t{ 1 } );
+      auto queries = make_queries( size, radius );
+      for ( auto drift_alpha :
+            { isai::scalar_t( 0.00001 ), isai::scalar_t( 0.001 ) } )
+      {
+        layer = initial;
+        is_alive.assign( size, true );
+        nearest.reset( size );
+        nearest.refresh( layer, alive );
+        auto pair = nearest.mutual_pairs( 1u ).front();
+
+        auto pass = std::size_t{ 0 };
+        auto rescanned = std::size_t{ 0 };
+        auto checksum = std::size_t{ 0 };
+        t = measure( 5u, [&]() {
+          for ( auto ix = std::size_t{ 0 }; ix < size; ix++ )
+          {
+            if ( is_alive[ ix ] )
+            {
+              auto neuron = neuron_type{ layer.neuron( ix ) };
+              auto is_winner =
+                ( ix + pass * 7919u ) % ( size / winners ) == 0u;
+              neuron.adjust_to( queries[ ( ix + pass ) % queries.size() ],
+                                is_winner ? winner_alpha : drift_alpha );
+              layer.store( ix, neuron.weights() );
+              nearest.mark_moved( ix );
+            }
+          }
+          auto merged = neuron_type{ layer.neuron( pair.first ) };
+          merged.adjust_to( layer.neuron( pair.second ),
+                            isai::scalar_t( 0.5 ) );
+          layer.store( pair.first, merged.weights() );
+          nearest.mark_moved( pair.first );
+          is_alive[ pair.second ] = false;
+
+          nearest.refresh( layer, alive );
+          rescanned += nearest.rescanned_count();
+          pair = nearest.mutual_pairs( 1u ).front();
+          checksum += pair.first * size + pair.second;
+          pass++;
+        } );
+        record_t{ "coalesce" }
+          .text( "phase", "interval" )
+          .count( "neurons", size )
+          .count( "winners", winners )
+          .value( "drift", static_cast< double >( drift_alpha ) )
+          .timing( t )
+          .count( "rescanned", rescanned / pass )
+          .count( "checksum", checksum )
+          .print();
+      }
+    }
+  }
+
+  // iris-like file of given number of rows
+  std::string make_csv( std::size_t rows )
+  {
+    auto path = ( std::filesystem::temp_directory_path() /
+                  ( "kohris_bench_" + std::to_string( rows ) + ".csv" ) )
+                  .string();
+    auto names = isai::csv_schema_t{}.label_names;
+    auto eng = std::mt19937{ bench_seed };
+    auto dist = std::uniform_int_distribution< int >{ 10, 79 };
+
+    auto file = std::fopen( path.c_str(), "w" );
+    for ( auto r = std::size_t{ 0 }; r < rows; r++ )
+    {
+      auto a = dist( eng );
+      auto b = dist( eng );
+      auto c = dist( eng );
+      auto d = dist( eng );
+      std::fprintf( file, "%d.%d,%d.%d,%d.%d,%d.%d,%s\n", a / 10, a % 10,
+                    b / 10, b % 10, c / 10, c % 10, d / 10, d % 10,
+                    names[ r % names.size() ].c_str() );
+    }
+    std::fclose( file );
+    return path;
+  }
+
+  // dataset loading - parsing (by threads), full preprocessing of csv and
+  // load of binary cache
+  void bench_load( options_t const &options )
+  {
+    auto sizes = options.is_quick
+                   ? std::vector< std::size_t >{ 10000u, 100000u }
+                   : std::vector< std::size_t >{ 10000u, 100000u, 1000000u };
+    auto cache_dir =
+      ( std::filesystem::temp_directory_path() / "kohris_bench_cache" )
+        .string();
+
+    for ( auto rows : sizes )
+    {
+      auto path = make_csv( rows );
+
+      for ( auto threads : thread_counts( options ) )
+      {
+        auto checksum = std::size_t{ 0 };
+        auto t = measure( 3u, [&]() {
+          auto data = isai::load_csv< isai::data_point_t >(
+            path.c_str(), isai::csv_schema_t{}, threads );
+          checksum = 0u;
+          for ( auto &&dp : data )
+          {
+            checksum += static_cast< std::size_t >( dp.label );
+          }
+        } );
+        record_t{ "load_csv" }
+          .count( "rows", rows )
+          .count( "threads", threads )
+          .timing( t )
+          .count( "checksum", checksum )
+          .print();
+      }
+
+      for ( auto is_cached : { false, true } )
+      {
+        auto checksum = std::size_t{ 0 };
+        auto t = measure( 3u, [&]() {
+          isai::prng_t::reseed( bench_seed );
+          auto dataset =
+            isai::dataset_t{ rows / 2u,           4.0,  true, path.c_str(),
+                             isai::csv_schema_t{}, 1u,
+                             is_cached ? cache_dir.c_str() : nullptr };
+          checksum = dataset.size();
+        } );
+        record_t{ "load_dataset" }
+          .text( "source", is_cached ? "cache" : "csv" )
+          .count( "rows", rows )
+          .timing( t )
+          .count( "checksum", checksum )
+          .print();
+      }
+
+      std::filesystem::remove( path );
+    }
+    std::filesystem::remove_all( cache_dir );
+  }
+
+  // whole training on iris
+  void bench_run( options_t const &options )
+  {
+    auto sizes = options.is_quick
+                   ? std::vector< std::size_t >{ 1000u, 5000u }
+                   : std::vector< std::size_t >{ 1000u, 10000u, 30000u };
+
+    for ( auto size : sizes )
+    {
+      for ( auto mode :
+            { isai::training_mode_t::online, isai::training_mode_t::batch } )
+      {
+        for ( auto threads : thread_counts( options ) )
+        {
+          auto settings = isai::knc_settings_t{};
+          settings.hidden_layer_size = size;
+          settings.training_mode = mode;
+          settings.thread_count = threads;
+          settings.is_verbose = false;
+
+          auto checksum = std::size_t{ 0 };
+          auto t = measure( 3u, [&]() {
+            isai::prng_t::reseed( bench_seed );
+            auto dataset = isai::dataset_t{
+              settings.training_set_size,
+              settings.normalization_sphere_radius,
+              settings.is_feature_sign_balanced,
+              settings.dataset_path.c_str(),
+              settings.dataset_schema,
+              1u };
+            auto network = isai::kohonen_network_t{ settings };
+            network.run( dataset.train_begin(), dataset.train_end() );
+            checksum = 0u;
+            for ( auto id : network.get_result_ids() )
+            {
+              checksum = checksum * 31u + id;
+            }
+          } );
+
+          record_t{ "run" }
+            .text( "mode", isai::training_mode_to_string( mode ) )
+            .count( "neurons", size )
+            .count( "threads", threads )
+            .timing( t )
+            .count( "checksum", checksum )
+            .print();
+        }
+      }
+    }
+  }
+
+  // share of test inputs whose cluster majority label is their own
+  double purity( isai::kohonen_network_t &network,
+                 isai::dataset_t const &dataset )
+  {
+    auto counts = std::vector< std::array< std::size_t, 3u > >(
+      network.get_result_ids().size() );
+    auto total = std::size_t{ 0 };
+    for ( auto i = dataset.test_begin(); i != dataset.test_end(); i++ )
+    {
+      counts[ network.find_winner( i->features ) ]
+            [ static_cast< std::size_t >( i->label ) ]++;
+      total++;
+    }
+    auto majority = std::size_t{ 0 };
+    for ( auto &&c : counts )
+    {
+      majority += *std::max_element( c.begin(), c.end() );
+    }
+    return total > 0u ? static_cast< double >( majority ) /
+                          static_cast< double >( total )
+                      : 0.0;
+  }
+
+  // cluster quality of lock-free parallel online training against serial
+  // online one (first line) - means over several seeds, as hogwild runs
+  // are not reproducible; thread counts are fixed (not hardware ones), so
+  // that reports of different machines compare
+  void bench_hogwild( options_t const &options )
+  {
+    auto sizes = options.is_quick
+                   ? std::vector< std::size_t >{ 5000u }
+                   : std::vector< std::size_t >{ 5000u, 30000u };
+    auto seed_count = options.is_quick ? 3u : 10u;
+
+    for ( auto size : sizes )
+    {
+      auto serial_purity = 0.0;
+      for ( auto threads : { 1u, 2u, 4u, 8u } )
+      {
+        auto settings = isai::knc_settings_t{};
+        settings.hidden_layer_size = size;
+        settings.training_mode = threads == 1u
+                                   ? isai::training_mode_t::online
+                                   : isai::training_mode_t::hogwild;
+        settings.thread_count = threads;
+        settings.is_verbose = false;
+
+        auto times = std::vector< double >{};
+        auto purities = std::vector< double >{};
+        auto iterations = std::size_t{ 0 };
+        for ( auto s = 0u; s < seed_count; s++ )
+        {
+          isai::prng_t::reseed( bench_seed + s );
+          auto dataset = isai::dataset_t{
+            settings.training_set_size, settings.normalization_sphere_radius,
+            settings.is_feature_sign_balanced, settings.dataset_path.c_str(),
+            settings.dataset_schema, 1u };
+          auto start = clock_type::now();
+          auto network = isai::kohonen_network_t{ settings };
+          network.run( dataset.train_begin(), dataset.train_end() );
+          times.emplace_back( elapsed_us( start ) );
+          purities.emplace_back( purity( network, dataset ) );
+          iterations += network.iteration_count();
+        }
+
+        std::sort( times.begin(), times.end() );
+        auto mean_purity =
+          std::accumulate( purities.begin(), purities.end(), 0.0 ) /
+          static_cast< double >( seed_count );
+        serial_purity = threads == 1u ? mean_purity : serial_purity;
+        record_t{ "hogwild" }
+          .text( "mode",
+                 isai::training_mode_to_string( settings.training_mode ) )
+          .count( "neurons", size )
+          .count( "threads", threads )
+          .count( "seeds", seed_count )
+          .timing( timing_t{ times[ times.size() / 2u ], times[ 0 ] } )
+          .value( "mean_iterations", static_cast< double >( iterations ) /
+                                       static_cast< double >( seed_count ) )
+          .value( "mean_purity", mean_purity )
+          .value( "min_purity",
+                  *std::min_element( purities.begin(), purities.end() ) )
+          .value( "purity_vs_serial", mean_purity - serial_purity )
+          .print();
+      }
+    }
+  }
+
+  // recall of approximate winner search against exact scan
+  void bench_winner_index( options_t const &options )
+  {
+    constexpr auto radius = isai::scalar_t{ 4 };
+    constexpr auto query_count = std::size_t{ 2000 };
+    auto sizes = options.is_quick
+                   ? std::vector< std::size_t >{ 10000u }
+                   : std::vector< std::size_t >{ 10000u, 100000u, 1000000u };
+
+    for ( auto size : sizes )
+    {
+      isai::prng_t::reseed( bench_seed );
+      auto layer = make_layer( size, radius );
+      auto queries = make_queries( query_count, radius );
+
+      auto kernel =
+        isai::get_winner_kernel< isai::scalar_t, isai::iris_dimension >(
+          isai::simd_level_t::automatic );
+      auto exact = std::vector< isai::winner_t >{};
+      for ( auto &&q : queries )
+      {
+        exact.emplace_back( kernel( layer, 0u, layer.padded_size(), q ) );
+      }
+
+      for ( auto probes : { 1u, 2u, 4u, 8u } )
+      {
+        auto index = isai::projection_index_t{ 4u, probes, kernel };
+        auto start = clock_type::now();
+        index.rebuild( layer );
+        auto build_us = elapsed_us( start );
+
+        auto hits = std::size_t{ 0 };
+        auto excess = 0.0;
+        auto t = measure( 3u, [&]() {
+          hits = 0u;
+          excess = 0.0;
+          for ( auto q = std::size_t{ 0 }; q < query_count; q++ )
+          {
+            auto res = index.find( layer, queries[ q ] );
+            hits += res.index == exact[ q ].index ? 1u : 0u;
+            excess += std::sqrt( res.sqr_distance ) -
+                      std::sqrt( exact[ q ].sqr_distance );
+          }
+        } );
+
+        record_t{ "winner_index" }
+          .count( "neurons", size )
+          .count( "probes", probes )
+          .value( "build_us", build_us )
+          .timing( t, query_count )
+          .value( "recall", static_cast< double >( hits ) /
+                              static_cast< double >( query_count ) )
+          .value( "avg_excess_distance",
+                  excess / static_cast< double >( query_count ) )
+          .print();
+      }
+    }
+  }
+
+  // winner agreement of quantized shortlist search with exact scan (the
+  // exact scan itself is timed as well, as baseline)
+  template < typename Q >
+  void bench_quantized_index( options_t const &options )
+  {
+    constexpr auto radius = isai::scalar_t{ 4 };
+    constexpr auto query_count = std::size_t{ 2000 };
+    auto sizes = options.is_quick
+                   ? std::vector< std::size_t >{ 10000u }
+                   : std::vector< std::size_t >{ 10000u, 100000u, 1000000u };
+
+    for ( auto size : sizes )
+    {
+      isai::prng_t::reseed( bench_seed );
+      auto layer = make_layer( size, radius );
+      auto queries = make_queries( query_count, radius );
+
+      auto kernel =
+        isai::get_winner_kernel< isai::scalar_t, isai::iris_dimension >(
+          isai::simd_level_t::automatic );
+      auto exact = std::vector< isai::winner_t >( query_count );
+      auto t_exact = measure( 3u, [&]() {
+        for ( auto q = std::size_t{ 0 }; q < query_count; q++ )
+        {
+          exact[ q ] =
+            kernel( layer, 0u, layer.padded_size(), queries[ q ] );
+        }
+      } );
+
+      record_t{ "quantized_index" }
+        .text( "weights", "exact" )
+        .count( "neurons", size )
+        .timing( t_exact, query_count )
+        .print();
+
+      for ( auto shortlist : { 1u, 4u, 8u, 16u, 32u } )
+      {
+        auto index = isai::quantized_index_t< Q >{
+          shortlist, isai::simd_level_t::automatic, kernel };
+        auto start = clock_type::now();
+        index.rebuild( layer );
+        auto build_us = elapsed_us( start );
+
+        auto hits = std::size_t{ 0 };
+        auto excess = 0.0;
+        auto t = measure( 3u, [&]() {
+          hits = 0u;
+          excess = 0.0;
+          for ( auto q = std::size_t{ 0 }; q < query_count; q++ )
+          {
+            auto res = index.find( layer, queries[ q ] );
+            hits += res.index == exact[ q ].index ? 1u : 0u;
+            excess += std::sqrt( res.sqr_distance ) -
+                      std::sqrt( exact[ q ].sqr_distance );
+          }
+        } );
+
+        record_t{ "quantized_index" }
+          .text( "weights", sizeof( Q ) == 1u ? "int8" : "int16" )
+          .count( "neurons", size )
+          .count( "shortlist", shortlist )
+          .value( "build_us", build_us )
+          .timing( t, query_count )
+          .value( "agreement", static_cast< double >( hits ) /
+                                 static_cast< double >( query_count ) )
+          .value( "avg_excess_distance",
+                  excess / static_cast< double >( query_count ) )
+          .print();
+      }
+    }
+  }
+
+}  // namespace
+
+int main( int argc, char **argv )
+{
+  auto options = options_t{};
+  for ( auto a = 1; a < argc; a++ )
+  {
+    if ( std::strcmp( argv[ a ], "--quick" ) == 0 )
+    {
+      options.is_quick = true;
+    }
+    else
+    {
+      options.filter = argv[ a ];
+    }
+  }
+
+  record_t{ "environment" }
+    .text( "scalar", type_name< isai::scalar_t >() )
+    .text( "simd", isai::simd_level_to_string( isai::detect_simd_level() ) )
+    .count( "hardware_threads", std::thread::hardware_concurrency() )
+    .count( "numa_nodes", isai::numa_nodes().size() )
+    .count( "quick", options.is_quick ? 1u : 0u )
+    .print();
+
+  using bench_t = void ( * )( options_t const & );
+  constexpr std::pair< char const *, bench_t > benches[] = {
+    { "find_winner/double", &bench_find_winner< double > },
+    { "find_winner/float", &bench_find_winner< float > },
+    { "find_winners/double", &bench_find_winners< double > },
+    { "find_winners/float", &bench_find_winners< float > },
+    { "adjust_to/double", &bench_adjust_to< double > },
+    { "adjust_to/float", &bench_adjust_to< float > },
+    { "normalize_stereographic/double",
+      &bench_normalize_stereographic< double > },
+    { "normalize_stereographic/float",
+      &bench_normalize_stereographic< float > },
+    { "coalesce", &bench_coalesce },
+    { "load", &bench_load },
+    { "run", &bench_run },
+    { "hogwild", &bench_hogwild },
+    { "winner_index", &bench_winner_index },
+    { "quantized_index/int16", &bench_quantized_index< std::int16_t > },
+    { "quantized_index/int8", &bench_quantized_index< std::int8_t > },
+  };
+  for ( auto &&bench : benches )
+  {
+    if ( options.is_enabled( bench.first ) )
+    {
+      bench.second( options );
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_BINARY_IO_H_INCLUDED
+#define ISAI_KOHRIS_BINARY_IO_H_INCLUDED
+
+#include "mapped_file.h"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace isai
+{
+
+  // sections of binary files (checkpoints, models) start at this alignment,
+  // so arrays can be used straight from memory mapping
+  constexpr std::size_t binary_section_alignment = 64u;
+
+  // builds binary file in memory (native byte order)
+  class binary_writer_t
+  {
+  public:
+    void append( void const *data, std::size_t size )
+    {
+      auto bytes = static_cast< char const * >( data );
+      m_buffer.insert( m_buffer.end(), bytes, bytes + size );
+    }
+
+    template < typename T >
+    void put( T const &value )
+    {
+      append( &value, sizeof( value ) );
+    }
+
+    void put_string( std::string const &str )
+    {
+      put( static_cast< std::uint64_t >( str.size() ) );
+      append( str.data(), str.size() );
+    }
+
+    // pads with zeros up to next section boundary
+    void align()
+    {
+      auto size = ( m_buffer.size() + binary_section_alignment - 1u ) /
+                  binary_section_alignment * binary_section_alignment;
+      m_buffer.resize( size, '\0' );
+    }
+
+    // false on failure (file is replaced atomically)
+    bool write( char const *path ) const
+    {
+      return write_file_atomically( path, m_buffer.data(), m_buffer.size() );
+    }
+
+  private:
+    std::vector< char > m_buffer = std::vector< char >{};
+  };
+
+  // reads binary file through memory mapping; throws std::runtime_error
+  // when reading past its end (truncated or corrupted file)
+  class binary_reader_t
+  {
+  public:
+    explicit binary_reader_t( char const *path ) :
+      m_file( path ),
+      m_path( path )
+    {
+    }
+
+    // pointer into mapping (valid as long as reader or its file lives)
+    char const *view( std::size_t size )
+    {
+      if ( size > m_file.size() - m_pos )
+      {
+        fail( "unexpected end of file" );
+      }
+      auto res = m_file.data() + m_pos;
+      m_pos += size;
+      return res;
+    }
+
+    void read( void *out, std::size_t size )
+    {
+      std::memcpy( out, view( size ), size );
+    }
+
+    template < typename T >
+    T get()
+    {
+      auto value = T{};
+      read( &value, sizeof( value ) );
+      return value;
+    }
+
+    std::string get_string()
+    {
+      auto size = static_cast< std::size_t >( get< std::uint64_t >() );
+      auto data = view( size );
+      return std::string{ data, size };
+    }
+
+    void align()
+    {
+      auto pos = ( m_pos + binary_section_alignment - 1u ) /
+                 binary_section_alignment * binary_section_alignment;
+      view( pos - m_pos );
+    }
+
+    // checks magic and version written at the beginning of file
+    void expect_header( char const ( &magic )[ 8 ], std::uint32_t version )
+    {
+      if ( std::memcmp( view( sizeof( magic ) ), magic, sizeof( magic ) ) != 0 )
+      {
+        fail( "unknown file format" );
+      }
+      if ( get< std::uint32_t >() != version )
+      {
+        fail( "unsupported format version" );
+      }
+    }
+
+    // checks that rest of file can hold given number of records of given
+    // size (before anything is allocated for them - count comes from file)
+    void expect_records( std::uint64_t count, std::size_t record_size )
+    {
+      if ( count > ( m_file.size() - m_pos ) / record_size )
+      {
+        fail( "record count exceeds file size" );
+      }
+    }
+
+    [[noreturn]] void fail( char const *error ) const
+    {
+      throw std::runtime_error{ m_path + ": " + error };
+    }
+
+    mapped_file_t &file() noexcept { return m_file; }
+
+  private:
+    mapped_file_t m_file;
+    std::string m_path;
+    std::size_t m_pos = 0u;
+  };
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_BINARY_IO_H_INCLUDED
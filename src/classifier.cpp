@@ -0,0 +1,140 @@
+#include "classifier.h"
+
+#include "csv.h"
+
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace isai
+{
+
+  namespace
+  {
+    // parses features of single line, returns null on success or error
+    char const *parse_point( char const *p, char const *line_end,
+                             char delimiter, features_t &features )
+    {
+      for ( auto d = std::size_t{ 0 }; d + 1u < iris_dimension; d++ )
+      {
+        if ( d > 0u )
+        {
+          if ( p == line_end || *p != delimiter )
+          {
+            return "too few columns";
+          }
+          p++;
+        }
+        while ( p != line_end && detail::is_blank( *p ) )
+        {
+          p++;
+        }
+        p = detail::parse_number( p, line_end, features[ d ] );
+        if ( p == nullptr )
+        {
+          return "malformed number";
+        }
+        while ( p != line_end && detail::is_blank( *p ) )
+        {
+          p++;
+        }
+      }
+      if ( p != line_end && *p != delimiter )
+      {
+        return "malformed number";
+      }
+      features[ iris_dimension - 1u ] = scalar_t{ 0 };
+      return nullptr;
+    }
+  }  // namespace
+
+  std::size_t classify_stream( model_t const &model, std::FILE *in,
+                               std::FILE *out, simd_level_t level,
+                               std::size_t thread_count, char delimiter,
+                               std::size_t batch_size )
+  {
+    constexpr auto read_size = std::size_t{ 1 } << 20u;
+
+    auto classifier = classifier_t{ model, level, thread_count };
+    batch_size = std::max( batch_size, std::size_t{ 1 } );
+    auto batch = std::vector< features_t >( batch_size );
+    auto labels = std::vector< std::size_t >( batch_size );
+    auto text = std::string{};
+    auto buffer = std::vector< char >{};
+    auto pending = std::size_t{ 0 };
+    auto total = std::size_t{ 0 };
+    auto line_no = std::size_t{ 0 };
+
+    auto flush = [&]() {
+      classifier.classify( batch.data(), pending, labels.data() );
+      text.clear();
+      for ( auto k = std::size_t{ 0 }; k < pending; k++ )
+      {
+        char digits[ 24 ];
+        auto res = std::to_chars( digits, digits + sizeof( digits ) - 1u,
+                                  labels[ k ] );
+        *res.ptr++ = '\n';
+        text.append( digits, res.ptr );
+      }
+      std::fwrite( text.data(), 1u, text.size(), out );
+      total += pending;
+      pending = 0u;
+    };
+
+    auto is_eof = false;
+    while ( !is_eof )
+    {
+      // buffer holds unfinished line from previous read (if any)
+      auto kept = buffer.size();
+      buffer.resize( kept + read_size );
+      auto got = std::fread( buffer.data() + kept, 1u, read_size, in );
+      buffer.resize( kept + got );
+      is_eof = got < read_size;
+      if ( is_eof && !buffer.empty() && buffer.back() != '\n' )
+      {
+        buffer.push_back( '\n' );
+      }
+
+      auto pos = static_cast< char const * >( buffer.data() );
+      auto end = pos + buffer.size();
+      while ( auto nl = static_cast< char const * >( std::memchr(
+                pos, '\n', static_cast< std::size_t >( end - pos ) ) ) )
+      {
+        line_no++;
+        auto p = pos;
+        pos = nl + 1;
+        while ( p != nl && detail::is_blank( *p ) )
+        {
+          p++;
+        }
+        if ( p == nl )
+        {
+          continue;
+        }
+
+        auto &features = batch[ pending ];
+        if ( auto error = parse_point( p, nl, delimiter, features ) )
+        {
+          throw std::runtime_error{ "<input>:" + std::to_string( line_no ) +
+                                    ": " + error };
+        }
+        model.prepare( features );
+        if ( ++pending == batch_size )
+        {
+          flush();
+        }
+      }
+      buffer.erase( buffer.begin(),
+                    buffer.begin() + ( pos - buffer.data() ) );
+    }
+
+    if ( pending > 0u )
+    {
+      flush();
+    }
+    std::fflush( out );
+    return total;
+  }
+
+}  // namespace isai
@@ -0,0 +1,296 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_CLASSIFIER_H_INCLUDED
+#define ISAI_KOHRIS_CLASSIFIER_H_INCLUDED
+
+#include "model.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace isai
+{
+
+  // assigns inputs [0, count) to their nearest centroids (row-major, k of
+  // them), storing centroid index and (unless null) squared distance of each
+  template < typename T, std::size_t N >
+  using basic_assign_kernel_t =
+    void ( * )( T const *centroids, std::size_t k,
+                basic_features_t< T, N > const *inputs, std::size_t count,
+                std::size_t *labels, T *sqr_distances );
+
+  // there are only few centroids, so kernels vectorize over inputs - block
+  // of inputs is gathered into lanes (features are stored contiguously) and
+  // compared with broadcast centroid; partial last block is transposed;
+  // distances are summed in the same order as sqr_distance_to (and ties go
+  // to lower index), so all kernels agree exactly with scalar code
+
+  template < typename T, std::size_t N >
+  void assign_scalar( T const *centroids, std::size_t k,
+                      basic_features_t< T, N > const *inputs,
+                      std::size_t count, std::size_t *labels,
+                      T *sqr_distances )
+  {
+    for ( auto i = std::size_t{ 0 }; i < count; i++ )
+    {
+      auto best = basic_winner_t< T >{ 0u, std::numeric_limits< T >::max() };
+      for ( auto c = std::size_t{ 0 }; c < k; c++ )
+      {
+        auto res = T{ 0 };
+        static_for< N >( [&]( auto d ) {
+          auto diff = inputs[ i ][ d ] - centroids[ c * N + d ];
+          res += diff * diff;
+        } );
+        if ( res < best.sqr_distance )
+        {
+          best = basic_winner_t< T >{ c, res };
+        }
+      }
+      labels[ i ] = best.index;
+      if ( sqr_distances != nullptr )
+      {
+        sqr_distances[ i ] = best.sqr_distance;
+      }
+    }
+  }
+
+  static_assert( sizeof( features_t ) == sizeof( scalar_t ) * iris_dimension,
+                 "features must be stored contiguously" );
+
+  namespace detail
+  {
+    // transposes up to Width inputs into lanes (missing ones are zero)
+    template < typename T, std::size_t N, std::size_t Width >
+    void transpose_block( basic_features_t< T, N > const *inputs,
+                          std::size_t count, T ( &lanes )[ N ][ Width ] )
+    {
+      for ( auto l = std::size_t{ 0 }; l < Width; l++ )
+      {
+        static_for< N >( [&]( auto d ) {
+          lanes[ d ][ l ] = l < count ? inputs[ l ][ d ] : T{ 0 };
+        } );
+      }
+    }
+
+    template < typename T, std::size_t Width >
+    void store_block( T const *vals, std::size_t const *ixs,
+                      std::size_t count, std::size_t *labels,
+                      T *sqr_distances )
+    {
+      for ( auto l = std::size_t{ 0 }; l < std::min( count, Width ); l++ )
+      {
+        labels[ l ] = ixs[ l ];
+        if ( sqr_distances != nullptr )
+        {
+          sqr_distances[ l ] = vals[ l ];
+        }
+      }
+    }
+  }  // namespace detail
+
+  template < typename T, std::size_t N >
+  ISAI_TARGET_AVX2 void
+  assign_avx2( T const *centroids, std::size_t k,
+               basic_features_t< T, N > const *inputs, std::size_t count,
+               std::size_t *labels, T *sqr_distances )
+  {
+    using ops = detail::avx2_ops_t< T >;
+    constexpr auto width = ops::width;
+
+    alignas( 64 ) T lanes[ N ][ width ];
+    T vals[ width ];
+    std::size_t ixs[ width ];
+    for ( auto i = std::size_t{ 0 }; i < count; i += width )
+    {
+      typename ops::vec_t in[ N ];
+      if ( count - i >= width )
+      {
+        for ( auto d = std::size_t{ 0 }; d < N; d++ )
+        {
+          in[ d ] = ops::gather( inputs[ i ].data() + d, N );
+        }
+      }
+      else
+      {
+        detail::transpose_block( inputs + i, count - i, lanes );
+        for ( auto d = std::size_t{ 0 }; d < N; d++ )
+        {
+          in[ d ] = ops::load( lanes[ d ] );
+        }
+      }
+
+      auto best_val = ops::set1( std::numeric_limits< T >::max() );
+      auto best_ix = ops::ix_set1( 0u );
+      for ( auto c = std::size_t{ 0 }; c < k; c++ )
+      {
+        auto res = ops::zero();
+        for ( auto d = std::size_t{ 0 }; d < N; d++ )
+        {
+          auto diff = ops::sub( in[ d ], ops::set1( centroids[ c * N + d ] ) );
+          res = ops::add( res, ops::mul( diff, diff ) );
+        }
+        auto mask = ops::less( res, best_val );
+        best_val = ops::blend( mask, best_val, res );
+        best_ix = ops::ix_blend( mask, best_ix, ops::ix_set1( c ) );
+      }
+
+      ops::store( vals, best_val );
+      ops::ix_store( ixs, best_ix );
+      detail::store_block< T, width >(
+        vals, ixs, count - i, labels + i,
+        sqr_distances != nullptr ? sqr_distances + i : nullptr );
+    }
+  }
+
+  template < typename T, std::size_t N >
+  ISAI_TARGET_AVX512 void
+  assign_avx512( T const *centroids, std::size_t k,
+                 basic_features_t< T, N > const *inputs, std::size_t count,
+                 std::size_t *labels, T *sqr_distances )
+  {
+    using ops = detail::avx512_ops_t< T >;
+    constexpr auto width = ops::width;
+
+    alignas( 64 ) T lanes[ N ][ width ];
+    T vals[ width ];
+    std::size_t ixs[ width ];
+    for ( auto i = std::size_t{ 0 }; i < count; i += width )
+    {
+      typename ops::vec_t in[ N ];
+      if ( count - i >= width )
+      {
+        for ( auto d = std::size_t{ 0 }; d < N; d++ )
+        {
+          in[ d ] = ops::gather( inputs[ i ].data() + d, N );
+        }
+      }
+      else
+      {
+        detail::transpose_block( inputs + i, count - i, lanes );
+        for ( auto d = std::size_t{ 0 }; d < N; d++ )
+        {
+          in[ d ] = ops::load( lanes[ d ] );
+        }
+      }
+
+      auto best_val = ops::set1( std::numeric_limits< T >::max() );
+      auto best_ix = ops::ix_set1( 0u );
+      for ( auto c = std::size_t{ 0 }; c < k; c++ )
+      {
+        auto res = ops::zero();
+        for ( auto d = std::size_t{ 0 }; d < N; d++ )
+        {
+          auto diff = ops::sub( in[ d ], ops::set1( centroids[ c * N + d ] ) );
+          res = ops::add( res, ops::mul( diff, diff ) );
+        }
+        auto mask = ops::less( res, best_val );
+        best_val = ops::blend( mask, best_val, res );
+        best_ix = ops::ix_blend( mask, best_ix, ops::ix_set1( c ) );
+      }
+
+      ops::store( vals, best_val );
+      ops::ix_store( ixs, best_ix );
+      detail::store_block< T, width >(
+        vals, ixs, count - i, labels + i,
+        sqr_distances != nullptr ? sqr_distances + i : nullptr );
+    }
+  }
+
+  // assignment kernel for given instruction set (or best one supported)
+  template < typename T, std::size_t N >
+  basic_assign_kernel_t< T, N > get_assign_kernel( simd_level_t level ) noexcept
+  {
+    switch ( resolve_simd_level( level ) )
+    {
+      case simd_level_t::avx512:
+        return &assign_avx512< T, N >;
+      case simd_level_t::avx2:
+        return &assign_avx2< T, N >;
+      default:
+        return &assign_scalar< T, N >;
+    }
+  }
+
+  // nearest centroid classifier of trained model, independent of training
+  // code - batches are split among threads of its own pool and results go
+  // straight to caller's buffers (nothing is allocated per call)
+  template < typename T, std::size_t N >
+  class basic_classifier_t
+  {
+  public:
+    using features_type = basic_features_t< T, N >;
+    using model_type = basic_model_t< T, N >;
+
+    explicit basic_classifier_t( model_type const &model,
+                                 simd_level_t level = simd_level_t::automatic,
+                                 std::size_t thread_count = 1u ) :
+      m_centroids( model.weights(), model.weights() + model.size() * N ),
+      m_kernel( get_assign_kernel< T, N >( level ) ),
+      m_pool( std::make_unique< thread_pool_t >( thread_count ) )
+    {
+    }
+
+    std::size_t size() const noexcept { return m_centroids.size() / N; }
+
+    // labels (and, unless null, squared distances) of count inputs already
+    // prepared by model (see basic_model_t::prepare)
+    void classify( features_type const *inputs, std::size_t count,
+                   std::size_t *labels, T *sqr_distances = nullptr )
+    {
+      if ( m_pool->size() == 1u )
+      {
+        assign( inputs, count, labels, sqr_distances );
+        return;
+      }
+
+      // parts are multiples of widest block, so only last one has tail
+      m_pool->run( [&]( std::size_t ix ) {
+        auto part =
+          thread_pool_t::split( count, m_pool->size(), ix, block_size );
+        if ( part.first < part.second )
+        {
+          assign( inputs + part.first, part.second - part.first,
+                  labels + part.first,
+                  sqr_distances != nullptr ? sqr_distances + part.first
+                                           : nullptr );
+        }
+      } );
+    }
+
+    // same on calling thread only (may be called from several threads at
+    // once, e.g. by ones of caller's own pool)
+    void assign( features_type const *inputs, std::size_t count,
+                 std::size_t *labels, T *sqr_distances = nullptr ) const
+    {
+      m_kernel( m_centroids.data(), size(), inputs, count, labels,
+                sqr_distances );
+    }
+
+  private:
+    static constexpr std::size_t block_size = 16u;
+
+    std::vector< T > m_centroids;
+    basic_assign_kernel_t< T, N > m_kernel;
+    std::unique_ptr< thread_pool_t > m_pool;
+  };
+
+  using classifier_t = basic_classifier_t< scalar_t, iris_dimension >;
+
+  // streaming mode - reads points from input, one per line (first N - 1
+  // delimited columns are raw features, anything after them is ignored),
+  // and writes index of nearest centroid for each of them; points are
+  // classified in batches; returns number of points classified, throws
+  // std::runtime_error on malformed input
+  std::size_t classify_stream( model_t const &model, std::FILE *in,
+                               std::FILE *out,
+                               simd_level_t level = simd_level_t::automatic,
+                               std::size_t thread_count = 1u,
+                               char delimiter = ',',
+                               std::size_t batch_size = 65536u );
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_CLASSIFIER_H_INCLUDED
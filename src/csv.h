@@ -0,0 +1,380 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_CSV_H_INCLUDED
+#define ISAI_KOHRIS_CSV_H_INCLUDED
+
+#include "mapped_file.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace isai
+{
+
+  // layout of delimited text file - numeric feature columns plus one label
+  // column (features are all other columns, in file order)
+  struct csv_schema_t
+  {
+    static constexpr std::size_t last_column =
+      std::numeric_limits< std::size_t >::max();
+
+    char delimiter = ',';
+    std::size_t label_column = last_column;
+    bool has_header = false;
+
+    // label values in order (label of row is index of its name); when empty,
+    // labels are numbered in order of their first appearance in file
+    std::vector< std::string > label_names = iris_label_names();
+
+    static std::vector< std::string > iris_label_names()
+    {
+      return { "Iris-setosa", "Iris-versicolor", "Iris-virginica" };
+    }
+  };
+
+  namespace detail
+  {
+
+    inline bool is_blank( char c ) noexcept
+    {
+      return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    // limits of exact fast path - mantissa and power of ten both exactly
+    // representable, so single (correctly rounded) division gives the same
+    // result as from_chars
+    template < typename T >
+    struct decimal_limits_t;
+
+    template <>
+    struct decimal_limits_t< double >
+    {
+      static constexpr std::uint64_t max_mantissa = std::uint64_t{ 1 } << 53u;
+      static constexpr int max_exponent = 22;
+    };
+
+    template <>
+    struct decimal_limits_t< float >
+    {
+      static constexpr std::uint64_t max_mantissa = std::uint64_t{ 1 } << 24u;
+      static constexpr int max_exponent = 10;
+    };
+
+    // parses number at the beginning of [first, last), returns pointer past
+    // it (or null if there is none); plain decimals such as "-12.345" take
+    // the fast path, anything else is left to from_chars
+    template < typename T >
+    char const *parse_number( char const *first, char const *last, T &value )
+    {
+      constexpr double powers_of_ten[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+      };
+      using limits = decimal_limits_t< T >;
+
+      auto p = first;
+      auto is_negative = p != last && *p == '-';
+      p += is_negative ? 1 : 0;
+
+      auto mantissa = std::uint64_t{ 0 };
+      auto digit_count = 0;
+      auto fraction_count = 0;
+      for ( ; p != last && *p >= '0' && *p <= '9'; p++, digit_count++ )
+      {
+        mantissa = mantissa * 10u + static_cast< std::uint64_t >( *p - '0' );
+      }
+      if ( p != last && *p == '.' )
+      {
+        for ( p++; p != last && *p >= '0' && *p <= '9'; p++, digit_count++ )
+        {
+          mantissa = mantissa * 10u + static_cast< std::uint64_t >( *p - '0' );
+          fraction_count++;
+        }
+      }
+
+      auto is_plain = digit_count > 0 && digit_count <= 19 &&
+                      ( p == last || ( *p != 'e' && *p != 'E' ) );
+      if ( is_plain && mantissa <= limits::max_mantissa &&
+           fraction_count <= limits::max_exponent )
+      {
+        value = static_cast< T >( mantissa ) /
+                static_cast< T >( powers_of_ten[ fraction_count ] );
+        value = is_negative ? -value : value;
+        return p;
+      }
+
+      auto res = std::from_chars( first, last, value );
+      return res.ec == std::errc{} ? res.ptr : nullptr;
+    }
+
+    // rows parsed from one part of file; with dynamic labels, label values
+    // are local indices into names (remapped when parts are merged)
+    template < typename DataPoint >
+    struct csv_part_t
+    {
+      std::vector< DataPoint > rows = std::vector< DataPoint >{};
+      std::vector< std::string_view > names =
+        std::vector< std::string_view >{};
+      char const *error_at = nullptr;
+      char const *error = nullptr;
+    };
+
+    // parses complete lines of [begin, end) in place, in single pass - fields
+    // are never copied and numbers are parsed straight from mapped memory
+    template < typename DataPoint >
+    void parse_csv_part( char const *begin, char const *end,
+                         csv_schema_t const &schema,
+                         csv_part_t< DataPoint > &part )
+    {
+      using features_type = decltype( DataPoint::features );
+      using label_type = decltype( DataPoint::label );
+      using value_type = typename features_type::value_type;
+      constexpr auto feature_count =
+        std::tuple_size< features_type >::value - 1u;
+
+      auto label_col = std::min( schema.label_column, feature_count );
+      auto delim = schema.delimiter;
+
+      // reserve according to length of first line (exact for fixed width)
+      auto first_nl = static_cast< char const * >(
+        std::memchr( begin, '\n', static_cast< std::size_t >( end - begin ) ) );
+      if ( first_nl != nullptr )
+      {
+        auto line_size = static_cast< std::size_t >( first_nl - begin + 1 );
+        part.rows.reserve(
+          static_cast< std::size_t >( end - begin ) / line_size + 1u );
+      }
+
+      auto fail = [&part]( char const *at, char const *error ) {
+        part.error_at = at;
+        part.error = error;
+      };
+
+      for ( auto pos = begin; pos < end; )
+      {
+        auto line_begin = pos;
+        auto line_end = static_cast< char const * >(
+          std::memchr( pos, '\n', static_cast< std::size_t >( end - pos ) ) );
+        line_end = line_end == nullptr ? end : line_end;
+        pos = line_end + 1;
+
+        auto p = line_begin;
+        while ( p != line_end && is_blank( *p ) )
+        {
+          p++;
+        }
+        if ( p == line_end )
+        {
+          continue;
+        }
+
+        auto dp = DataPoint{};
+        auto d = std::size_t{ 0 };
+        auto has_label = false;
+        for ( auto col = std::size_t{ 0 };; col++ )
+        {
+          while ( p != line_end && is_blank( *p ) )
+          {
+            p++;
+          }
+
+          if ( col == label_col )
+          {
+            auto field_end = static_cast< char const * >( std::memchr(
+              p, delim, static_cast< std::size_t >( line_end - p ) ) );
+            field_end = field_end == nullptr ? line_end : field_end;
+            auto label_end = field_end;
+            while ( label_end != p && is_blank( label_end[ -1 ] ) )
+            {
+              label_end--;
+            }
+            auto field = std::string_view{
+              p, static_cast< std::size_t >( label_end - p ) };
+            p = field_end;
+
+            auto label_ix = std::size_t{ 0 };
+            if ( !schema.label_names.empty() )
+            {
+              auto const &names = schema.label_names;
+              label_ix = static_cast< std::size_t >(
+                std::find( names.begin(), names.end(), field ) -
+                names.begin() );
+              if ( label_ix == names.size() )
+              {
+                return fail( line_begin, "unknown label" );
+              }
+            }
+            else
+            {
+              auto &names = part.names;
+              label_ix = static_cast< std::size_t >(
+                std::find( names.begin(), names.end(), field ) -
+                names.begin() );
+              if ( label_ix == names.size() )
+              {
+                names.emplace_back( field );
+              }
+            }
+            dp.label = static_cast< label_type >( label_ix );
+            has_label = true;
+          }
+          else
+          {
+            if ( d == feature_count )
+            {
+              return fail( line_begin, "too many columns" );
+            }
+            p = parse_number( p, line_end, dp.features[ d++ ] );
+            while ( p != nullptr && p != line_end && is_blank( *p ) )
+            {
+              p++;
+            }
+            if ( p == nullptr || ( p != line_end && *p != delim ) )
+            {
+              return fail( line_begin, "malformed number" );
+            }
+          }
+
+          if ( p == line_end )
+          {
+            break;
+          }
+          p++;  // delimiter
+        }
+
+        if ( d != feature_count || !has_label )
+        {
+          return fail( line_begin, "too few columns" );
+        }
+        dp.features[ feature_count ] = value_type{ 0 };
+        part.rows.emplace_back( dp );
+      }
+    }
+
+  }  // namespace detail
+
+  // loads delimited file with given schema - file is memory mapped and split
+  // at line boundaries into one part per thread; rows keep file order;
+  // throws std::system_error if file cannot be read, std::runtime_error
+  // (with line number) on malformed content; unless null, label_names
+  // receives names of label values
+  template < typename DataPoint >
+  std::vector< DataPoint >
+  load_csv( char const *path, csv_schema_t const &schema,
+            std::size_t thread_count = 1u,
+            std::vector< std::string > *label_names = nullptr )
+  {
+    auto file = mapped_file_t{ path };
+    auto text = file.view();
+    auto begin = text.data();
+    auto end = text.data() + text.size();
+
+    if ( schema.has_header )
+    {
+      auto header_end = text.find( '\n' );
+      begin = header_end == std::string_view::npos ? end
+                                                   : begin + header_end + 1u;
+    }
+
+    auto pool = thread_pool_t{ thread_count };
+    auto parts =
+      std::vector< detail::csv_part_t< DataPoint > >( pool.size() );
+
+    // part boundaries moved forward to nearest line start
+    auto bounds = std::vector< char const * >( pool.size() + 1u, end );
+    bounds[ 0 ] = begin;
+    for ( auto p = std::size_t{ 1 }; p < pool.size(); p++ )
+    {
+      auto split = thread_pool_t::split(
+        static_cast< std::size_t >( end - begin ), pool.size(), p );
+      auto at = std::max( begin + split.first, bounds[ p - 1u ] );
+      auto nl = static_cast< char const * >(
+        std::memchr( at, '\n', static_cast< std::size_t >( end - at ) ) );
+      bounds[ p ] = nl == nullptr ? end : nl + 1;
+    }
+
+    pool.run( [&]( std::size_t ix ) {
+      detail::parse_csv_part( bounds[ ix ], bounds[ ix + 1u ], schema,
+                              parts[ ix ] );
+    } );
+
+    // merge parts in file order (also numbering dynamic labels globally)
+    auto total = std::size_t{ 0 };
+    auto names = std::vector< std::string_view >{};
+    auto local = std::vector< std::size_t >{};
+    for ( auto &&part : parts )
+    {
+      if ( part.error != nullptr )
+      {
+        auto line_no = std::count( text.data(), part.error_at, '\n' ) + 1;
+        throw std::runtime_error{ std::string{ path } + ":" +
+                                  std::to_string( line_no ) + ": " +
+                                  part.error };
+      }
+      total += part.rows.size();
+    }
+
+    auto store_names = [&]( auto const &views ) {
+      if ( label_names != nullptr )
+      {
+        label_names->assign( schema.label_names.begin(),
+                             schema.label_names.end() );
+        if ( schema.label_names.empty() )
+        {
+          for ( auto &&name : views )
+          {
+            label_names->emplace_back( name );
+          }
+        }
+      }
+    };
+
+    // single part is already numbered in order of first appearance
+    if ( parts.size() == 1u )
+    {
+      store_names( parts[ 0 ].names );
+      return std::move( parts[ 0 ].rows );
+    }
+
+    auto res = std::vector< DataPoint >{};
+    res.reserve( total );
+    for ( auto &&part : parts )
+    {
+      local.clear();
+      for ( auto &&name : part.names )
+      {
+        auto ix = static_cast< std::size_t >(
+          std::find( names.begin(), names.end(), name ) - names.begin() );
+        if ( ix == names.size() )
+        {
+          names.emplace_back( name );
+        }
+        local.emplace_back( ix );
+      }
+      for ( auto &&dp : part.rows )
+      {
+        if ( !local.empty() )
+        {
+          dp.label = static_cast< decltype( dp.label ) >(
+            local[ static_cast< std::size_t >( dp.label ) ] );
+        }
+        res.emplace_back( dp );
+      }
+    }
+
+    store_names( names );
+    return res;
+  }
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_CSV_H_INCLUDED
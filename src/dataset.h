@@ -3,82 +3,169 @@
 #ifndef ISAI_KOHRIS_DATASET_H_INCLUDED
 #define ISAI_KOHRIS_DATASET_H_INCLUDED
 
+#include "csv.h"
+#include "dataset_cache.h"
 #include "prng.h"
+#include "unroll.h"
 
 #include <algorithm>
 #include <array>
-#include <fstream>
+#include <cstdint>
+#include <cstdio>
+#include <numeric>
+#include <string>
 #include <vector>
 
 namespace isai
 {
 
-  // types of iris (labels)
-  enum class label_t
-  {
-    setosa,
-    versicolor,
-    virginica
-  };
+  // label of data point - index into label names of its dataset (see
+  // label_names() of dataset and chunked source)
+  using label_t = std::uint32_t;
 
-  // human-readable labels
-  constexpr char const *const iris_label_strs[] = { "iris setosa",
-                                                    "iris versicolor",
-                                                    "iris virginica" };
-  constexpr char const *label_to_string( label_t label )
+  // name of label, or "?" when names table does not have it
+  inline char const *label_to_string( std::vector< std::string > const &names,
+                                      label_t label )
   {
-    return iris_label_strs[ static_cast< int >( label ) ];
+    return label < names.size() ? names[ label ].c_str() : "?";
   }
 
-  // array of features
-  using features_t = std::array< double, 5 >;
+  // array of features (last coordinate is reserved for projection)
+  template < typename T, std::size_t N >
+  using basic_features_t = std::array< T, N >;
+
+  // scalar type used by default instantiations (selected at build time)
+#ifdef ISAI_KOHRIS_SINGLE_PRECISION
+  using scalar_t = float;
+#else
+  using scalar_t = double;
+#endif
+
+  // iris - four measured features plus projection coordinate
+  constexpr std::size_t iris_dimension = 5u;
+
+  using features_t = basic_features_t< scalar_t, iris_dimension >;
 
   // dot product
-  inline double operator*( features_t const &lhs, features_t const &rhs )
+  template < typename T, std::size_t N >
+  inline T operator*( std::array< T, N > const &lhs,
+                      std::array< T, N > const &rhs )
   {
-    return lhs[ 0 ] * rhs[ 0 ] + lhs[ 1 ] * rhs[ 1 ] + lhs[ 2 ] * rhs[ 2 ] +
-           lhs[ 3 ] * rhs[ 3 ] + lhs[ 4 ] * rhs[ 4 ];
+    auto res = lhs[ 0 ] * rhs[ 0 ];
+    static_for< N - 1u >(
+      [&]( auto d ) { res += lhs[ d + 1u ] * rhs[ d + 1u ]; } );
+    return res;
   }
 
   // point of data from iris dataset
-  struct data_point_t
+  template < typename T, std::size_t N >
+  struct basic_data_point_t
   {
-    features_t features;
+    basic_features_t< T, N > features;
     label_t label;
   };
 
+  using data_point_t = basic_data_point_t< scalar_t, iris_dimension >;
+
   // general utility stereographic normalization
-  void normalize_stereographic( features_t &features, double radius );
+  template < typename T, std::size_t N >
+  void normalize_stereographic( std::array< T, N > &features, T radius )
+  {
+    auto rcoeff = T{ 4 } * radius * radius;
+    auto sum = T{ 0 };
+    static_for< N >(
+      [&]( auto d ) { sum += features[ d ] * features[ d ]; } );
+    auto den = rcoeff + sum;
+
+    static_for< N - 1u >(
+      [&]( auto d ) { features[ d ] = ( rcoeff * features[ d ] ) / den; } );
+    features[ N - 1u ] = ( sum - rcoeff ) / den;
+  }
+
+  // default dataset (iris, labels in last column)
+  constexpr char const *const iris_csv_path = "data/iris.csv";
 
   // stores iris dataset and provides basic helper functionalities
-  class dataset_t
+  template < typename T, std::size_t N >
+  class basic_dataset_t
   {
   public:
-    // basic constructor
-    explicit dataset_t( std::size_t training_count,
-                        double proj_sphere_radius = 1.0,
-                        bool do_sign_balancing = false ) :
+    using features_type = basic_features_t< T, N >;
+    using data_point_type = basic_data_point_t< T, N >;
+    using preprocessing_type = basic_preprocessing_t< T, N >;
+
+    // basic constructor (with cache directory given, preprocessed data is
+    // taken from binary cache when source and settings did not change)
+    explicit basic_dataset_t( std::size_t training_count,
+                              double proj_sphere_radius = 1.0,
+                              bool do_sign_balancing = false,
+                              char const *const path = iris_csv_path,
+                              csv_schema_t const &schema = csv_schema_t{},
+                              std::size_t thread_count = 1u,
+                              char const *const cache_dir = nullptr ) :
       m_training_count( training_count )
     {
-      // load data from file
-      load_from_file( "data/iris.csv" );
+      m_preprocessing.radius = proj_sphere_radius;
+      m_preprocessing.is_balanced = do_sign_balancing;
 
-      // preprocessing
-      if ( do_sign_balancing )
+      auto cache_path = std::string{};
+      auto cache_key = std::uint64_t{ 0 };
+      if ( cache_dir != nullptr && *cache_dir != '\0' )
       {
-        balance_signs();
+        cache_key = make_dataset_cache_key( path, schema, proj_sphere_radius,
+                                            do_sign_balancing, sizeof( T ), N );
+        cache_path = make_dataset_cache_path( cache_dir, path, cache_key );
+        m_is_cached =
+          read_dataset_cache( cache_path.c_str(), cache_key, m_data,
+                              m_label_names, m_preprocessing );
       }
-      normalize( proj_sphere_radius );
+
+      if ( !m_is_cached )
+      {
+        // load data from file
+        load_from_file( path, schema, thread_count );
+
+        // preprocessing
+        if ( do_sign_balancing )
+        {
+          balance_signs();
+        }
+        normalize( static_cast< T >( proj_sphere_radius ) );
+
+        if ( !cache_path.empty() )
+        {
+          write_dataset_cache( cache_path.c_str(), cache_key, m_data,
+                               m_label_names, m_preprocessing );
+        }
+      }
+      assert( m_training_count <= size() );
 
       // randomly split to training and test sets
       prng_t::shuffle( m_data );
     }
 
     // default copy/move constructors/assignments
-    dataset_t( dataset_t const & ) = default;
-    dataset_t( dataset_t && ) noexcept = default;
-    dataset_t &operator=( dataset_t const & ) = default;
-    dataset_t &operator=( dataset_t && ) noexcept = default;
+    basic_dataset_t( basic_dataset_t const & ) = default;
+    basic_dataset_t( basic_dataset_t && ) noexcept = default;
+    basic_dataset_t &operator=( basic_dataset_t const & ) = default;
+    basic_dataset_t &operator=( basic_dataset_t && ) noexcept = default;
+
+    // parameters data was preprocessed with (means are zero unless signs
+    // were balanced)
+    preprocessing_type const &preprocessing() const noexcept
+    {
+      return m_preprocessing;
+    }
+
+    // names of labels, indexed by label value (schema ones, or names in
+    // order of first appearance in file)
+    std::vector< std::string > const &label_names() const noexcept
+    {
+      return m_label_names;
+    }
+
+    // whether data came from binary cache instead of source file
+    bool is_cached() const noexcept { return m_is_cached; }
 
     // size and iterators for whole dataset
     std::size_t size() const noexcept { return m_data.size(); }
@@ -92,7 +179,7 @@ namespace isai
     {
       return m_data.begin() +
              static_cast< typename std::vector<
-               data_point_t >::iterator::difference_type >( train_size() );
+               data_point_type >::iterator::difference_type >( train_size() );
     }
 
     // size and iterators for test set
@@ -104,19 +191,41 @@ namespace isai
     {
       return m_data.begin() +
              static_cast< typename std::vector<
-               data_point_t >::iterator::difference_type >( train_size() );
+               data_point_type >::iterator::difference_type >( train_size() );
     }
     auto test_end() const noexcept { return m_data.end(); }
 
     // debug print
-    void print( bool is_normalized = true ) const;
+    void print( bool is_normalized = true ) const
+    {
+      for ( auto &&dp : m_data )
+      {
+        std::printf( "[ " );
+        for ( auto d = std::size_t{ 0 }; d + 1u < N; d++ )
+        {
+          std::printf( "%8.3f ", static_cast< double >( dp.features[ d ] ) );
+        }
+        if ( is_normalized )
+        {
+          std::printf( "%8.3f",
+                       static_cast< double >( dp.features[ N - 1u ] ) );
+        }
+        std::printf( " ] <- %s\n",
+                     label_to_string( m_label_names, dp.label ) );
+      }
+    }
 
   private:
-    // loads iris dataset form file
-    void load_from_file( char const *path );
+    // loads dataset from delimited file (features, then label by default)
+    void load_from_file( char const *const path, csv_schema_t const &schema,
+                         std::size_t thread_count )
+    {
+      m_data = load_csv< data_point_type >( path, schema, thread_count,
+                                            &m_label_names );
+    }
 
     // normalizes each featurre vector using stereographic projection
-    void normalize( double radius )
+    void normalize( T radius )
     {
       for ( auto &&dp : m_data )
       {
@@ -125,13 +234,37 @@ namespace isai
     }
 
     // balance values to have both signs
-    void balance_signs();
+    void balance_signs()
+    {
+      auto avgs = std::accumulate(
+        m_data.begin(), m_data.end(), std::array< T, N - 1u >{},
+        []( auto &&acc, auto &&dp ) {
+          static_for< N - 1u >(
+            [&]( auto d ) { acc[ d ] += dp.features[ d ]; } );
+          return acc;
+        } );
+      std::transform( avgs.begin(), avgs.end(), avgs.begin(),
+                      [this]( auto avg_val ) {
+                        return avg_val / static_cast< T >( size() );
+                      } );
+      for ( auto &&dp : m_data )
+      {
+        static_for< N - 1u >(
+          [&]( auto d ) { dp.features[ d ] -= avgs[ d ]; } );
+      }
+      m_preprocessing.means = avgs;
+    }
 
   private:
-    std::vector< data_point_t > m_data = std::vector< data_point_t >{};
+    std::vector< data_point_type > m_data = std::vector< data_point_type >{};
+    std::vector< std::string > m_label_names = std::vector< std::string >{};
     std::size_t m_training_count;
+    preprocessing_type m_preprocessing = preprocessing_type{};
+    bool m_is_cached = false;
   };
 
+  using dataset_t = basic_dataset_t< scalar_t, iris_dimension >;
+
 }  // namespace isai
 
 #endif  // !ISAI_KOHRIS_DATASET_H_INCLUDED
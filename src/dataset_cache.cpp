@@ -0,0 +1,108 @@
+#include "dataset_cache.h"
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/stat.h>
+
+namespace isai
+{
+
+  namespace
+  {
+
+    // fnv-1a - key only has to tell apart different inputs, not resist
+    // attacks
+    class key_hasher_t
+    {
+    public:
+      void add( void const *data, std::size_t size ) noexcept
+      {
+        auto bytes = static_cast< unsigned char const * >( data );
+        for ( auto i = std::size_t{ 0 }; i < size; i++ )
+        {
+          m_hash = ( m_hash ^ bytes[ i ] ) * 0x100000001b3ull;
+        }
+      }
+
+      template < typename T >
+      void add( T const &value ) noexcept
+      {
+        add( &value, sizeof( value ) );
+      }
+
+      void add( std::string const &str ) noexcept
+      {
+        add( str.size() );
+        add( str.data(), str.size() );
+      }
+
+      std::uint64_t hash() const noexcept { return m_hash; }
+
+    private:
+      std::uint64_t m_hash = 0xcbf29ce484222325ull;
+    };
+
+    std::string absolute_path( char const *path )
+    {
+      char buffer[ PATH_MAX ];
+      return ::realpath( path, buffer ) != nullptr ? std::string{ buffer }
+                                                   : std::string{ path };
+    }
+
+  }  // namespace
+
+  std::uint64_t make_dataset_cache_key( char const *source,
+                                        csv_schema_t const &schema,
+                                        double radius, bool is_balanced,
+                                        std::size_t scalar_size,
+                                        std::size_t dimension )
+  {
+    auto hasher = key_hasher_t{};
+    hasher.add( dataset_cache_version );
+    hasher.add( absolute_path( source ) );
+
+    struct stat st = {};
+    if ( ::stat( source, &st ) == 0 )
+    {
+      hasher.add( static_cast< std::int64_t >( st.st_size ) );
+      hasher.add( static_cast< std::int64_t >( st.st_mtim.tv_sec ) );
+      hasher.add( static_cast< std::int64_t >( st.st_mtim.tv_nsec ) );
+    }
+
+    hasher.add( schema.delimiter );
+    hasher.add( static_cast< std::uint64_t >( schema.label_column ) );
+    hasher.add( schema.has_header );
+    hasher.add( static_cast< std::uint64_t >( schema.label_names.size() ) );
+    for ( auto &&name : schema.label_names )
+    {
+      hasher.add( name );
+    }
+
+    hasher.add( radius );
+    hasher.add( is_balanced );
+    hasher.add( static_cast< std::uint64_t >( scalar_size ) );
+    hasher.add( static_cast< std::uint64_t >( dimension ) );
+    return hasher.hash();
+  }
+
+  std::string make_dataset_cache_path( char const *dir, char const *source,
+                                       std::uint64_t key )
+  {
+    ::mkdir( dir, 0755 );  // NOLINT (may already exist)
+
+    auto name = std::string{ source };
+    auto slash = name.find_last_of( '/' );
+    if ( slash != std::string::npos )
+    {
+      name.erase( 0u, slash + 1u );
+    }
+
+    char suffix[ 32 ];
+    std::snprintf( suffix, sizeof( suffix ), ".%016llx.bin",
+                   static_cast< unsigned long long >( key ) );
+    return std::string{ dir } + "/" + name + suffix;
+  }
+
+}  // namespace isai
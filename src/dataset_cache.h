@@ -0,0 +1,247 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_DATASET_CACHE_H_INCLUDED
+#define ISAI_KOHRIS_DATASET_CACHE_H_INCLUDED
+
+#include "csv.h"
+#include "mapped_file.h"
+#include "unroll.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace isai
+{
+
+  // binary cache of preprocessed dataset (sign balanced and normalized, in
+  // file order) - fixed header, balancing means, then one 64-byte aligned
+  // column per feature coordinate, column of labels and label names (count,
+  // then length and characters of each)
+
+  // bump whenever layout or preprocessing changes
+  constexpr std::uint32_t dataset_cache_version = 2u;
+
+  struct dataset_cache_header_t
+  {
+    char magic[ 8 ];
+    std::uint32_t version;
+    std::uint32_t scalar_size;
+    std::uint64_t dimension;
+    std::uint64_t row_count;
+    std::uint64_t key;
+    double radius;
+    std::uint64_t is_balanced;
+  };
+
+  constexpr char dataset_cache_magic[ 8 ] = "KOHRISD";
+
+  // preprocessing parameters stored along with data
+  template < typename T, std::size_t N >
+  struct basic_preprocessing_t
+  {
+    double radius = 1.0;
+    bool is_balanced = false;
+    std::array< T, N - 1u > means = std::array< T, N - 1u >{};
+  };
+
+  // identifies source file (absolute path, size and modification time) and
+  // all settings affecting preprocessed contents
+  std::uint64_t make_dataset_cache_key( char const *source,
+                                        csv_schema_t const &schema,
+                                        double radius, bool is_balanced,
+                                        std::size_t scalar_size,
+                                        std::size_t dimension );
+
+  // cache file for given source and key (directory is created if missing)
+  std::string make_dataset_cache_path( char const *dir, char const *source,
+                                       std::uint64_t key );
+
+  namespace detail
+  {
+    constexpr std::size_t align_cache_offset( std::size_t offset ) noexcept
+    {
+      return ( offset + 63u ) / 64u * 64u;
+    }
+
+    // offsets of sections within cache file
+    template < typename T, std::size_t N >
+    struct cache_layout_t
+    {
+      explicit cache_layout_t( std::size_t rows ) noexcept :
+        means( align_cache_offset( sizeof( dataset_cache_header_t ) ) ),
+        column_size( align_cache_offset( rows * sizeof( T ) ) ),
+        columns( align_cache_offset( means + ( N - 1u ) * sizeof( T ) ) ),
+        labels( columns + N * column_size ),
+        size( labels + rows * sizeof( std::int32_t ) )
+      {
+      }
+
+      std::size_t means;
+      std::size_t column_size;
+      std::size_t columns;
+      std::size_t labels;
+      std::size_t size;  // without label names
+    };
+  }  // namespace detail
+
+  // reads cache into data; false if it is missing, stale or not compatible
+  template < typename T, std::size_t N, typename DataPoint >
+  bool read_dataset_cache( char const *path, std::uint64_t key,
+                           std::vector< DataPoint > &data,
+                           std::vector< std::string > &label_names,
+                           basic_preprocessing_t< T, N > &prep )
+  {
+    auto file = mapped_file_t{};
+    try
+    {
+      file = mapped_file_t{ path };
+    }
+    catch ( std::system_error const & )
+    {
+      return false;
+    }
+
+    auto header = dataset_cache_header_t{};
+    if ( file.size() < sizeof( header ) )
+    {
+      return false;
+    }
+    std::memcpy( &header, file.data(), sizeof( header ) );
+    // every row takes its features and label (checked before layout is
+    // computed from row count, which could overflow)
+    if ( header.row_count >
+         file.size() / ( N * sizeof( T ) + sizeof( std::int32_t ) ) )
+    {
+      return false;
+    }
+
+    auto layout =
+      detail::cache_layout_t< T, N >{ static_cast< std::size_t >(
+        header.row_count ) };
+    if ( std::memcmp( header.magic, dataset_cache_magic,
+                      sizeof( header.magic ) ) != 0 ||
+         header.version != dataset_cache_version ||
+         header.scalar_size != sizeof( T ) || header.dimension != N ||
+         header.key != key || file.size() < layout.size )
+    {
+      return false;
+    }
+
+    auto pos = layout.size;
+    auto get_u32 = [&file, &pos]( std::uint32_t &value ) {
+      if ( file.size() - pos < sizeof( value ) )
+      {
+        return false;
+      }
+      std::memcpy( &value, file.data() + pos, sizeof( value ) );
+      pos += sizeof( value );
+      return true;
+    };
+    auto name_count = std::uint32_t{};
+    if ( !get_u32( name_count ) )
+    {
+      return false;
+    }
+    auto names = std::vector< std::string >{};
+    for ( auto n = std::uint32_t{ 0 }; n < name_count; n++ )
+    {
+      auto length = std::uint32_t{};
+      if ( !get_u32( length ) || file.size() - pos < length )
+      {
+        return false;
+      }
+      names.emplace_back( file.data() + pos, length );
+      pos += length;
+    }
+    if ( pos != file.size() )
+    {
+      return false;
+    }
+    label_names = std::move( names );
+
+    prep.radius = header.radius;
+    prep.is_balanced = header.is_balanced != 0u;
+    std::memcpy( prep.means.data(), file.data() + layout.means,
+                 sizeof( prep.means ) );
+
+    // columns are gathered into rows (training streams rows many times),
+    // reading all columns side by side
+    auto rows = static_cast< std::size_t >( header.row_count );
+    auto cols = file.data() + layout.columns;
+    auto labels = file.data() + layout.labels;
+    data.resize( rows );
+    for ( auto i = std::size_t{ 0 }; i < rows; i++ )
+    {
+      auto &dp = data[ i ];
+      static_for< N >( [&]( auto d ) {
+        std::memcpy( &dp.features[ d ],
+                     cols + d * layout.column_size + i * sizeof( T ),
+                     sizeof( T ) );
+      } );
+      auto label = std::int32_t{};
+      std::memcpy( &label, labels + i * sizeof( label ), sizeof( label ) );
+      dp.label = static_cast< decltype( dp.label ) >( label );
+    }
+
+    return true;
+  }
+
+  // writes cache; false on failure - caching is best effort
+  template < typename T, std::size_t N, typename DataPoint >
+  bool write_dataset_cache( char const *path, std::uint64_t key,
+                            std::vector< DataPoint > const &data,
+                            std::vector< std::string > const &label_names,
+                            basic_preprocessing_t< T, N > const &prep )
+  {
+    auto rows = data.size();
+    auto layout = detail::cache_layout_t< T, N >{ rows };
+    auto buffer = std::vector< char >( layout.size, '\0' );
+    auto put_u32 = [&buffer]( std::size_t value ) {
+      auto v = static_cast< std::uint32_t >( value );
+      auto at = buffer.size();
+      buffer.resize( at + sizeof( v ) );
+      std::memcpy( buffer.data() + at, &v, sizeof( v ) );
+    };
+    put_u32( label_names.size() );
+    for ( auto &&name : label_names )
+    {
+      put_u32( name.size() );
+      buffer.insert( buffer.end(), name.begin(), name.end() );
+    }
+
+    auto header = dataset_cache_header_t{};
+    std::memcpy( header.magic, dataset_cache_magic, sizeof( header.magic ) );
+    header.version = dataset_cache_version;
+    header.scalar_size = sizeof( T );
+    header.dimension = N;
+    header.row_count = rows;
+    header.key = key;
+    header.radius = prep.radius;
+    header.is_balanced = prep.is_balanced ? 1u : 0u;
+    std::memcpy( buffer.data(), &header, sizeof( header ) );
+    std::memcpy( buffer.data() + layout.means, prep.means.data(),
+                 sizeof( prep.means ) );
+
+    auto cols = buffer.data() + layout.columns;
+    auto labels = buffer.data() + layout.labels;
+    for ( auto i = std::size_t{ 0 }; i < rows; i++ )
+    {
+      auto const &dp = data[ i ];
+      static_for< N >( [&]( auto d ) {
+        std::memcpy( cols + d * layout.column_size + i * sizeof( T ),
+                     &dp.features[ d ], sizeof( T ) );
+      } );
+      auto label = static_cast< std::int32_t >( dp.label );
+      std::memcpy( labels + i * sizeof( label ), &label, sizeof( label ) );
+    }
+
+    return write_file_atomically( path, buffer.data(), buffer.size() );
+  }
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_DATASET_CACHE_H_INCLUDED
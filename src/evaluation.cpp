@@ -0,0 +1,55 @@
+#include "evaluation.h"
+
+namespace isai
+{
+
+  void score_confusion( evaluation_t &evaluation )
+  {
+    evaluation.purity = 0.0;
+    evaluation.adjusted_rand_index = 0.0;
+    if ( evaluation.count == 0u || evaluation.confusion.empty() )
+    {
+      return;
+    }
+
+    auto pairs = []( double n ) { return n * ( n - 1.0 ) / 2.0; };
+    auto const &confusion = evaluation.confusion;
+    auto majority = 0.0;
+    auto index = 0.0;  // pairs sharing both label and cluster
+    auto cluster_pairs = 0.0;
+    for ( auto c = std::size_t{ 0 }; c < confusion[ 0 ].size(); c++ )
+    {
+      auto best = std::size_t{ 0 };
+      auto size = 0.0;
+      for ( auto &&row : confusion )
+      {
+        best = std::max( best, row[ c ] );
+        size += static_cast< double >( row[ c ] );
+        index += pairs( static_cast< double >( row[ c ] ) );
+      }
+      majority += static_cast< double >( best );
+      cluster_pairs += pairs( size );
+    }
+
+    auto label_pairs = 0.0;
+    for ( auto &&row : confusion )
+    {
+      auto size = 0.0;
+      for ( auto n : row )
+      {
+        size += static_cast< double >( n );
+      }
+      label_pairs += pairs( size );
+    }
+
+    auto count = static_cast< double >( evaluation.count );
+    evaluation.purity = majority / count;
+
+    auto expected =
+      count > 1.0 ? label_pairs * cluster_pairs / pairs( count ) : 0.0;
+    auto max = ( label_pairs + cluster_pairs ) / 2.0;
+    evaluation.adjusted_rand_index =
+      max == expected ? 1.0 : ( index - expected ) / ( max - expected );
+  }
+
+}  // namespace isai
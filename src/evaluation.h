@@ -0,0 +1,175 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_EVALUATION_H_INCLUDED
+#define ISAI_KOHRIS_EVALUATION_H_INCLUDED
+
+#include "aligned.h"
+#include "classifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+namespace isai
+{
+
+  // scores of clustering against known labels
+  struct evaluation_t
+  {
+    // inputs by actual label (rows) and assigned cluster (columns)
+    std::vector< std::vector< std::size_t > > confusion =
+      std::vector< std::vector< std::size_t > >{};
+    std::size_t count = 0u;  // inputs scored
+
+    // share of inputs in majority label of their cluster
+    double purity = 0.0;
+
+    // agreement of clusters with labels over all pairs of inputs,
+    // corrected for chance (1 - same partitions, about 0 - random ones)
+    double adjusted_rand_index = 0.0;
+
+    // mean distance of input to centroid of its cluster
+    double quantization_error = 0.0;
+  };
+
+  // fills purity and adjusted rand index from confusion matrix and count
+  void score_confusion( evaluation_t &evaluation );
+
+  // single pass evaluation of trained model on labeled data of any size -
+  // every add() splits its range among threads of evaluator's own pool,
+  // each of them classifying its part in small batches straight into its
+  // own confusion matrix and distance sum (nothing is kept per input);
+  // threads are reduced only when result is read; any number of clusters
+  // and labels (rows are added as labels show up)
+  template < typename T, std::size_t N >
+  class basic_evaluator_t
+  {
+  public:
+    using features_type = basic_features_t< T, N >;
+    using model_type = basic_model_t< T, N >;
+    using classifier_type = basic_classifier_t< T, N >;
+
+    explicit basic_evaluator_t( model_type const &model,
+                                simd_level_t level = simd_level_t::automatic,
+                                std::size_t thread_count = 1u ) :
+      m_classifier( model, level, 1u ),
+      m_pool( std::make_unique< thread_pool_t >( thread_count ) ),
+      m_parts( m_pool->size() )
+    {
+      assert( m_classifier.size() > 0u );
+    }
+
+    // scores data points of range (features preprocessed as training ones)
+    template < typename Iterator >
+    void add( Iterator begin, Iterator end )
+    {
+      auto count = static_cast< std::size_t >( std::distance( begin, end ) );
+      m_pool->run( [&]( std::size_t ix ) {
+        auto part = thread_pool_t::split( count, m_pool->size(), ix );
+        auto i = begin;
+        std::advance( i, part.first );
+        m_parts[ ix ].value.add( m_classifier, i, part.second - part.first );
+      } );
+    }
+
+    // reduction of all threads (in their order - result does not depend on
+    // scheduling)
+    evaluation_t result() const
+    {
+      auto res = evaluation_t{};
+      auto distance_sum = 0.0;
+      for ( auto &&p : m_parts )
+      {
+        auto const &part = p.value;
+        if ( res.confusion.size() < part.confusion.size() )
+        {
+          res.confusion.resize( part.confusion.size(),
+                                std::vector< std::size_t >(
+                                  m_classifier.size() ) );
+        }
+        for ( auto l = std::size_t{ 0 }; l < part.confusion.size(); l++ )
+        {
+          for ( auto c = std::size_t{ 0 }; c < m_classifier.size(); c++ )
+          {
+            res.confusion[ l ][ c ] += part.confusion[ l ][ c ];
+          }
+        }
+        res.count += part.count;
+        distance_sum += part.distance_sum;
+      }
+
+      if ( res.count != 0u )
+      {
+        res.quantization_error =
+          distance_sum / static_cast< double >( res.count );
+      }
+      score_confusion( res );
+      return res;
+    }
+
+  private:
+    static constexpr std::size_t batch_size = 1024u;
+
+    // state of one thread
+    struct part_t
+    {
+      template < typename Iterator >
+      void add( classifier_type const &classifier, Iterator i,
+                std::size_t remaining )
+      {
+        while ( remaining != 0u )
+        {
+          auto n = std::min( remaining, batch_size );
+          features.clear();
+          labels.clear();
+          for ( auto k = std::size_t{ 0 }; k < n; k++, i++ )
+          {
+            features.emplace_back( ( *i ).features );
+            labels.emplace_back( static_cast< std::size_t >( ( *i ).label ) );
+          }
+          clusters.resize( n );
+          sqr_distances.resize( n );
+          classifier.assign( features.data(), n, clusters.data(),
+                             sqr_distances.data() );
+
+          for ( auto k = std::size_t{ 0 }; k < n; k++ )
+          {
+            if ( labels[ k ] >= confusion.size() )
+            {
+              confusion.resize( labels[ k ] + 1u, std::vector< std::size_t >(
+                                                    classifier.size() ) );
+            }
+            confusion[ labels[ k ] ][ clusters[ k ] ]++;
+            distance_sum +=
+              std::sqrt( static_cast< double >( sqr_distances[ k ] ) );
+          }
+          count += n;
+          remaining -= n;
+        }
+      }
+
+      // batch scratch buffers
+      std::vector< features_type > features = std::vector< features_type >{};
+      std::vector< std::size_t > labels = std::vector< std::size_t >{};
+      std::vector< std::size_t > clusters = std::vector< std::size_t >{};
+      std::vector< T > sqr_distances = std::vector< T >{};
+
+      std::vector< std::vector< std::size_t > > confusion =
+        std::vector< std::vector< std::size_t > >{};
+      double distance_sum = 0.0;
+      std::size_t count = 0u;
+    };
+
+  private:
+    classifier_type m_classifier;
+    std::unique_ptr< thread_pool_t > m_pool;
+    std::vector< cache_padded_t< part_t > > m_parts;
+  };
+
+  using evaluator_t = basic_evaluator_t< scalar_t, iris_dimension >;
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_EVALUATION_H_INCLUDED
@@ -0,0 +1,564 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_INDEX_H_INCLUDED
+#define ISAI_KOHRIS_INDEX_H_INCLUDED
+
+#include "binary_io.h"
+#include "layer.h"
+#include "quantized.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+
+namespace isai
+{
+
+  // backend used to find best matching unit
+  enum class winner_search_t
+  {
+    exact,       // full (simd, optionally sharded) scan of hidden layer
+    projection,  // random projection trees - approximate
+    int16,       // quantized weights shortlist, exact rerank - approximate
+    int8         // same with coarser weights
+  };
+
+  constexpr char const *const winner_search_strs[] = { "exact", "projection",
+                                                       "int16", "int8" };
+  constexpr char const *winner_search_to_string( winner_search_t search )
+  {
+    return winner_search_strs[ static_cast< int >( search ) ];
+  }
+
+  // interface of approximate winner search structures kept alongside
+  // hidden layer
+  template < typename T, std::size_t N >
+  class basic_winner_index_t
+  {
+  public:
+    using layer_type = basic_hidden_layer_t< T, N >;
+    using features_type = basic_features_t< T, N >;
+    using winner_type = basic_winner_t< T >;
+
+    basic_winner_index_t() = default;
+    basic_winner_index_t( basic_winner_index_t const & ) = delete;
+    basic_winner_index_t( basic_winner_index_t && ) = delete;
+    basic_winner_index_t &operator=( basic_winner_index_t const & ) = delete;
+    basic_winner_index_t &operator=( basic_winner_index_t && ) = delete;
+    virtual ~basic_winner_index_t() = default;
+
+    // indexes all neurons of layer from scratch (e.g. after compaction)
+    virtual void rebuild( layer_type const &layer ) = 0;
+
+    // local update after weights of single neuron changed
+    virtual void update( layer_type const &layer, std::size_t ix ) = 0;
+
+    // follows compaction of layer - remap holds new index of each old one
+    // (npos for removed ones); by default index is simply rebuilt
+    virtual void compact( layer_type const &layer,
+                          std::vector< std::size_t > const &remap )
+    {
+      static_cast< void >( remap );
+      rebuild( layer );
+    }
+
+    // saves state not derived from current weights (e.g. random split
+    // directions), so that restored index equals saved one, not just some
+    // rebuilt one; by default there is none and restore simply rebuilds
+    virtual void save( binary_writer_t &out ) const
+    {
+      static_cast< void >( out );
+    }
+    virtual void restore( layer_type const &layer, binary_reader_t &in )
+    {
+      static_cast< void >( in );
+      rebuild( layer );
+    }
+
+    // (approximate) winner for input; safe to call concurrently
+    virtual winner_type find( layer_type const &layer,
+                              features_type const &input ) const = 0;
+  };
+
+  // all weights and inputs lie on unit sphere, so nearest neuron is the one
+  // with highest dot product, and neurons on same side of random hyperplanes
+  // as input are likely candidates; each table is a random projection tree
+  // - every node splits its neurons in halves along random direction (so
+  // splits follow the small cap of the sphere neurons actually occupy) and
+  // leaves are buckets of about bucket_size neurons; query checks its own
+  // leaf plus, for each extra probe, leaf across next least certain split
+  template < typename T, std::size_t N >
+  class basic_projection_index_t final : public basic_winner_index_t< T, N >
+  {
+  public:
+    using base_type = basic_winner_index_t< T, N >;
+    using typename base_type::features_type;
+    using typename base_type::layer_type;
+    using typename base_type::winner_type;
+    using kernel_type = basic_winner_kernel_t< T, N >;
+
+    static constexpr std::size_t max_depth = 20u;
+
+    // below this many neurons plain scan is faster than any index
+    static constexpr std::size_t min_indexed_size = 256u;
+
+    // aimed number of neurons per leaf
+    static constexpr std::size_t bucket_size = 16u;
+
+    basic_projection_index_t( std::size_t table_count,
+                              std::size_t probe_count, kernel_type fallback ) :
+      m_tables( std::max( table_count, std::size_t{ 1 } ) ),
+      m_probe_count( std::max( probe_count, std::size_t{ 1 } ) ),
+      m_fallback( fallback )
+    {
+    }
+
+    void rebuild( layer_type const &layer ) override
+    {
+      auto count = layer.size();
+      m_built_size = count;
+
+      m_depth = 0u;
+      while ( m_depth < max_depth &&
+              ( bucket_size << ( m_depth + 1u ) ) <= count )
+      {
+        m_depth++;
+      }
+
+      m_items.resize( count );
+      for ( auto &&table : m_tables )
+      {
+        reset_table( table, count );
+        if ( count < min_indexed_size )
+        {
+          continue;
+        }
+
+        for ( auto i = std::size_t{ 0 }; i < count; i++ )
+        {
+          m_items[ i ] = item_t{ T{ 0 }, static_cast< std::uint32_t >( i ),
+                                 layer.neuron( i ) };
+        }
+        build_node( table, 1u, 0u, 0u, count );
+      }
+    }
+
+    // trees (split directions and thresholds) are saved, buckets are
+    // refilled from current weights - each neuron sits in leaf it descends
+    // to, as updates keep it
+    void save( binary_writer_t &out ) const override
+    {
+      out.put( static_cast< std::uint64_t >( m_tables.size() ) );
+      out.put( static_cast< std::uint64_t >( m_depth ) );
+      out.put( static_cast< std::uint64_t >( m_built_size ) );
+      for ( auto &&table : m_tables )
+      {
+        out.append( table.directions.data(),
+                    table.directions.size() * sizeof( features_type ) );
+        out.append( table.thresholds.data(),
+                    table.thresholds.size() * sizeof( T ) );
+      }
+    }
+
+    void restore( layer_type const &layer, binary_reader_t &in ) override
+    {
+      auto table_count = in.get< std::uint64_t >();
+      auto depth = in.get< std::uint64_t >();
+      if ( table_count != m_tables.size() || depth > max_depth )
+      {
+        in.fail( "checkpoint of differently configured winner index" );
+      }
+      m_depth = static_cast< std::size_t >( depth );
+      m_built_size = static_cast< std::size_t >( in.get< std::uint64_t >() );
+
+      auto count = layer.size();
+      for ( auto &&table : m_tables )
+      {
+        reset_table( table, count );
+        in.read( table.directions.data(),
+                 table.directions.size() * sizeof( features_type ) );
+        in.read( table.thresholds.data(),
+                 table.thresholds.size() * sizeof( T ) );
+        if ( m_built_size < min_indexed_size )
+        {
+          continue;
+        }
+
+        for ( auto i = std::size_t{ 0 }; i < count; i++ )
+        {
+          auto code = descend( table, layer.neuron( i ), 1u, 0u );
+          table.buckets[ code ].emplace_back(
+            static_cast< std::uint32_t >( i ) );
+          table.codes[ i ] = code;
+        }
+      }
+    }
+
+    void update( layer_type const &layer, std::size_t ix ) override
+    {
+      if ( m_built_size < min_indexed_size )
+      {
+        return;
+      }
+
+      auto weights = layer.neuron( ix );
+      for ( auto &&table : m_tables )
+      {
+        auto code = descend( table, weights, 1u, 0u );
+        auto prev = table.codes[ ix ];
+        if ( code == prev )
+        {
+          continue;
+        }
+
+        auto &from = table.buckets[ prev ];
+        auto pos = std::find( from.begin(), from.end(),
+                              static_cast< std::uint32_t >( ix ) );
+        assert( pos != from.end() );
+        *pos = from.back();
+        from.pop_back();
+
+        table.buckets[ code ].emplace_back(
+          static_cast< std::uint32_t >( ix ) );
+        table.codes[ ix ] = code;
+      }
+    }
+
+    void compact( layer_type const &layer,
+                  std::vector< std::size_t > const &remap ) override
+    {
+      // trees are kept as long as they stay reasonably balanced
+      if ( m_built_size < min_indexed_size ||
+           2u * layer.size() < m_built_size )
+      {
+        rebuild( layer );
+        return;
+      }
+
+      for ( auto &&table : m_tables )
+      {
+        for ( auto &&bucket : table.buckets )
+        {
+          auto kept = std::size_t{ 0 };
+          for ( auto ix : bucket )
+          {
+            if ( remap[ ix ] != std::numeric_limits< std::size_t >::max() )
+            {
+              bucket[ kept++ ] = static_cast< std::uint32_t >( remap[ ix ] );
+            }
+          }
+          bucket.resize( kept );
+        }
+
+        for ( auto old = std::size_t{ 0 }; old < remap.size(); old++ )
+        {
+          if ( remap[ old ] != std::numeric_limits< std::size_t >::max() )
+          {
+            table.codes[ remap[ old ] ] = table.codes[ old ];
+          }
+        }
+        table.codes.resize( layer.size() );
+      }
+    }
+
+    winner_type find( layer_type const &layer,
+                      features_type const &input ) const override
+    {
+      if ( m_built_size < min_indexed_size )
+      {
+        return m_fallback( layer, 0u, layer.padded_size(), input );
+      }
+
+      auto best = no_winner< T >;
+      auto margins = std::array< T, max_depth >{};
+      auto order = std::array< std::size_t, max_depth >{};
+      auto probes = std::min( m_probe_count, m_depth + 1u );
+
+      for ( auto &&table : m_tables )
+      {
+        // main path, remembering how close to each split input was
+        auto node = std::size_t{ 1 };
+        for ( auto l = std::size_t{ 0 }; l < m_depth; l++ )
+        {
+          auto proj =
+            table.directions[ node ] * input - table.thresholds[ node ];
+          margins[ l ] = std::abs( proj );
+          order[ l ] = l;
+          node = 2u * node + ( proj >= T{ 0 } ? 1u : 0u );
+        }
+        std::partial_sort(
+          order.begin(),
+          order.begin() + static_cast< std::ptrdiff_t >( probes - 1u ),
+          order.begin() + static_cast< std::ptrdiff_t >( m_depth ),
+          [&margins]( auto lhs, auto rhs ) {
+            return margins[ lhs ] < margins[ rhs ];
+          } );
+
+        for ( auto p = std::size_t{ 0 }; p < probes; p++ )
+        {
+          auto leaf = static_cast< std::uint32_t >(
+            node - ( std::size_t{ 1 } << m_depth ) );
+          if ( p > 0u )
+          {
+            auto l = order[ p - 1u ];
+            auto main_child = node >> ( m_depth - l - 1u );
+            leaf = descend( table, input, main_child ^ 1u, l + 1u );
+          }
+
+          for ( auto ix : table.buckets[ leaf ] )
+          {
+            auto res = T{ 0 };
+            static_for< N >( [&]( auto d ) {
+              auto diff = input[ d ] - layer.column( d )[ ix ];
+              res += diff * diff;
+            } );
+            best = better_of( best, winner_type{ ix, res } );
+          }
+        }
+      }
+
+      if ( best.index == no_winner< T >.index )
+      {
+        return m_fallback( layer, 0u, layer.padded_size(), input );
+      }
+      return best;
+    }
+
+  private:
+    // complete binary tree in heap order (root at 1, leaves from 2^depth)
+    struct table_t
+    {
+      std::vector< features_type > directions;
+      std::vector< T > thresholds;
+      std::vector< std::vector< std::uint32_t > > buckets;
+      std::vector< std::uint32_t > codes;  // current leaf of each neuron
+    };
+
+    // empty table of current depth
+    void reset_table( table_t &table, std::size_t count ) const
+    {
+      table.directions.resize( std::size_t{ 1 } << m_depth );
+      table.thresholds.resize( std::size_t{ 1 } << m_depth );
+      table.buckets.assign( std::size_t{ 1 } << m_depth,
+                            std::vector< std::uint32_t >{} );
+      table.codes.resize( count );
+    }
+
+    void build_node( table_t &table, std::size_t node, std::size_t level,
+                     std::size_t begin, std::size_t end )
+    {
+      if ( level == m_depth )
+      {
+        // neurons left in range are exactly the ones reaching this leaf
+        auto code = static_cast< std::uint32_t >(
+          node - ( std::size_t{ 1 } << m_depth ) );
+        auto &bucket = table.buckets[ code ];
+        bucket.reserve( end - begin );
+        for ( auto i = begin; i < end; i++ )
+        {
+          bucket.emplace_back( m_items[ i ].ix );
+          table.codes[ m_items[ i ].ix ] = code;
+        }
+        return;
+      }
+
+      auto &dir = table.directions[ node ];
+      prng_t::init_random_direction( dir );
+
+      // split at median of projections of neurons reaching this node
+      auto mid = begin + ( end - begin ) / 2u;
+      auto threshold = T{ 0 };
+      if ( begin < end )
+      {
+        for ( auto i = begin; i < end; i++ )
+        {
+          m_items[ i ].projection = dir * m_items[ i ].weights;
+        }
+        auto first = m_items.begin();
+        std::nth_element( first + static_cast< std::ptrdiff_t >( begin ),
+                          first + static_cast< std::ptrdiff_t >( mid ),
+                          first + static_cast< std::ptrdiff_t >( end ),
+                          []( auto &&lhs, auto &&rhs ) {
+                            return lhs.projection < rhs.projection;
+                          } );
+        threshold = m_items[ mid ].projection;
+      }
+      table.thresholds[ node ] = threshold;
+
+      build_node( table, 2u * node, level + 1u, begin, mid );
+      build_node( table, 2u * node + 1u, level + 1u, mid, end );
+    }
+
+    // descends from given node to leaf, returns leaf number
+    std::uint32_t descend( table_t const &table, features_type const &v,
+                           std::size_t node, std::size_t level ) const
+      noexcept
+    {
+      for ( auto l = level; l < m_depth; l++ )
+      {
+        auto is_right =
+          table.directions[ node ] * v >= table.thresholds[ node ];
+        node = 2u * node + ( is_right ? 1u : 0u );
+      }
+      return static_cast< std::uint32_t >( node -
+                                           ( std::size_t{ 1 } << m_depth ) );
+    }
+
+  private:
+    std::vector< table_t > m_tables = std::vector< table_t >{};
+    std::size_t m_probe_count;
+    std::size_t m_depth = 0u;
+    std::size_t m_built_size = 0u;
+    kernel_type m_fallback;
+
+    // rebuild scratch buffer (weights are copied along, so partitioning
+    // never has to gather them from layer columns)
+    struct item_t
+    {
+      T projection;
+      std::uint32_t ix;
+      features_type weights;
+    };
+    std::vector< item_t > m_items = std::vector< item_t >{};
+  };
+
+  // integer simd scan of quantized shadow copy of hidden layer picks
+  // shortlist_size neurons with best quantized scores, exact distances are
+  // then computed for those only; winner agrees with exact search unless
+  // quantization error pushes it out of the shortlist (copy is refreshed
+  // whenever weights change, i.e. after every adjust_to of the network)
+  template < typename T, std::size_t N, typename Q >
+  class basic_quantized_index_t final : public basic_winner_index_t< T, N >
+  {
+  public:
+    using base_type = basic_winner_index_t< T, N >;
+    using typename base_type::features_type;
+    using typename base_type::layer_type;
+    using typename base_type::winner_type;
+    using kernel_type = basic_winner_kernel_t< T, N >;
+    using shadow_type = basic_quantized_layer_t< Q, N >;
+
+    basic_quantized_index_t( std::size_t shortlist_size, simd_level_t level,
+                             kernel_type fallback ) :
+      m_shortlist_size( shortlist_size ),
+      m_kernel( get_shortlist_kernel< Q, N >( level ) ),
+      m_fallback( fallback )
+    {
+    }
+
+    // scale follows largest coordinate magnitude at (re)build time - weights
+    // moving further out saturate until next one
+    void rebuild( layer_type const &layer ) override
+    {
+      auto bound = 0.0;
+      for ( auto d = std::size_t{ 0 }; d < N; d++ )
+      {
+        for ( auto i = std::size_t{ 0 }; i < layer.size(); i++ )
+        {
+          auto w = static_cast< double >( layer.column( d )[ i ] );
+          bound = std::max( bound, std::abs( w ) );
+        }
+      }
+      auto range = static_cast< double >( shadow_type::range );
+      m_shadow.set_scale( bound > 0.0 ? range / bound : range );
+      store_all( layer );
+    }
+
+    // scale is saved, as the one of last rebuild may differ from one
+    // current weights would give
+    void save( binary_writer_t &out ) const override
+    {
+      out.put( m_shadow.scale() );
+    }
+
+    void restore( layer_type const &layer, binary_reader_t &in ) override
+    {
+      m_shadow.set_scale( in.get< double >() );
+      store_all( layer );
+    }
+
+    void update( layer_type const &layer, std::size_t ix ) override
+    {
+      m_shadow.store( ix, layer.neuron( ix ) );
+    }
+
+    winner_type find( layer_type const &layer,
+                      features_type const &input ) const override
+    {
+      auto shortlist = quantized_shortlist_t{ m_shortlist_size };
+      if ( layer.size() <= shortlist.capacity )
+      {
+        return m_fallback( layer, 0u, layer.padded_size(), input );
+      }
+
+      m_kernel( m_shadow, m_shadow.quantize_input( input ), shortlist );
+
+      auto best = no_winner< T >;
+      for ( auto k = std::size_t{ 0 }; k < shortlist.size; k++ )
+      {
+        auto ix = std::size_t{ shortlist.ixs[ k ] };
+        auto res = T{ 0 };
+        static_for< N >( [&]( auto d ) {
+          auto diff = input[ d ] - layer.column( d )[ ix ];
+          res += diff * diff;
+        } );
+        best = better_of( best, winner_type{ ix, res } );
+      }
+      return best;
+    }
+
+  private:
+    void store_all( layer_type const &layer )
+    {
+      m_shadow.resize( layer.size() );
+      for ( auto i = std::size_t{ 0 }; i < layer.size(); i++ )
+      {
+        m_shadow.store( i, layer.neuron( i ) );
+      }
+    }
+
+  private:
+    std::size_t m_shortlist_size;
+    basic_shortlist_kernel_t< Q, N > m_kernel;
+    kernel_type m_fallback;
+    shadow_type m_shadow = shadow_type{};
+  };
+
+  using winner_index_t = basic_winner_index_t< scalar_t, iris_dimension >;
+  using projection_index_t =
+    basic_projection_index_t< scalar_t, iris_dimension >;
+  template < typename Q >
+  using quantized_index_t =
+    basic_quantized_index_t< scalar_t, iris_dimension, Q >;
+
+  // creates index for given search backend (null for exact search)
+  template < typename T, std::size_t N >
+  std::unique_ptr< basic_winner_index_t< T, N > >
+  make_winner_index( winner_search_t search, std::size_t table_count,
+                     std::size_t probe_count, std::size_t shortlist_size,
+                     simd_level_t level,
+                     basic_winner_kernel_t< T, N > fallback )
+  {
+    switch ( search )
+    {
+      case winner_search_t::projection:
+        return std::make_unique< basic_projection_index_t< T, N > >(
+          table_count, probe_count, fallback );
+      case winner_search_t::int16:
+        return std::make_unique<
+          basic_quantized_index_t< T, N, std::int16_t > >(
+          shortlist_size, level, fallback );
+      case winner_search_t::int8:
+        return std::make_unique<
+          basic_quantized_index_t< T, N, std::int8_t > >( shortlist_size,
+                                                          level, fallback );
+      default:
+        return nullptr;
+    }
+  }
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_INDEX_H_INCLUDED
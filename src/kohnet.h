@@ -3,41 +3,182 @@
 #ifndef ISAI_KOHRIS_KOHNET_H_INCLUDED
 #define ISAI_KOHRIS_KOHNET_H_INCLUDED
 
+#include "binary_io.h"
 #include "dataset.h"
+#include "index.h"
+#include "layer.h"
+#include "nearest.h"
+#include "simd.h"
+#include "thread_pool.h"
+#include "trace.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
 
 namespace isai
 {
 
+  // how winners are moved towards training inputs
+  enum class training_mode_t
+  {
+    online,  // after each input (inputs processed one after another)
+    batch,   // once per epoch, towards mean of all inputs won
+    hogwild  // after each input, threads take disjoint parts of inputs and
+             // move shared weights without locking (not reproducible)
+  };
+
+  constexpr char const *const training_mode_strs[] = { "online", "batch",
+                                                       "hogwild" };
+  constexpr char const *training_mode_to_string( training_mode_t mode )
+  {
+    return training_mode_strs[ static_cast< int >( mode ) ];
+  }
+
+  // why last run() ended
+  enum class stop_reason_t
+  {
+    none,         // not run yet
+    completed,    // expected number of clusters remained
+    converged,    // neurons moved less than displacement threshold
+    plateau,      // number of winning neurons stopped changing
+    deadline,     // cancelled by deadline
+    epoch_limit   // incremental training ran all epochs it was given
+  };
+
+  constexpr char const *const stop_reason_strs[] = {
+    "none", "completed", "converged", "plateau", "deadline", "epoch_limit"
+  };
+  constexpr char const *stop_reason_to_string( stop_reason_t reason )
+  {
+    return stop_reason_strs[ static_cast< int >( reason ) ];
+  }
+
   struct knc_settings_t
   {
+    std::string dataset_path = iris_csv_path;
+    csv_schema_t dataset_schema = csv_schema_t{};
+    std::string dataset_cache_dir = std::string{};  // empty - no caching
+    std::size_t stream_chunk_size = 0u;  // lines per chunk, zero - in memory
+
     std::size_t hidden_layer_size = 10000u;
     std::size_t training_set_size = 100u;
+    std::uint64_t seed = 0u;  // zero - keep current state of prng_t
     std::size_t expected_cluster_count = 3u;
 
     double normalization_sphere_radius = 4.0;
     double alpha = 0.3;
     std::size_t coalesce_interval = 10u;
+    std::size_t coalesce_pair_limit = 1u;  // mutually nearest pairs per pass
 
     bool is_feature_sign_balanced = true;
+
+    // early stopping, possibly with more clusters than expected (zero - rule
+    // off): once no neuron moved farther than displacement_threshold during
+    // epoch, or once number of winning neurons stayed within relative
+    // plateau_tolerance of its value for plateau_epochs epochs in a row
+    double displacement_threshold = 0.0;
+    std::size_t plateau_epochs = 0u;
+    double plateau_tolerance = 0.0;
+
+    simd_level_t simd_level = simd_level_t::automatic;
+    std::size_t thread_count = 1u;  // zero - use all hardware threads
+
+    // numa placement - threads are pinned to nodes in order of shards of
+    // hidden layer they scan (each shard is first written by its owner, so
+    // it is then allocated on owner's node, and layer compacted below half
+    // of size it was placed for is placed again); transparent huge pages
+    // for large hidden layers (fewer tlb misses while scanning)
+    bool is_thread_pinned = false;
+    bool use_huge_pages = false;
+
+    training_mode_t training_mode = training_mode_t::online;
+
+    // approximate winner search - more tables/probes: better recall, slower
+    // (not with hogwild on several threads, which always scan whole layer)
+    winner_search_t winner_search = winner_search_t::exact;
+    std::size_t ann_table_count = 4u;
+    std::size_t ann_probe_count = 4u;  // buckets checked per table
+    // neurons reranked exactly after quantized scan (at most 64)
+    std::size_t quantized_shortlist_size = 8u;
+
+    // training state is saved every checkpoint_interval iterations and once
+    // training completes (empty path or zero interval - no checkpoints)
+    std::string checkpoint_path = std::string{};
+    std::size_t checkpoint_interval = 0u;
+    std::string resume_path = std::string{};  // checkpoint to continue from
+    std::string model_path = std::string{};   // trained model export
+
+    bool is_verbose = true;  // status line after every iteration
+    std::size_t status_interval_ms = 0u;  // least time between status lines
+
+    // collected phase timings and counters (needs tracing compiled in)
+    std::string trace_path = std::string{};
+    trace_format_t trace_format = trace_format_t::json_lines;
+  };
+
+  // incremental training on delta batch of new inputs (see refine) - kill
+  // and coalesce steps are off by default: inputs of small batch leave most
+  // neurons without wins, which would kill them; coalesce runs every epoch
+  // (refine is too short for coalesce interval)
+  struct refine_settings_t
+  {
+    std::size_t epoch_count = 5u;
+    bool do_kill = false;
+    bool do_coalesce = false;
   };
 
-  class kohonen_neuron_t
+  // neurons removed by optional steps of refine
+  struct refine_result_t
+  {
+    std::size_t kill_count = 0u;
+    std::size_t coalesce_count = 0u;
+  };
+
+  // versioned file formats (bumped on every layout change)
+  constexpr char checkpoint_magic[ 8 ] = "KOHRISC";
+  constexpr std::uint32_t checkpoint_version = 3u;
+
+  template < typename T, std::size_t N >
+  class basic_kohonen_neuron_t
   {
   public:
-    explicit kohonen_neuron_t( double radius = 1.0 )
+    using features_type = basic_features_t< T, N >;
+
+    explicit basic_kohonen_neuron_t( T radius = T{ 1 } )
     {
       prng_t::init_neuron_weights( m_weights );
       normalize_stereographic( m_weights, radius );
     }
 
-    double operator[]( std::size_t pos ) const { return m_weights[ pos ]; }
-    double &operator[]( std::size_t pos ) { return m_weights[ pos ]; }
+    // random weights drawn from given engine
+    template < typename Engine >
+    basic_kohonen_neuron_t( T radius, Engine &eng )
+    {
+      prng_t::init_neuron_weights( m_weights, eng );
+      normalize_stereographic( m_weights, radius );
+    }
+
+    explicit basic_kohonen_neuron_t( features_type const &weights ) :
+      m_weights( weights )
+    {
+    }
+
+    T operator[]( std::size_t pos ) const { return m_weights[ pos ]; }
+    T &operator[]( std::size_t pos ) { return m_weights[ pos ]; }
     auto begin() const { m_weights.begin(); }
     auto end() const { m_weights.end(); }
 
-    features_t const &weights() const { return m_weights; }
+    features_type const &weights() const { return m_weights; }
 
     void normalize()
     {
@@ -48,10 +189,10 @@ namespace isai
       }
     }
 
-    double sqr_distance_to( features_t const &other ) const
+    T sqr_distance_to( features_type const &other ) const
     {
       assert( other.size() == m_weights.size() );
-      auto res = 0.0;
+      auto res = T{ 0 };
       for ( auto i = std::size_t{ 0 }; i < m_weights.size(); i++ )
       {
         res +=
@@ -60,12 +201,12 @@ namespace isai
       return res;
     }
 
-    double distance_to( features_t const &other ) const
+    T distance_to( features_type const &other ) const
     {
       return std::sqrt( sqr_distance_to( other ) );
     }
 
-    void adjust_to( features_t const &other, double alpha = 0.2 )
+    void adjust_to( features_type const &other, T alpha = T( 0.2 ) )
     {
       for ( auto i = std::size_t{ 0 }; i < m_weights.size(); i++ )
       {
@@ -74,95 +215,560 @@ namespace isai
       normalize();
     }
 
-    double adjust_to_ex( features_t const &other, double alpha = 0.2 )
+    T adjust_to_ex( features_type const &other, T alpha = T( 0.2 ) )
     {
       auto prev = m_weights;
       adjust_to( other, alpha );
       return sqr_distance_to( prev );
     }
 
-    void average_with( kohonen_neuron_t const &other )
+    void average_with( basic_kohonen_neuron_t const &other )
     {
       for ( auto i = std::size_t{ 0 }; i < m_weights.size(); i++ )
       {
-        m_weights[ i ] += ( m_weights[ i ] + other.m_weights[ i ] ) / 2.0;
+        m_weights[ i ] += ( m_weights[ i ] + other.m_weights[ i ] ) / T{ 2 };
       }
       normalize();
     }
 
   private:
-    double norm()
+    T norm()
     {
       auto sqrsum = std::accumulate(
-        m_weights.begin(), m_weights.end(), 0.0,
+        m_weights.begin(), m_weights.end(), T{ 0 },
         []( auto &&acc, auto &&val ) { return acc + ( val * val ); } );
       return std::sqrt( sqrsum );
     }
 
   private:
-    features_t m_weights = features_t{};
+    features_type m_weights = features_type{};
+  };
+
+  using kohonen_neuron_t = basic_kohonen_neuron_t< scalar_t, iris_dimension >;
+
+  // weights neurons had at start of epoch, kept only for those moved in it
+  // (saved just before their first move), so displacement is measured
+  // without copying whole layer every epoch
+  template < typename T, std::size_t N >
+  class basic_epoch_start_t
+  {
+  public:
+    using features_type = basic_features_t< T, N >;
+
+    // forgets saved weights, for layer of given size
+    void reset( std::size_t count )
+    {
+      m_slots.resize( count );
+      m_weights.clear();
+    }
+
+    void save( std::size_t ix, features_type const &weights )
+    {
+      save_at( grow( 1u ), ix, weights );
+    }
+
+    // concurrent saving of distinct neurons - room for count of them is
+    // made first (returned is its first slot), each thread saves to slots
+    // it claims, and unclaimed ones are dropped by shrink afterwards
+    std::size_t grow( std::size_t count )
+    {
+      auto first = m_weights.size();
+      m_weights.resize( first + count );
+      return first;
+    }
+
+    void save_at( std::size_t slot, std::size_t ix,
+                  features_type const &weights )
+    {
+      m_slots[ ix ] = slot;
+      m_weights[ slot ] = weights;
+    }
+
+    void shrink( std::size_t count ) { m_weights.resize( count ); }
+
+    // weights saved for neuron moved in epoch
+    features_type const &operator[]( std::size_t ix ) const
+    {
+      return m_weights[ m_slots[ ix ] ];
+    }
+
+  private:
+    std::vector< std::size_t > m_slots =
+      std::vector< std::size_t >{};  // valid for saved neurons only
+    std::vector< features_type > m_weights = std::vector< features_type >{};
   };
 
   // stores iris dataset and provides basic helper functionalities
-  class kohonen_network_t
+  template < typename T, std::size_t N >
+  class basic_kohonen_network_t
   {
   public:
-    explicit kohonen_network_t( knc_settings_t const &settings ) :
-      m_iteration_no( 0u ),
-      m_alive_count( 0u ),
-      m_kill_count( 0u ),
-      m_coalesce_count( 0u ),
-      m_settings( settings )
+    using neuron_type = basic_kohonen_neuron_t< T, N >;
+    using features_type = basic_features_t< T, N >;
+    using layer_type = basic_hidden_layer_t< T, N >;
+    using winner_type = basic_winner_t< T >;
+
+    // throws std::runtime_error when settings do not go together
+    explicit basic_kohonen_network_t( knc_settings_t const &settings ) :
+      basic_kohonen_network_t( settings, nullptr )
+    {
+    }
+
+    // warm start from neurons of trained network (e.g. its get_results()),
+    // which become initial hidden layer (ids follow their order); throws
+    // std::runtime_error with fewer of them than expected clusters
+    basic_kohonen_network_t( knc_settings_t const &settings,
+                             std::vector< neuron_type > const &neurons ) :
+      basic_kohonen_network_t( sized_for( settings, neurons.size() ),
+                               &neurons )
     {
-      m_hidden_layer.reserve( m_settings.hidden_layer_size );
-      m_statuses.reserve( m_settings.hidden_layer_size );
-      for ( auto i = std::size_t{ 0 }; i < m_settings.hidden_layer_size; i++ )
-      {
-        m_hidden_layer.emplace_back( m_settings.normalization_sphere_radius );
-        m_statuses.emplace_back( 0 );
-        m_alive_count++;
-      }
-      assert( m_alive_count == m_settings.hidden_layer_size );
     }
 
     template < typename Iterator >
     void run( Iterator begin, Iterator end )
     {
-      while ( !is_completed() )
+      while ( !should_stop() )
       {
         prepare();
-        for ( auto i = begin; i != end; i++ )
+        process_range( begin, end );
+        track_convergence();
+        kill();
+        coalesce();
+        print_status();
+        save_periodic_checkpoint();
+      }
+      print_status( true );
+    }
+
+    // same as run, but every epoch streams training chunks of given source
+    // (e.g. chunked_source_t) instead of iterating in-memory range; in batch
+    // mode each chunk is one (mini-)batch
+    template < typename Source >
+    void run_stream( Source &source )
+    {
+      while ( !should_stop() )
+      {
+        prepare();
+        source.start( source.train_chunks(), true );
+        while ( auto chunk = source.next() )
         {
-          process_input( ( *i ).features );
+          process_range( chunk->begin(), chunk->end() );
         }
+        track_convergence();
         kill();
         coalesce();
         print_status();
+        save_periodic_checkpoint();
       }
+      print_status( true );
     }
 
+    // incremental training - continues from current weights (trained
+    // network or warm start from its survivors) for at most given number of
+    // epochs over delta batch of new inputs only, so update takes time in
+    // proportion to new data, not whole history; reaching expected number
+    // of clusters only ends optional kill and coalesce steps, other stop
+    // rules and deadline apply as in run()
+    template < typename Iterator >
+    refine_result_t refine( Iterator begin, Iterator end,
+                            refine_settings_t const &refine_settings )
+    {
+      auto res = refine_result_t{};
+      m_max_displacement = std::numeric_limits< double >::infinity();
+      m_plateau_length = 0u;
+      m_stop_reason = stop_reason_t::epoch_limit;
+      for ( auto e = std::size_t{ 0 };
+            e < refine_settings.epoch_count && !should_stop_early(); e++ )
+      {
+        prepare();
+        process_range( begin, end );
+        track_convergence();
+        if ( refine_settings.do_kill && !is_completed() )
+        {
+          kill();
+        }
+        if ( refine_settings.do_coalesce )
+        {
+          coalesce_closest();
+        }
+        res.kill_count += m_kill_count;
+        res.coalesce_count += m_coalesce_count;
+        print_status();
+        save_periodic_checkpoint();
+      }
+      print_status( true );
+      return res;
+    }
+
+    // runs stop (at the end of iteration) once deadline passes
+    void set_deadline( std::chrono::steady_clock::time_point deadline )
+    {
+      m_deadline = deadline;
+    }
+
+    stop_reason_t stop_reason() const noexcept { return m_stop_reason; }
+    std::size_t iteration_count() const noexcept { return m_iteration_no; }
+    std::size_t alive_count() const noexcept { return m_alive_count; }
+
+    // distances neurons moved during last epoch - sum over all of them and
+    // the largest one (tracked only with displacement threshold set)
+    double total_displacement() const noexcept { return m_total_displacement; }
+    double max_displacement() const noexcept { return m_max_displacement; }
+
+    // writes complete training state - weights of alive neurons (column by
+    // column, as stored in hidden layer), their win counts and ids, epoch
+    // counters, state of stop rules, prng state and state of approximate
+    // winner index; file is replaced atomically, so failure keeps previous
+    // checkpoint intact
+    bool save_checkpoint( char const *path ) const
+    {
+      auto out = binary_writer_t{};
+      out.append( checkpoint_magic, sizeof( checkpoint_magic ) );
+      out.put( checkpoint_version );
+      out.put( static_cast< std::uint32_t >( sizeof( T ) ) );
+      out.put( static_cast< std::uint64_t >( N ) );
+      out.put( static_cast< std::uint64_t >( m_settings.hidden_layer_size ) );
+      out.put( static_cast< std::uint64_t >( size() ) );
+      out.put( static_cast< std::uint64_t >( m_iteration_no ) );
+      out.put( static_cast< std::uint64_t >( m_alive_count ) );
+      out.put( static_cast< std::uint64_t >( m_kill_count ) );
+      out.put( static_cast< std::uint64_t >( m_coalesce_count ) );
+      out.put( m_max_displacement );
+      out.put( m_total_displacement );
+      out.put( m_plateau_base );
+      out.put( static_cast< std::uint64_t >( m_plateau_length ) );
+      out.put_string( prng_t::get_state() );
+
+      for ( auto d = std::size_t{ 0 }; d < N; d++ )
+      {
+        out.align();
+        out.append( m_hidden_layer.column( d ), size() * sizeof( T ) );
+      }
+      out.align();
+      for ( auto s : m_statuses )
+      {
+        out.put( static_cast< std::int32_t >( s ) );
+      }
+      out.align();
+      for ( auto id : m_ids )
+      {
+        out.put( static_cast< std::uint64_t >( id ) );
+      }
+      out.align();
+      out.put( static_cast< std::uint32_t >( m_settings.winner_search ) );
+      if ( m_index )
+      {
+        m_index->save( out );
+      }
+      return out.write( path );
+    }
+
+    // replaces training state with one saved by save_checkpoint, so run()
+    // continues exactly where saved run stopped (given same training data
+    // in same order); approximate winner index saved with other search
+    // backend is rebuilt from scratch;
+    // throws std::system_error or std::runtime_error (incompatible file)
+    void load_checkpoint( char const *path )
+    {
+      auto in = binary_reader_t{ path };
+      in.expect_header( checkpoint_magic, checkpoint_version );
+      if ( in.get< std::uint32_t >() != sizeof( T ) ||
+           in.get< std::uint64_t >() != N )
+      {
+        in.fail( "checkpoint of network with different weight layout" );
+      }
+      auto initial_size = in.get< std::uint64_t >();
+      auto stored_count = in.get< std::uint64_t >();
+      auto iteration_no = in.get< std::uint64_t >();
+      auto alive_count = in.get< std::uint64_t >();
+      auto kill_count = in.get< std::uint64_t >();
+      auto coalesce_count = in.get< std::uint64_t >();
+      auto max_displacement = in.get< double >();
+      auto total_displacement = in.get< double >();
+      auto plateau_base = in.get< double >();
+      auto plateau_length = in.get< std::uint64_t >();
+      auto prng_state = in.get_string();
+      in.expect_records( stored_count, N * sizeof( T ) +
+                                         sizeof( std::int32_t ) +
+                                         sizeof( std::uint64_t ) );
+      auto count = static_cast< std::size_t >( stored_count );
+      if ( alive_count != count ||
+           count < m_settings.expected_cluster_count )
+      {
+        in.fail( "checkpoint incompatible with settings" );
+      }
+
+      auto layer = layer_type{};
+      allocate_layer( layer, count );
+      for ( auto d = std::size_t{ 0 }; d < N; d++ )
+      {
+        in.align();
+        in.read( layer.column( d ), count * sizeof( T ) );
+      }
+      auto statuses = std::vector< int >( count );
+      in.align();
+      for ( auto &&s : statuses )
+      {
+        s = static_cast< int >( in.get< std::int32_t >() );
+      }
+      auto ids = std::vector< std::size_t >( count );
+      in.align();
+      for ( auto &&id : ids )
+      {
+        id = static_cast< std::size_t >( in.get< std::uint64_t >() );
+      }
+      in.align();
+      auto search = static_cast< winner_search_t >( in.get< std::uint32_t >() );
+      auto index = decltype( m_index ){};
+      if ( m_index && search == m_settings.winner_search )
+      {
+        index = make_winner_index< T, N >(
+          m_settings.winner_search, m_settings.ann_table_count,
+          m_settings.ann_probe_count, m_settings.quantized_shortlist_size,
+          m_settings.simd_level, m_winner_kernel );
+        index->restore( layer, in );
+      }
+
+      m_hidden_layer = std::move( layer );
+      m_statuses = std::move( statuses );
+      m_ids = std::move( ids );
+      m_settings.hidden_layer_size = static_cast< std::size_t >( initial_size );
+      m_iteration_no = static_cast< std::size_t >( iteration_no );
+      m_alive_count = count;
+      m_kill_count = static_cast< std::size_t >( kill_count );
+      m_coalesce_count = static_cast< std::size_t >( coalesce_count );
+      m_nearest.reset( count );
+      if ( index )
+      {
+        m_index = std::move( index );
+      }
+      else if ( m_index )
+      {
+        m_index->rebuild( m_hidden_layer );
+      }
+      m_max_displacement = max_displacement;
+      m_total_displacement = total_displacement;
+      m_plateau_base = plateau_base;
+      m_plateau_length = static_cast< std::size_t >( plateau_length );
+      prng_t::set_state( prng_state );
+    }
+
+    // surviving neurons, ordered by their stable ids
     auto get_results() const
     {
-      auto res = std::vector< kohonen_neuron_t >{};
+      auto res = std::vector< neuron_type >{};
       for ( auto i = std::size_t{ 0 }; i < size(); i++ )
       {
         if ( is_alive( i ) )
         {
-          res.emplace_back( m_hidden_layer[ i ] );
+          res.emplace_back( m_hidden_layer.neuron( i ) );
         }
       }
 
-      assert( res.size() == m_settings.expected_cluster_count );
+      assert( res.size() == m_alive_count );
+
+      return res;
+    }
 
+    // stable ids (initial positions in hidden layer) of surviving neurons,
+    // in the same order as get_results()
+    auto get_result_ids() const
+    {
+      auto res = std::vector< std::size_t >{};
+      for ( auto i = std::size_t{ 0 }; i < size(); i++ )
+      {
+        if ( is_alive( i ) )
+        {
+          res.emplace_back( m_ids[ i ] );
+        }
+      }
       return res;
     }
 
+    // position of neuron closest to input within hidden layer;
+    // only alive neurons are stored (and padding is parked at infinity), so
+    // kernel needs no status checks;
+    // with more threads, each one scans its own shard of the hidden layer and
+    // local winners are reduced in shard order (keeps serial tie-breaking)
+    std::size_t find_winner( features_type const &input )
+    {
+      if ( m_index )
+      {
+        return m_index->find( m_hidden_layer, input ).index;
+      }
+
+      if ( m_pool->size() == 1u )
+      {
+        return m_winner_kernel( m_hidden_layer, 0u,
+                                m_hidden_layer.padded_size(), input )
+          .index;
+      }
+
+      m_pool->run( [this, &input]( std::size_t ix ) {
+        auto shard = thread_pool_t::split( m_hidden_layer.padded_size(),
+                                           m_pool->size(), ix,
+                                           layer_type::block_size );
+        m_shard_winners[ ix ].value =
+          shard.first < shard.second
+            ? m_winner_kernel( m_hidden_layer, shard.first, shard.second,
+                               input )
+            : no_winner< T >;
+      } );
+
+      auto best = no_winner< T >;
+      for ( auto &&sw : m_shard_winners )
+      {
+        best = better_of( best, sw.value );
+      }
+      return best.index;
+    }
+
   private:
+    // neurons - initial weights (null - random ones)
+    basic_kohonen_network_t( knc_settings_t const &settings,
+                             std::vector< neuron_type > const *neurons ) :
+      m_iteration_no( 0u ),
+      m_alive_count( 0u ),
+      m_kill_count( 0u ),
+      m_coalesce_count( 0u ),
+      m_settings( settings ),
+      m_winner_kernel( get_winner_kernel< T, N >( settings.simd_level ) ),
+      m_block_winner_kernel(
+        get_block_winner_kernel< T, N >( settings.simd_level ) ),
+      m_pool( std::make_unique< thread_pool_t >( settings.thread_count,
+                                                 settings.is_thread_pinned ) ),
+      m_shard_winners( m_pool->size() ),
+      m_nearest( settings.hidden_layer_size )
+    {
+      if ( m_settings.training_mode == training_mode_t::hogwild &&
+           m_pool->size() > 1u &&
+           m_settings.winner_search != winner_search_t::exact )
+      {
+        throw std::runtime_error{
+          "hogwild training supports exact winner search only" };
+      }
+
+      if ( neurons != nullptr )
+      {
+        init_neurons( *neurons );
+      }
+      else
+      {
+        init_neurons();
+      }
+
+      m_index = make_winner_index< T, N >(
+        m_settings.winner_search, m_settings.ann_table_count,
+        m_settings.ann_probe_count, m_settings.quantized_shortlist_size,
+        m_settings.simd_level, m_winner_kernel );
+      if ( m_index )
+      {
+        m_index->rebuild( m_hidden_layer );
+      }
+    }
+
+    static knc_settings_t sized_for( knc_settings_t settings,
+                                     std::size_t count )
+    {
+      if ( count < settings.expected_cluster_count )
+      {
+        throw std::runtime_error{
+          "warm start needs at least as many neurons as expected clusters" };
+      }
+      settings.hidden_layer_size = count;
+      return settings;
+    }
+
+    // neurons are drawn in fixed blocks, each from its own stream of single
+    // seed taken from prng_t - weights do not depend on thread count
+    void init_neurons()
+    {
+      constexpr auto block_size = std::size_t{ 4096 };
+      auto count = m_settings.hidden_layer_size;
+      auto blocks = ( count + block_size - 1u ) / block_size;
+      auto seed = prng_t::get_seed();
+      auto radius = static_cast< T >( m_settings.normalization_sphere_radius );
+
+      allocate_layer( m_hidden_layer, count );
+      m_pool->run( [this, count, blocks, seed, radius]( std::size_t ix ) {
+        auto part = thread_pool_t::split( blocks, m_pool->size(), ix );
+        for ( auto b = part.first; b < part.second; b++ )
+        {
+          auto eng = prng_engine_t{ seed, b };
+          for ( auto i = b * block_size;
+                i < std::min( count, ( b + 1u ) * block_size ); i++ )
+          {
+            m_hidden_layer.store( i, neuron_type{ radius, eng }.weights() );
+          }
+        }
+      } );
+
+      m_statuses.assign( count, 0 );
+      m_ids.resize( count );
+      std::iota( m_ids.begin(), m_ids.end(), std::size_t{ 0 } );
+      m_alive_count = count;
+    }
+
+    // warm start - weights given, win counts start over
+    void init_neurons( std::vector< neuron_type > const &neurons )
+    {
+      auto count = neurons.size();
+      allocate_layer( m_hidden_layer, count );
+      for ( auto i = std::size_t{ 0 }; i < count; i++ )
+      {
+        m_hidden_layer.store( i, neurons[ i ].weights() );
+      }
+
+      m_statuses.assign( count, 0 );
+      m_ids.resize( count );
+      std::iota( m_ids.begin(), m_ids.end(), std::size_t{ 0 } );
+      m_alive_count = count;
+    }
+
+    // new hidden layer, whose shards are first written by threads scanning
+    // them in find_winner (so pages of each shard are placed on its owner's
+    // numa node)
+    void allocate_layer( layer_type &layer, std::size_t count )
+    {
+      layer = layer_type{ 0u, m_settings.use_huge_pages };
+      layer.resize_unset( count );
+      m_pool->run( [this, &layer]( std::size_t ix ) {
+        auto shard = thread_pool_t::split( layer.padded_size(),
+                                           m_pool->size(), ix,
+                                           layer_type::block_size );
+        layer.reset( shard.first, shard.second );
+      } );
+      m_placed_size = layer.padded_size();
+    }
+
+    void save_periodic_checkpoint() const
+    {
+      if ( m_settings.checkpoint_path.empty() ||
+           m_settings.checkpoint_interval == 0u ||
+           ( m_iteration_no % m_settings.checkpoint_interval != 0u &&
+             m_alive_count != m_settings.expected_cluster_count ) )
+      {
+        return;
+      }
+      if ( !save_checkpoint( m_settings.checkpoint_path.c_str() ) )
+      {
+        std::fprintf( stderr, "warning: could not write checkpoint %s\n",
+                      m_settings.checkpoint_path.c_str() );
+      }
+    }
+
     void prepare()
     {
       m_kill_count = 0u;
       m_coalesce_count = 0u;
       m_iteration_no++;
+      ISAI_TRACE_SCOPE( trace_phase_t::prepare, m_iteration_no );
+
+      // displacement is measured against weights at start of epoch
+      if ( m_settings.displacement_threshold > 0.0 )
+      {
+        m_epoch_start.reset( size() );
+      }
 
       auto sum = 0;
 
@@ -178,39 +784,194 @@ namespace isai
       assert( sum = static_cast< int >( m_settings.training_set_size ) );
     }
 
-    std::size_t find_winner( features_t const &input ) const
+    template < typename Iterator >
+    void process_range( Iterator begin, Iterator end )
     {
-      auto best_ix = std::size_t{ 0 };
-      auto best_val = std::numeric_limits< double >::max();
-
-      for ( auto i = std::size_t{ 0 }; i < size(); i++ )
+      ISAI_TRACE_SCOPE( trace_phase_t::process, m_iteration_no );
+      ISAI_TRACE_COUNT( trace_counter_t::inputs,
+                        static_cast< std::uint64_t >(
+                          std::distance( begin, end ) ) );
+      if ( m_settings.training_mode == training_mode_t::batch )
+      {
+        process_batch( begin, end );
+      }
+      else if ( m_settings.training_mode == training_mode_t::hogwild &&
+                m_pool->size() > 1u )
+      {
+        process_hogwild( begin, end );
+      }
+      else
       {
-        auto sqr_distance = m_hidden_layer[ i ].sqr_distance_to( input );
-        if ( is_alive( i ) && sqr_distance < best_val )
+        for ( auto i = begin; i != end; i++ )
         {
-          best_ix = i;
-          best_val = sqr_distance;
+          process_input( ( *i ).features );
         }
       }
-
-      return best_ix;
     }
 
-    void process_input( features_t const &input )
+    void process_input( features_type const &input )
     {
+      count_distance_evaluations( 1u );
       auto winner_ix = find_winner( input );
-      m_hidden_layer[ winner_ix ].adjust_to( input );
+      auto winner = neuron_type{ m_hidden_layer.neuron( winner_ix ) };
+      save_epoch_start( winner_ix );
+      winner.adjust_to( input, static_cast< T >( m_settings.alpha ) );
+      move_neuron( winner_ix, winner.weights() );
       m_statuses[ winner_ix ]++;
     }
 
+    // batch variant - winners of all inputs are found in parallel (weights
+    // stay untouched during that pass, so all threads see same snapshot),
+    // then each winner is moved once towards mean of inputs it has won;
+    // exact search compares whole part of inputs of each thread with layer
+    // at once (blocked kernel)
+    template < typename Iterator >
+    void process_batch( Iterator begin, Iterator end )
+    {
+      auto count = static_cast< std::size_t >( std::distance( begin, end ) );
+      m_batch_inputs.clear();
+      for ( auto i = begin; i != end; i++ )
+      {
+        m_batch_inputs.emplace_back( ( *i ).features );
+      }
+      m_batch_winners.resize( count );
+      count_distance_evaluations( count );
+
+      m_pool->run( [this, count]( std::size_t ix ) {
+        ISAI_TRACE_SCOPE( trace_phase_t::winner_search, m_iteration_no );
+        auto part = thread_pool_t::split( count, m_pool->size(), ix );
+        if ( !m_index )
+        {
+          m_block_winner_kernel(
+            m_hidden_layer, 0u, m_hidden_layer.padded_size(),
+            m_batch_inputs.data() + part.first, part.second - part.first,
+            m_batch_winners.data() + part.first );
+          return;
+        }
+        for ( auto k = part.first; k < part.second; k++ )
+        {
+          m_batch_winners[ k ] =
+            m_index->find( m_hidden_layer, m_batch_inputs[ k ] );
+        }
+      } );
+
+      // accumulate in input order - result does not depend on thread count
+      if ( m_batch_sums.size() < size() )
+      {
+        m_batch_sums.resize( size() );
+        m_batch_counts.resize( size() );
+      }
+      m_batch_touched.clear();
+      auto k = std::size_t{ 0 };
+      for ( auto i = begin; i != end; i++, k++ )
+      {
+        auto w = m_batch_winners[ k ].index;
+        auto &sum = m_batch_sums[ w ];
+        save_epoch_start( w );
+        m_statuses[ w ]++;
+        if ( m_batch_counts[ w ]++ == 0u )
+        {
+          sum = features_type{};
+          m_batch_touched.emplace_back( w );
+        }
+        static_for< N >(
+          [&]( auto d ) { sum[ d ] += ( *i ).features[ d ]; } );
+      }
+
+      for ( auto w : m_batch_touched )
+      {
+        auto mean = m_batch_sums[ w ];
+        for ( auto &&m : mean )
+        {
+          m /= static_cast< T >( m_batch_counts[ w ] );
+        }
+        m_batch_counts[ w ] = 0u;
+        auto winner = neuron_type{ m_hidden_layer.neuron( w ) };
+        winner.adjust_to( mean, static_cast< T >( m_settings.alpha ) );
+        move_neuron( w, winner.weights() );
+      }
+    }
+
+    // hogwild variant - every thread finds winners of its part of inputs
+    // and moves them in place, racing with the others (updates are sparse,
+    // so collisions are rare, and lost update or neuron mixing coordinates
+    // of two moves only perturbs single step); weights are accessed only by
+    // relaxed atomic loads and stores (so exact scalar scan is used, simd
+    // kernels and winner index read them plainly); win counts are atomic,
+    // so kill sees every win, and moved neurons are recorded serially after
+    // the pass
+    template < typename Iterator >
+    void process_hogwild( Iterator begin, Iterator end )
+    {
+      auto count = static_cast< std::size_t >( std::distance( begin, end ) );
+      count_distance_evaluations( count );
+      if ( m_hogwild_wins.size() < size() )
+      {
+        m_hogwild_wins = std::vector< std::atomic< int > >( size() );
+      }
+
+      // first win of neuron in epoch claims slot for its start weights
+      auto is_tracked = m_settings.displacement_threshold > 0.0;
+      auto first_slot =
+        is_tracked ? m_epoch_start.grow( std::min( count, size() ) ) : 0u;
+      auto next_slot = std::atomic< std::size_t >{ first_slot };
+
+      m_pool->run( [this, begin, count, is_tracked,
+                    &next_slot]( std::size_t ix ) {
+        ISAI_TRACE_SCOPE( trace_phase_t::winner_search, m_iteration_no );
+        auto part = thread_pool_t::split( count, m_pool->size(), ix );
+        for ( auto k = part.first; k < part.second; k++ )
+        {
+          auto const &input =
+            ( *std::next( begin, static_cast< typename std::iterator_traits<
+                                   Iterator >::difference_type >( k ) ) )
+              .features;
+          auto w = find_winner_relaxed( m_hidden_layer, 0u,
+                                        m_hidden_layer.padded_size(), input )
+                     .index;
+          auto winner = neuron_type{ m_hidden_layer.neuron_relaxed( w ) };
+          if ( m_hogwild_wins[ w ].fetch_add( 1, std::memory_order_relaxed ) ==
+                 0 &&
+               is_tracked && m_statuses[ w ] == 0 )
+          {
+            m_epoch_start.save_at(
+              next_slot.fetch_add( 1u, std::memory_order_relaxed ), w,
+              winner.weights() );
+          }
+          winner.adjust_to( input, static_cast< T >( m_settings.alpha ) );
+          m_hidden_layer.store_relaxed( w, winner.weights() );
+        }
+      } );
+      if ( is_tracked )
+      {
+        m_epoch_start.shrink( next_slot.load( std::memory_order_relaxed ) );
+      }
+
+      for ( auto i = std::size_t{ 0 }; i < size(); i++ )
+      {
+        auto wins =
+          m_hogwild_wins[ i ].exchange( 0, std::memory_order_relaxed );
+        if ( wins > 0 )
+        {
+          m_statuses[ i ] += wins;
+          m_nearest.mark_moved( i );
+          if ( m_index )
+          {
+            m_index->update( m_hidden_layer, i );
+          }
+        }
+      }
+    }
+
     void kill()
     {
+      ISAI_TRACE_SCOPE( trace_phase_t::kill, m_iteration_no );
       assert( m_kill_count == 0 );
-      for ( auto &&s : m_statuses )
+      for ( auto i = std::size_t{ 0 }; i < size(); i++ )
       {
-        if ( s == 0 )
+        if ( m_statuses[ i ] == 0 )
         {
-          s = -1;
+          m_statuses[ i ] = -1;
           m_kill_count++;
           m_alive_count--;
           if ( is_completed() )
@@ -219,61 +980,254 @@ namespace isai
           }
         }
       }
+      compact();
     }
 
+    // every coalesce interval
     void coalesce()
     {
-      if ( is_completed() ||
-           m_iteration_no % m_settings.coalesce_interval != 0 )
+      if ( m_iteration_no % m_settings.coalesce_interval == 0 )
+      {
+        coalesce_closest();
+      }
+    }
+
+    // merges closest pair of alive neurons (or several mutually closest
+    // pairs, if allowed by settings) - nearest partners are cached between
+    // passes and only rows affected by moves or deaths get recomputed
+    void coalesce_closest()
+    {
+      if ( is_completed() )
       {
         return;
       }
+      ISAI_TRACE_SCOPE( trace_phase_t::coalesce, m_iteration_no );
 
-      auto best_i = std::size_t{ 0 };
-      auto best_j = std::size_t{ 0 };
-      auto best_val = std::numeric_limits< double >::min();
+      m_nearest.refresh( m_hidden_layer,
+                         [this]( std::size_t ix ) { return is_alive( ix ); } );
 
+      auto limit =
+        std::min( std::max( m_settings.coalesce_pair_limit, std::size_t{ 1 } ),
+                  m_alive_count - m_settings.expected_cluster_count );
+      for ( auto &&pair : m_nearest.mutual_pairs( limit ) )
+      {
+        coalesce( pair.first, pair.second );
+      }
+      compact();
+    }
+
+    void coalesce( std::size_t i, std::size_t j )
+    {
+      auto merged = neuron_type{ m_hidden_layer.neuron( j ) };
+      merged.average_with( neuron_type{ m_hidden_layer.neuron( i ) } );
+      move_neuron( j, merged.weights() );
+      m_statuses[ i ] = -1;
+      m_coalesce_count++;
+      m_alive_count--;
+    }
+
+    // removes dead neurons from hot storage, keeping relative order of alive
+    // ones (so lower slot still means lower id and tie-breaking is kept)
+    void compact()
+    {
+      if ( m_alive_count == size() )
+      {
+        return;
+      }
+
+      m_remap.resize( size() );
+      auto kept = std::size_t{ 0 };
       for ( auto i = std::size_t{ 0 }; i < size(); i++ )
       {
         if ( !is_alive( i ) )
         {
+          m_remap[ i ] = basic_nearest_pairs_t< T >::npos;
           continue;
         }
+        if ( kept != i )
+        {
+          m_hidden_layer.store( kept, m_hidden_layer.neuron( i ) );
+          m_statuses[ kept ] = m_statuses[ i ];
+          m_ids[ kept ] = m_ids[ i ];
+        }
+        m_remap[ i ] = kept++;
+      }
+
+      assert( kept == m_alive_count );
+      m_hidden_layer.resize( kept );
+      m_statuses.resize( kept );
+      m_ids.resize( kept );
+      m_nearest.compact( m_remap, kept );
+      if ( m_index )
+      {
+        m_index->compact( m_hidden_layer, m_remap );
+      }
+      place_layer_again();
+    }
 
-        for ( auto j = i + 1; j < size(); j++ )
+    // shards of shrunk layer span pages first touched by other threads
+    // (shard boundaries move with size), so once it halves, pinned threads
+    // copy their shards into new layer, touching its pages first
+    void place_layer_again()
+    {
+      if ( !m_settings.is_thread_pinned || m_pool->size() == 1u ||
+           m_hidden_layer.padded_size() * 2u > m_placed_size )
+      {
+        return;
+      }
+      auto layer = layer_type{};
+      allocate_layer( layer, size() );
+      m_pool->run( [this, &layer]( std::size_t ix ) {
+        auto shard = thread_pool_t::split( layer.padded_size(),
+                                           m_pool->size(), ix,
+                                           layer_type::block_size );
+        for ( auto d = std::size_t{ 0 }; d < N; d++ )
         {
-          auto dot_prod =
-            m_hidden_layer[ i ].weights() * m_hidden_layer[ j ].weights();
-          if ( is_alive( j ) && dot_prod > best_val )
-          {
-            best_i = i;
-            best_j = j;
-            best_val = dot_prod;
-          }
+          std::copy( m_hidden_layer.column( d ) + shard.first,
+                     m_hidden_layer.column( d ) + shard.second,
+                     layer.column( d ) + shard.first );
         }
+      } );
+      m_hidden_layer = std::move( layer );
+    }
+
+    // before first move of neuron in epoch (it has not won yet)
+    void save_epoch_start( std::size_t ix )
+    {
+      if ( m_settings.displacement_threshold > 0.0 && m_statuses[ ix ] == 0 )
+      {
+        m_epoch_start.save( ix, m_hidden_layer.neuron( ix ) );
       }
-      coalesce( best_i, best_j );
     }
 
-    void coalesce( std::size_t i, std::size_t j )
+    void move_neuron( std::size_t ix, features_type const &weights )
     {
-      m_hidden_layer[ j ].average_with( m_hidden_layer[ i ] );
-      m_statuses[ i ] = -1;
-      m_coalesce_count++;
-      m_alive_count--;
+      m_hidden_layer.store( ix, weights );
+      m_nearest.mark_moved( ix );
+      if ( m_index )
+      {
+        m_index->update( m_hidden_layer, ix );
+      }
     }
 
-    void print_status() const
+    // console sink - with interval set, lines are skipped until it passes
+    // (last iteration is always printed - final call, once run stops,
+    // prints it if it was skipped)
+    void print_status( bool is_final = false )
     {
+      if ( !m_settings.is_verbose || ( is_final && !m_is_status_pending ) )
+      {
+        return;
+      }
+      auto now = std::chrono::steady_clock::now();
+      if ( !is_final && m_settings.status_interval_ms != 0u &&
+           m_alive_count != m_settings.expected_cluster_count &&
+           now - m_last_status <
+             std::chrono::milliseconds( m_settings.status_interval_ms ) )
+      {
+        m_is_status_pending = true;
+        return;
+      }
+      m_last_status = now;
+      m_is_status_pending = false;
       auto perc = ( static_cast< double >( m_alive_count ) /
-                    static_cast< double >( size() ) ) *
+                    static_cast< double >( m_settings.hidden_layer_size ) ) *
                   100.0;
       std::printf( "ITERATION #%03lu - live neurons remaining: %lu/%lu "
                    "(%.2f%%) [killed: %lu, coalesced: %lu]\n",
-                   m_iteration_no, m_alive_count, size(), perc, m_kill_count,
+                   m_iteration_no, m_alive_count,
+                   m_settings.hidden_layer_size, perc, m_kill_count,
                    m_coalesce_count );
     }
 
+    // exact search computes distance to every slot of hidden layer (work
+    // of approximate index is not counted)
+    void count_distance_evaluations( std::size_t input_count ) const
+    {
+      if ( !m_index )
+      {
+        ISAI_TRACE_COUNT( trace_counter_t::distance_evaluations,
+                          static_cast< std::uint64_t >(
+                            input_count * m_hidden_layer.padded_size() ) );
+      }
+      static_cast< void >( input_count );
+    }
+
+    // measures epoch once all inputs were processed (win counts are
+    // complete and no neuron was removed or merged yet) - only neurons which
+    // won some input could have moved
+    void track_convergence()
+    {
+      if ( m_settings.displacement_threshold > 0.0 )
+      {
+        m_total_displacement = 0.0;
+        m_max_displacement = 0.0;
+        for ( auto i = std::size_t{ 0 }; i < size(); i++ )
+        {
+          if ( m_statuses[ i ] > 0 )
+          {
+            auto d = static_cast< double >(
+              neuron_type{ m_hidden_layer.neuron( i ) }.distance_to(
+                m_epoch_start[ i ] ) );
+            m_total_displacement += d;
+            m_max_displacement = std::max( m_max_displacement, d );
+          }
+        }
+      }
+
+      if ( m_settings.plateau_epochs != 0u )
+      {
+        auto winners = static_cast< double >(
+          std::count_if( m_statuses.begin(), m_statuses.end(),
+                         []( int s ) { return s > 0; } ) );
+        if ( m_plateau_length != 0u &&
+             std::abs( winners - m_plateau_base ) <=
+               m_settings.plateau_tolerance * m_plateau_base )
+        {
+          m_plateau_length++;
+        }
+        else
+        {
+          m_plateau_base = winners;
+          m_plateau_length = 1u;
+        }
+      }
+    }
+
+    bool should_stop()
+    {
+      if ( is_completed() )
+      {
+        m_stop_reason = stop_reason_t::completed;
+        return true;
+      }
+      return should_stop_early();
+    }
+
+    // rules which end incremental training as well
+    bool should_stop_early()
+    {
+      if ( m_settings.displacement_threshold > 0.0 &&
+           m_max_displacement < m_settings.displacement_threshold )
+      {
+        m_stop_reason = stop_reason_t::converged;
+        return true;
+      }
+      if ( m_settings.plateau_epochs != 0u &&
+           m_plateau_length >= m_settings.plateau_epochs )
+      {
+        m_stop_reason = stop_reason_t::plateau;
+        return true;
+      }
+      if ( m_deadline != std::chrono::steady_clock::time_point::max() &&
+           std::chrono::steady_clock::now() >= m_deadline )
+      {
+        m_stop_reason = stop_reason_t::deadline;
+        return true;
+      }
+      return false;
+    }
+
     bool is_completed()
     {
       assert( m_alive_count >= m_settings.expected_cluster_count );
@@ -289,9 +1243,12 @@ namespace isai
     std::size_t size() const noexcept { return m_hidden_layer.size(); }
 
   private:
-    std::vector< kohonen_neuron_t > m_hidden_layer =
-      std::vector< kohonen_neuron_t >{};
+    // dense storage of alive neurons (dead ones are compacted away at the
+    // end of kill and coalesce steps) with their stable ids
+    layer_type m_hidden_layer = layer_type{};
     std::vector< int > m_statuses = std::vector< int >{};
+    std::vector< std::size_t > m_ids = std::vector< std::size_t >{};
+    std::vector< std::size_t > m_remap = std::vector< std::size_t >{};
 
     std::size_t m_iteration_no;
     std::size_t m_alive_count;
@@ -299,8 +1256,49 @@ namespace isai
     std::size_t m_coalesce_count;
 
     knc_settings_t m_settings;
+    basic_winner_kernel_t< T, N > m_winner_kernel;
+    basic_block_winner_kernel_t< T, N > m_block_winner_kernel;
+
+    std::unique_ptr< thread_pool_t > m_pool;
+    std::size_t m_placed_size = 0u;  // padded size layer was placed for
+    std::vector< cache_padded_t< winner_type > > m_shard_winners;
+
+    std::unique_ptr< basic_winner_index_t< T, N > > m_index =
+      std::unique_ptr< basic_winner_index_t< T, N > >{};
+
+    basic_nearest_pairs_t< T > m_nearest;
+
+    // batch mode scratch buffers
+    std::vector< features_type > m_batch_inputs =
+      std::vector< features_type >{};
+    std::vector< winner_type > m_batch_winners = std::vector< winner_type >{};
+    std::vector< features_type > m_batch_sums =
+      std::vector< features_type >{};
+    std::vector< std::size_t > m_batch_counts = std::vector< std::size_t >{};
+    std::vector< std::size_t > m_batch_touched = std::vector< std::size_t >{};
+
+    // convergence tracking
+    basic_epoch_start_t< T, N > m_epoch_start =
+      basic_epoch_start_t< T, N >{};
+    double m_total_displacement = 0.0;
+    double m_max_displacement = std::numeric_limits< double >::infinity();
+    double m_plateau_base = 0.0;
+    std::size_t m_plateau_length = 0u;
+
+    // hogwild mode win counts of current pass
+    std::vector< std::atomic< int > > m_hogwild_wins =
+      std::vector< std::atomic< int > >{};
+
+    bool m_is_status_pending = false;  // line of last iteration skipped
+    std::chrono::steady_clock::time_point m_last_status =
+      std::chrono::steady_clock::time_point{};
+    std::chrono::steady_clock::time_point m_deadline =
+      std::chrono::steady_clock::time_point::max();
+    stop_reason_t m_stop_reason = stop_reason_t::none;
   };
 
+  using kohonen_network_t = basic_kohonen_network_t< scalar_t, iris_dimension >;
+
 }  // namespace isai
 
 #endif  // !ISAI_KOHRIS_KOHNET_H_INCLUDED
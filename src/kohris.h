@@ -4,7 +4,16 @@
 #define ISAI_KOHRIS_KOHRIS_H_INCLUDED
 
 #include "dataset.h"
+#include "evaluation.h"
 #include "kohnet.h"
+#include "model.h"
+#include "stream.h"
+
+#include <array>
+#include <chrono>
+#include <iterator>
+#include <future>
+#include <memory>
 
 namespace isai
 {
@@ -12,91 +21,235 @@ namespace isai
   class iris_clusterizer_t
   {
   public:
+    // dataset is loaded (or stream opened) by background thread while
+    // network initializes its neurons (in parallel blocks, see
+    // basic_kohonen_network_t::init_neurons); loader gets its own prng
+    // stream drawn first, so seeded runs stay reproducible
     explicit iris_clusterizer_t( knc_settings_t const &settings ) :
-      m_settings( settings ),
-      m_dataset( settings.training_set_size,
-                 settings.normalization_sphere_radius,
-                 settings.is_feature_sign_balanced ),
+      m_settings( seed_prng( settings ) ),
+      m_startup_begin( std::chrono::steady_clock::now() ),
+      m_loader( start_loading( settings ) ),
       m_solver( settings )
     {
+      m_network_ms = elapsed_ms( m_startup_begin );
+      auto loaded = m_loader.get();
+      m_dataset = std::move( loaded.dataset );
+      m_stream = std::move( loaded.stream );
+      m_dataset_ms = loaded.ms;
+      m_startup_ms = elapsed_ms( m_startup_begin );
     }
 
     void run()
     {
       std::printf( "Training started with following parameters:\n" );
       print_settings();
+      print_startup();
 
-      m_solver.run( m_dataset.train_begin(), m_dataset.train_end() );
-      std::printf( "Training completed.\n\n" );
+      if ( !m_settings.resume_path.empty() )
+      {
+        m_solver.load_checkpoint( m_settings.resume_path.c_str() );
+        std::printf( "Training resumed from checkpoint %s.\n",
+                     m_settings.resume_path.c_str() );
+      }
+      if ( m_dataset )
+      {
+        m_solver.run( m_dataset->train_begin(), m_dataset->train_end() );
+      }
+      else
+      {
+        m_solver.run_stream( *m_stream );
+      }
+      if ( m_solver.stop_reason() == stop_reason_t::completed )
+      {
+        std::printf( "Training completed.\n\n" );
+      }
+      else
+      {
+        std::printf( "Training stopped early (%s) with %lu clusters.\n\n",
+                     stop_reason_to_string( m_solver.stop_reason() ),
+                     m_solver.alive_count() );
+      }
 
-      evaluate( m_dataset.test_begin(), m_dataset.test_end(),
-                m_solver.get_results() );
+      auto model = model_t{ m_solver.get_results(), m_solver.get_result_ids(),
+                            m_dataset ? m_dataset->preprocessing()
+                                      : m_stream->preprocessing() };
+      if ( !m_settings.model_path.empty() &&
+           !model.save( m_settings.model_path.c_str() ) )
+      {
+        std::fprintf( stderr, "warning: could not write model %s\n",
+                      m_settings.model_path.c_str() );
+      }
+
+      auto evaluator =
+        evaluator_t{ model, m_settings.simd_level, m_settings.thread_count };
+      if ( m_dataset )
+      {
+        evaluator.add( m_dataset->test_begin(), m_dataset->test_end() );
+      }
+      else
+      {
+        m_stream->start( m_stream->test_chunks(), false );
+        while ( auto chunk = m_stream->next() )
+        {
+          evaluator.add( chunk->begin(), chunk->end() );
+        }
+      }
+      print_evaluation( evaluator.result() );
+
+      if ( !m_settings.trace_path.empty() )
+      {
+        write_trace();
+      }
     }
 
   private:
-    template < typename Iterator >
-    void evaluate( Iterator begin, Iterator end,
-                   std::vector< kohonen_neuron_t > const &results )
+    // explicit seed makes whole run reproducible (dataset split and order,
+    // initial weights) - so it must be applied before anything is drawn
+    static knc_settings_t const &seed_prng( knc_settings_t const &settings )
     {
-      // clusterize test data according to given results
-      auto labels = std::vector< std::pair< std::size_t, std::size_t > >{};
-
-      for ( auto i = begin; i != end; i++ )
+      if ( settings.seed != 0u )
       {
-        auto best_label = std::size_t{ 0 };
-        auto best_dist_sqr = results[ 0 ].sqr_distance_to( ( *i ).features );
+        prng_t::reseed( settings.seed );
+      }
+      return settings;
+    }
 
-        for ( auto j = std::size_t{ 1 }; j < results.size(); j++ )
-        {
-          auto dist_sqr = results[ j ].sqr_distance_to( ( *i ).features );
-          if ( dist_sqr < best_dist_sqr )
-          {
-            best_dist_sqr = dist_sqr;
-            best_label = j;
-          }
-        }
+    struct loaded_t
+    {
+      std::unique_ptr< dataset_t > dataset;
+      std::unique_ptr< chunked_source_t > stream;
+      double ms;
+    };
 
-        auto act_label = static_cast< std::size_t >( ( *i ).label );
+    static std::future< loaded_t >
+    start_loading( knc_settings_t const &settings )
+    {
+      auto seed = prng_t::get_seed();
+      return std::async( std::launch::async, [&settings, seed]() {
+        auto begin = std::chrono::steady_clock::now();
+        prng_t::reseed( seed );
+        auto res = loaded_t{ make_dataset( settings ), make_stream( settings ),
+                             0.0 };
+        res.ms = elapsed_ms( begin );
+        return res;
+      } );
+    }
 
-        assert( best_label >= 0 && best_label < 3 );
-        assert( act_label >= 0 && act_label < 3 );
+    static double elapsed_ms( std::chrono::steady_clock::time_point begin )
+    {
+      return std::chrono::duration< double, std::milli >(
+               std::chrono::steady_clock::now() - begin )
+        .count();
+    }
+
+    // whole dataset is loaded unless streaming is enabled
+    static std::unique_ptr< dataset_t >
+    make_dataset( knc_settings_t const &settings )
+    {
+      if ( settings.stream_chunk_size != 0u )
+      {
+        return nullptr;
+      }
+      return std::make_unique< dataset_t >(
+        settings.training_set_size, settings.normalization_sphere_radius,
+        settings.is_feature_sign_balanced, settings.dataset_path.c_str(),
+        settings.dataset_schema, settings.thread_count,
+        settings.dataset_cache_dir.c_str() );
+    }
 
-        labels.emplace_back( act_label, best_label );
+    static std::unique_ptr< chunked_source_t >
+    make_stream( knc_settings_t const &settings )
+    {
+      if ( settings.stream_chunk_size == 0u )
+      {
+        return nullptr;
       }
+      return std::make_unique< chunked_source_t >(
+        settings.dataset_path.c_str(), settings.dataset_schema,
+        settings.stream_chunk_size, settings.training_set_size,
+        settings.normalization_sphere_radius,
+        settings.is_feature_sign_balanced );
+    }
 
-      // create cross reference table
-      std::size_t crt[ 3 ][ 3 ];
-      for ( auto i = 0; i < 9; i++ )
+    void write_trace()
+    {
+      auto file = std::fopen( m_settings.trace_path.c_str(), "w" );
+      if ( file == nullptr )
       {
-        crt[ i / 3 ][ i % 3 ] = 0u;
+        std::fprintf( stderr, "warning: could not write trace %s\n",
+                      m_settings.trace_path.c_str() );
+        return;
       }
+      trace_write( file, m_settings.trace_format );
+      std::fclose( file );
+    }
 
-      for ( auto &&lp : labels )
+    // cross reference table - actual labels in rows, predicted clusters
+    // in columns - followed by scores
+    void print_evaluation( evaluation_t const &evaluation )
+    {
+      auto const &crt = evaluation.confusion;
+      auto cluster_count = crt.empty() ? std::size_t{ 0 } : crt[ 0 ].size();
+      auto print_line = [cluster_count]() {
+        std::printf( "*----------------------*" );
+        for ( auto c = std::size_t{ 0 }; c < cluster_count; c++ )
+        {
+          std::printf( "------*" );
+        }
+        std::printf( "\n" );
+      };
+
+      print_line();
+      std::printf( "|  actual \\ predicted  |" );
+      for ( auto c = std::size_t{ 0 }; c < cluster_count; c++ )
       {
-        crt[ lp.first ][ lp.second ]++;
+        std::printf( "  #%-3lu|", c + 1u );
+      }
+      std::printf( "\n" );
+      // label names as parsed from dataset (long ones are cut to column)
+      auto const &names =
+        m_dataset ? m_dataset->label_names() : m_stream->label_names();
+      print_line();
+      for ( auto l = std::size_t{ 0 }; l < crt.size(); l++ )
+      {
+        std::printf( "| #%lu - %15.15s |", l + 1u,
+                     label_to_string( names, static_cast< label_t >( l ) ) );
+        for ( auto n : crt[ l ] )
+        {
+          std::printf( " %4lu |", n );
+        }
+        std::printf( "\n" );
+        print_line();
       }
+      std::printf( "Purity: %.4f, adjusted rand index: %.4f, quantization "
+                   "error: %.4f (%lu test inputs).\n",
+                   evaluation.purity, evaluation.adjusted_rand_index,
+                   evaluation.quantization_error, evaluation.count );
+    }
 
-      // print crt
-      std::printf( "*----------------------*------*------*------*\n" );
-      std::printf( "|  actual \\ predicted  |  #1  |  #2  |  #3  |\n" );
-      std::printf( "*----------------------*------*------*------*\n" );
-      std::printf( "| #1 - %15s | %4lu | %4lu | %4lu |\n", iris_label_strs[ 0 ],
-                   crt[ 0 ][ 0 ], crt[ 0 ][ 1 ], crt[ 0 ][ 2 ] );
-      std::printf( "*----------------------*------*------*------*\n" );
-      std::printf( "| #2 - %15s | %4lu | %4lu | %4lu |\n", iris_label_strs[ 1 ],
-                   crt[ 1 ][ 0 ], crt[ 1 ][ 1 ], crt[ 1 ][ 2 ] );
-      std::printf( "*----------------------*------*------*------*\n" );
-      std::printf( "| #3 - %15s | %4lu | %4lu | %4lu |\n", iris_label_strs[ 2 ],
-                   crt[ 2 ][ 0 ], crt[ 2 ][ 1 ], crt[ 2 ][ 2 ] );
-      std::printf( "*----------------------*------*------*------*\n" );
+    // phases are timed on their own threads - with spare cores, startup
+    // takes about the longer of them instead of their sum
+    void print_startup()
+    {
+      std::printf( "Startup took %.1f ms (dataset %.1f ms and network %.1f ms "
+                   "overlapped).\n\n",
+                   m_startup_ms, m_dataset_ms, m_network_ms );
     }
 
     void print_settings()
     {
+      std::printf( " - dataset:                             %s\n",
+                   m_settings.dataset_path.c_str() );
+      std::printf( " - dataset loaded from cache:           %s\n",
+                   m_dataset && m_dataset->is_cached() ? "yes" : "no" );
+      std::printf( " - dataset streaming chunk (0 - off):   %3lu\n",
+                   m_settings.stream_chunk_size );
       std::printf( " - training set size:                   %3lu\n",
                    m_settings.training_set_size );
       std::printf( " - initial no of neurons:               %3lu\n",
                    m_settings.hidden_layer_size );
+      std::printf( " - random seed (0 - not fixed):         %llu\n",
+                   static_cast< unsigned long long >( m_settings.seed ) );
 
       std::printf( " - radius of normalization sphere:      %6.2f\n",
                    m_settings.normalization_sphere_radius );
@@ -104,13 +257,44 @@ namespace isai
                    m_settings.alpha );
       std::printf( " - adjacent neuront coalesce interval:  %3lu\n",
                    m_settings.coalesce_interval );
+      std::printf( " - max pairs coalesced per pass:        %3lu\n",
+                   m_settings.coalesce_pair_limit );
+      std::printf( " - worker threads (0 - all available):  %3lu\n",
+                   m_settings.thread_count );
+      std::printf( " - threads pinned to numa nodes:        %s\n",
+                   m_settings.is_thread_pinned ? "yes" : "no" );
+      std::printf( " - huge pages for weights:              %s\n",
+                   m_settings.use_huge_pages ? "yes" : "no" );
+      std::printf( " - training mode:                       %s\n",
+                   training_mode_to_string( m_settings.training_mode ) );
+      std::printf( " - winner search:                       %s\n",
+                   winner_search_to_string( m_settings.winner_search ) );
+      std::printf( " - checkpoint interval (0 - off):       %3lu\n",
+                   m_settings.checkpoint_interval );
+      std::printf( " - stop below displacement (0 - off):   %g\n",
+                   m_settings.displacement_threshold );
+      std::printf( " - stop after plateau epochs (0 - off): %3lu\n",
+                   m_settings.plateau_epochs );
       std::puts( "" );
     }
 
 
   private:
     knc_settings_t m_settings;
-    dataset_t m_dataset;
+
+    // startup phase timings
+    std::chrono::steady_clock::time_point m_startup_begin;
+    double m_dataset_ms = 0.0;
+    double m_network_ms = 0.0;
+    double m_startup_ms = 0.0;
+
+    std::future< loaded_t > m_loader;
+
+    // whole dataset in memory, or streamed in chunks
+    std::unique_ptr< dataset_t > m_dataset = std::unique_ptr< dataset_t >{};
+    std::unique_ptr< chunked_source_t > m_stream =
+      std::unique_ptr< chunked_source_t >{};
+
     kohonen_network_t m_solver;
   };
 
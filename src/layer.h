@@ -0,0 +1,171 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_LAYER_H_INCLUDED
+#define ISAI_KOHRIS_LAYER_H_INCLUDED
+
+#include "aligned.h"
+#include "dataset.h"
+#include "numa.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace isai
+{
+
+  // hidden layer weights stored as structure of arrays - one aligned column
+  // per feature coordinate, so that winner search can stream whole columns;
+  // large columns are mapped pages (optionally huge ones), see
+  // page_allocator_t
+  template < typename T, std::size_t N >
+  class basic_hidden_layer_t
+  {
+  public:
+    using value_type = T;
+    using features_type = basic_features_t< T, N >;
+    static constexpr std::size_t dimension = N;
+
+    // columns are padded to multiple of this, so kernels need no tail loops
+    // (one avx-512 register of floats)
+    static constexpr std::size_t block_size = 16u;
+
+    explicit basic_hidden_layer_t( std::size_t count = 0u,
+                                   bool is_huge = false ) :
+      basic_hidden_layer_t( count, page_allocator_t< T >{ is_huge } )
+    {
+    }
+
+    // columns taken from given allocator (e.g. arena in shared memory)
+    basic_hidden_layer_t( std::size_t count,
+                          page_allocator_t< T > const &allocator )
+    {
+      for ( auto &&col : m_columns )
+      {
+        col = column_type( allocator );
+      }
+      resize( count );
+    }
+
+    // number of neurons and number of slots including padding
+    std::size_t size() const noexcept { return m_size; }
+    std::size_t padded_size() const noexcept { return m_columns[ 0 ].size(); }
+
+    // slots kept from before keep their weights, newly allocated ones are
+    // zeroed; all slots past count (padding) are parked
+    void resize( std::size_t count )
+    {
+      auto kept = std::min( padded_size(), padded_for( count ) );
+      resize_unset( count );
+      reset( kept, padded_size() );
+      for ( auto i = count; i < kept; i++ )
+      {
+        park( i );
+      }
+    }
+
+    // as resize, but new slots are left unwritten until reset - e.g. by
+    // threads that will scan them, so that each thread touches (and places
+    // on its numa node) pages of its own part first
+    void resize_unset( std::size_t count )
+    {
+      for ( auto &&col : m_columns )
+      {
+        col.resize( padded_for( count ) );
+      }
+      m_size = count;
+    }
+
+    // zeroes slots [begin, end) (padding ones are parked instead)
+    void reset( std::size_t begin, std::size_t end )
+    {
+      assert( end <= padded_size() );
+      for ( auto &&col : m_columns )
+      {
+        std::fill( col.begin() + static_cast< std::ptrdiff_t >( begin ),
+                   col.begin() + static_cast< std::ptrdiff_t >( end ),
+                   T{ 0 } );
+      }
+      for ( auto i = std::max( begin, m_size ); i < end; i++ )
+      {
+        park( i );
+      }
+    }
+
+    // gathers weights of single neuron
+    features_type neuron( std::size_t pos ) const
+    {
+      assert( pos < padded_size() );
+      auto res = features_type{};
+      static_for< N >( [&]( auto d ) { res[ d ] = m_columns[ d ][ pos ]; } );
+      return res;
+    }
+
+    // scatters weights of single neuron
+    void store( std::size_t pos, features_type const &weights )
+    {
+      assert( pos < padded_size() );
+      static_for< N >(
+        [&]( auto d ) { m_columns[ d ][ pos ] = weights[ d ]; } );
+    }
+
+    // as neuron and store, but each coordinate is relaxed atomic access -
+    // for threads that move neurons while others read them (plain loads
+    // and stores would race); gcc/clang builtins, as std::atomic_ref is
+    // c++20
+    features_type neuron_relaxed( std::size_t pos ) const
+    {
+      assert( pos < padded_size() );
+      auto res = features_type{};
+      static_for< N >( [&]( auto d ) {
+        __atomic_load( &m_columns[ d ][ pos ], &res[ d ], __ATOMIC_RELAXED );
+      } );
+      return res;
+    }
+
+    void store_relaxed( std::size_t pos, features_type const &weights )
+    {
+      assert( pos < padded_size() );
+      static_for< N >( [&]( auto d ) {
+        auto value = weights[ d ];
+        __atomic_store( &m_columns[ d ][ pos ], &value, __ATOMIC_RELAXED );
+      } );
+    }
+
+    // dot product of two neurons (same summation order as features one)
+    T dot( std::size_t i, std::size_t j ) const
+    {
+      auto res = m_columns[ 0 ][ i ] * m_columns[ 0 ][ j ];
+      static_for< N - 1u >( [&]( auto d ) {
+        res += m_columns[ d + 1u ][ i ] * m_columns[ d + 1u ][ j ];
+      } );
+      return res;
+    }
+
+    // moves slot infinitely far away, so it never wins any distance test
+    void park( std::size_t pos )
+    {
+      assert( pos < padded_size() );
+      m_columns[ 0 ][ pos ] = std::numeric_limits< T >::infinity();
+    }
+
+    T const *column( std::size_t dim ) const { return m_columns[ dim ].data(); }
+    T *column( std::size_t dim ) { return m_columns[ dim ].data(); }
+
+  private:
+    using column_type = std::vector< T, page_allocator_t< T > >;
+
+    static std::size_t padded_for( std::size_t count ) noexcept
+    {
+      return ( count + block_size - 1u ) / block_size * block_size;
+    }
+
+  private:
+    std::array< column_type, N > m_columns = std::array< column_type, N >{};
+    std::size_t m_size = 0u;
+  };
+
+  using hidden_layer_t = basic_hidden_layer_t< scalar_t, iris_dimension >;
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_LAYER_H_INCLUDED
@@ -0,0 +1,124 @@
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace isai
+{
+
+  mapped_file_t::mapped_file_t( char const *path )
+  {
+    auto fd = ::open( path, O_RDONLY | O_CLOEXEC );  // NOLINT
+    if ( fd < 0 )
+    {
+      throw std::system_error{ errno, std::generic_category(),
+                               std::string{ "cannot open " } + path };
+    }
+
+    struct stat st = {};
+    if ( ::fstat( fd, &st ) != 0 )
+    {
+      auto err = errno;
+      ::close( fd );
+      throw std::system_error{ err, std::generic_category(),
+                               std::string{ "cannot stat " } + path };
+    }
+
+    // empty file cannot be mapped, but is still valid (empty view)
+    auto size = static_cast< std::size_t >( st.st_size );
+    if ( size > 0u )
+    {
+      auto *addr = ::mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+      if ( addr == MAP_FAILED )  // NOLINT
+      {
+        auto err = errno;
+        ::close( fd );
+        throw std::system_error{ err, std::generic_category(),
+                                 std::string{ "cannot map " } + path };
+      }
+      ::madvise( addr, size, MADV_SEQUENTIAL );
+      m_data = static_cast< char const * >( addr );
+      m_size = size;
+    }
+
+    // mapping stays valid after descriptor is closed
+    ::close( fd );
+  }
+
+  mapped_file_t::mapped_file_t( mapped_file_t &&other ) noexcept :
+    m_data( std::exchange( other.m_data, nullptr ) ),
+    m_size( std::exchange( other.m_size, 0u ) )
+  {
+  }
+
+  mapped_file_t &mapped_file_t::operator=( mapped_file_t &&other ) noexcept
+  {
+    if ( this != &other )
+    {
+      unmap();
+      m_data = std::exchange( other.m_data, nullptr );
+      m_size = std::exchange( other.m_size, 0u );
+    }
+    return *this;
+  }
+
+  mapped_file_t::~mapped_file_t() { unmap(); }
+
+  void mapped_file_t::discard( std::size_t offset,
+                              std::size_t size ) const noexcept
+  {
+    // only whole pages inside of range
+    auto page = static_cast< std::size_t >( ::sysconf( _SC_PAGESIZE ) );
+    auto first = ( offset + page - 1u ) / page * page;
+    auto last = std::min( offset + size, m_size ) / page * page;
+    if ( m_data != nullptr && first < last )
+    {
+      ::madvise( const_cast< char * >( m_data ) + first, last - first,
+                 MADV_DONTNEED );
+    }
+  }
+
+  void mapped_file_t::unmap() noexcept
+  {
+    if ( m_data != nullptr )
+    {
+      ::munmap( const_cast< char * >( m_data ), m_size );
+      m_data = nullptr;
+      m_size = 0u;
+    }
+  }
+
+  bool write_file_atomically( char const *path, char const *data,
+                              std::size_t size )
+  {
+    auto tmp_path =
+      std::string{ path } + ".tmp." + std::to_string( ::getpid() );
+    {
+      auto fout = std::ofstream{ tmp_path, std::ios::out | std::ios::binary };
+      fout.write( data, static_cast< std::streamsize >( size ) );
+      if ( !fout )
+      {
+        fout.close();
+        std::remove( tmp_path.c_str() );
+        return false;
+      }
+    }
+    if ( std::rename( tmp_path.c_str(), path ) != 0 )
+    {
+      std::remove( tmp_path.c_str() );
+      return false;
+    }
+    return true;
+  }
+
+}  // namespace isai
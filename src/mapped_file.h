@@ -0,0 +1,49 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_MAPPED_FILE_H_INCLUDED
+#define ISAI_KOHRIS_MAPPED_FILE_H_INCLUDED
+
+#include <cstddef>
+#include <string_view>
+
+namespace isai
+{
+
+  // read-only memory mapping of whole file (contents are paged in lazily,
+  // nothing is copied); throws std::system_error when file cannot be mapped
+  class mapped_file_t
+  {
+  public:
+    mapped_file_t() noexcept = default;
+    explicit mapped_file_t( char const *path );
+    mapped_file_t( mapped_file_t const & ) = delete;
+    mapped_file_t( mapped_file_t &&other ) noexcept;
+    mapped_file_t &operator=( mapped_file_t const & ) = delete;
+    mapped_file_t &operator=( mapped_file_t &&other ) noexcept;
+    ~mapped_file_t();
+
+    char const *data() const noexcept { return m_data; }
+    std::size_t size() const noexcept { return m_size; }
+    std::string_view view() const noexcept { return { m_data, m_size }; }
+
+    // drops pages of given range from memory (they are read again from
+    // file when touched) - keeps resident size bounded when streaming
+    void discard( std::size_t offset, std::size_t size ) const noexcept;
+
+  private:
+    void unmap() noexcept;
+
+  private:
+    char const *m_data = nullptr;
+    std::size_t m_size = 0u;
+  };
+
+  // writes whole file through temporary one renamed at the end, so readers
+  // (possibly other processes) never see partially written contents;
+  // false on failure
+  bool write_file_atomically( char const *path, char const *data,
+                              std::size_t size );
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_MAPPED_FILE_H_INCLUDED
@@ -0,0 +1,189 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_MODEL_H_INCLUDED
+#define ISAI_KOHRIS_MODEL_H_INCLUDED
+
+#include "binary_io.h"
+#include "dataset.h"
+#include "dataset_cache.h"
+#include "kohnet.h"
+#include "unroll.h"
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace isai
+{
+
+  // inference-only export of trained network - centroids (surviving
+  // neurons) with their ids and preprocessing needed for raw inputs;
+  // file is header, then 64-byte aligned row-major weights and ids, and
+  // loading only maps it and validates header (weights are used in place)
+
+  constexpr char model_magic[ 8 ] = "KOHRISM";
+  constexpr std::uint32_t model_version = 1u;
+
+  template < typename T, std::size_t N >
+  class basic_model_t
+  {
+  public:
+    using features_type = basic_features_t< T, N >;
+    using neuron_type = basic_kohonen_neuron_t< T, N >;
+    using preprocessing_type = basic_preprocessing_t< T, N >;
+
+    basic_model_t() = default;
+
+    // e.g. from get_results() and get_result_ids() of trained network
+    basic_model_t( std::vector< neuron_type > const &centroids,
+                   std::vector< std::size_t > const &ids,
+                   preprocessing_type const &preprocessing ) :
+      m_preprocessing( preprocessing ),
+      m_size( centroids.size() )
+    {
+      assert( ids.size() == centroids.size() );
+      m_weights.reserve( m_size * N );
+      for ( auto &&c : centroids )
+      {
+        m_weights.insert( m_weights.end(), c.weights().begin(),
+                          c.weights().end() );
+      }
+      m_ids.assign( ids.begin(), ids.end() );
+    }
+
+    // throws std::system_error or std::runtime_error (incompatible file)
+    static basic_model_t load( char const *path )
+    {
+      auto res = basic_model_t{};
+      auto in = binary_reader_t{ path };
+      in.expect_header( model_magic, model_version );
+      if ( in.get< std::uint32_t >() != sizeof( T ) ||
+           in.get< std::uint64_t >() != N )
+      {
+        in.fail( "model of network with different weight layout" );
+      }
+      auto size = in.get< std::uint64_t >();
+      res.m_preprocessing.radius = in.get< double >();
+      res.m_preprocessing.is_balanced = in.get< std::uint64_t >() != 0u;
+      in.read( res.m_preprocessing.means.data(),
+               sizeof( res.m_preprocessing.means ) );
+      in.expect_records( size, N * sizeof( T ) + sizeof( std::uint64_t ) );
+      res.m_size = static_cast< std::size_t >( size );
+
+      in.align();
+      res.m_mapped_weights = reinterpret_cast< T const * >(
+        in.view( res.m_size * N * sizeof( T ) ) );
+      in.align();
+      res.m_mapped_ids = reinterpret_cast< std::uint64_t const * >(
+        in.view( res.m_size * sizeof( std::uint64_t ) ) );
+      res.m_file = std::move( in.file() );
+      return res;
+    }
+
+    // false on failure (file is replaced atomically)
+    bool save( char const *path ) const
+    {
+      auto out = binary_writer_t{};
+      out.append( model_magic, sizeof( model_magic ) );
+      out.put( model_version );
+      out.put( static_cast< std::uint32_t >( sizeof( T ) ) );
+      out.put( static_cast< std::uint64_t >( N ) );
+      out.put( static_cast< std::uint64_t >( m_size ) );
+      out.put( m_preprocessing.radius );
+      out.put( static_cast< std::uint64_t >( m_preprocessing.is_balanced ) );
+      out.append( m_preprocessing.means.data(),
+                  sizeof( m_preprocessing.means ) );
+
+      out.align();
+      out.append( weights(), m_size * N * sizeof( T ) );
+      out.align();
+      for ( auto k = std::size_t{ 0 }; k < m_size; k++ )
+      {
+        out.put( static_cast< std::uint64_t >( id( k ) ) );
+      }
+      return out.write( path );
+    }
+
+    std::size_t size() const noexcept { return m_size; }
+
+    // row-major weights of all centroids
+    T const *weights() const noexcept
+    {
+      return m_mapped_weights != nullptr ? m_mapped_weights
+                                         : m_weights.data();
+    }
+
+    features_type centroid( std::size_t k ) const
+    {
+      assert( k < m_size );
+      auto res = features_type{};
+      static_for< N >( [&]( auto d ) { res[ d ] = weights()[ k * N + d ]; } );
+      return res;
+    }
+
+    // stable id of neuron the centroid comes from
+    std::size_t id( std::size_t k ) const
+    {
+      assert( k < m_size );
+      return static_cast< std::size_t >(
+        m_mapped_ids != nullptr ? m_mapped_ids[ k ] : m_ids[ k ] );
+    }
+
+    preprocessing_type const &preprocessing() const noexcept
+    {
+      return m_preprocessing;
+    }
+
+    // applies preprocessing of training data to raw input (last coordinate
+    // is the one reserved for projection)
+    void prepare( features_type &features ) const
+    {
+      if ( m_preprocessing.is_balanced )
+      {
+        static_for< N - 1u >(
+          [&]( auto d ) { features[ d ] -= m_preprocessing.means[ d ]; } );
+      }
+      features[ N - 1u ] = T{ 0 };
+      normalize_stereographic( features,
+                               static_cast< T >( m_preprocessing.radius ) );
+    }
+
+    // nearest centroid of prepared input (lowest index wins ties)
+    std::size_t classify( features_type const &features ) const
+    {
+      auto best = std::size_t{ 0 };
+      auto best_dist_sqr = std::numeric_limits< T >::infinity();
+      for ( auto k = std::size_t{ 0 }; k < m_size; k++ )
+      {
+        auto dist_sqr = T{ 0 };
+        static_for< N >( [&]( auto d ) {
+          auto diff = features[ d ] - weights()[ k * N + d ];
+          dist_sqr += diff * diff;
+        } );
+        if ( dist_sqr < best_dist_sqr )
+        {
+          best_dist_sqr = dist_sqr;
+          best = k;
+        }
+      }
+      return best;
+    }
+
+  private:
+    preprocessing_type m_preprocessing = preprocessing_type{};
+    std::size_t m_size = 0u;
+
+    // owned storage, or pointers into mapped file
+    std::vector< T > m_weights = std::vector< T >{};
+    std::vector< std::uint64_t > m_ids = std::vector< std::uint64_t >{};
+    mapped_file_t m_file = mapped_file_t{};
+    T const *m_mapped_weights = nullptr;
+    std::uint64_t const *m_mapped_ids = nullptr;
+  };
+
+  using model_t = basic_model_t< scalar_t, iris_dimension >;
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_MODEL_H_INCLUDED
@@ -0,0 +1,413 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_NEAREST_H_INCLUDED
+#define ISAI_KOHRIS_NEAREST_H_INCLUDED
+
+#include "layer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <tuple>
+#include <utility>
+
+namespace isai
+{
+
+  // caches nearest alive partner (highest dot product - all weights lie on
+  // unit sphere) of each neuron, with upper bound of its dot product with
+  // any other neuron; refresh widens bounds by how far neurons moved since
+  // previous one (dot of two neurons changes at most by their shifts times
+  // largest norm - few neurons which moved most are checked exactly
+  // instead) and recomputes only rows whose partner died or no longer
+  // beats the bound - the others keep exact partner, just its dot updated
+  template < typename T >
+  class basic_nearest_pairs_t
+  {
+  public:
+    static constexpr std::size_t npos =
+      std::numeric_limits< std::size_t >::max();
+
+    struct nearest_t
+    {
+      std::size_t partner;
+      T dot;
+    };
+
+    explicit basic_nearest_pairs_t( std::size_t count = 0u ) { reset( count ); }
+
+    // forgets everything - next refresh recomputes all rows
+    void reset( std::size_t count )
+    {
+      m_nearest.assign( count, unknown() );
+      m_bounds.assign( count, std::numeric_limits< T >::max() );
+      m_is_moved.assign( count, false );
+      m_moved.clear();
+      m_anchors.clear();
+    }
+
+    // to be called whenever weights of neuron change
+    void mark_moved( std::size_t ix )
+    {
+      if ( !m_is_moved[ ix ] )
+      {
+        m_is_moved[ ix ] = true;
+        m_moved.emplace_back( ix );
+      }
+    }
+
+    // follows compaction of hidden layer - remap holds new index of each
+    // old one (npos for removed ones, whose partners become stale)
+    void compact( std::vector< std::size_t > const &remap, std::size_t count )
+    {
+      for ( auto old = std::size_t{ 0 }; old < remap.size(); old++ )
+      {
+        auto ix = remap[ old ];
+        if ( ix == npos )
+        {
+          continue;
+        }
+        assert( ix <= old );
+        auto n = m_nearest[ old ];
+        n.partner = n.partner == npos ? npos : remap[ n.partner ];
+        m_nearest[ ix ] = n;
+        m_bounds[ ix ] = m_bounds[ old ];
+        m_is_moved[ ix ] = m_is_moved[ old ];
+        if ( !m_anchors.empty() )
+        {
+          std::copy_n( m_anchors.begin() +
+                         static_cast< std::ptrdiff_t >( old * m_dimension ),
+                       m_dimension,
+                       m_anchors.begin() +
+                         static_cast< std::ptrdiff_t >( ix * m_dimension ) );
+        }
+      }
+      m_nearest.resize( count );
+      m_bounds.resize( count );
+      m_is_moved.resize( count );
+      if ( !m_anchors.empty() )
+      {
+        m_anchors.resize( count * m_dimension );
+      }
+
+      m_moved.clear();
+      for ( auto ix = std::size_t{ 0 }; ix < count; ix++ )
+      {
+        if ( m_is_moved[ ix ] )
+        {
+          m_moved.emplace_back( ix );
+        }
+      }
+      m_alive.clear();
+    }
+
+    // takes partners computed elsewhere (e.g. by processes owning parts of
+    // layer) for all neurons - all of them alive, none marked as moved (next
+    // refresh recomputes all rows, as their bounds are not known)
+    void assign( std::vector< nearest_t > nearest )
+    {
+      m_nearest = std::move( nearest );
+      m_bounds.assign( m_nearest.size(), std::numeric_limits< T >::max() );
+      m_is_moved.assign( m_nearest.size(), false );
+      m_moved.clear();
+      m_anchors.clear();
+      m_alive.resize( m_nearest.size() );
+      std::iota( m_alive.begin(), m_alive.end(), std::size_t{ 0 } );
+    }
+
+    nearest_t const &operator[]( std::size_t ix ) const
+    {
+      return m_nearest[ ix ];
+    }
+
+    // brings cached partners of all alive neurons up to date
+    template < typename Layer, typename IsAlive >
+    void refresh( Layer const &layer, IsAlive &&is_alive )
+    {
+      m_alive.clear();
+      for ( auto i = std::size_t{ 0 }; i < layer.size(); i++ )
+      {
+        if ( is_alive( i ) )
+        {
+          m_alive.emplace_back( i );
+        }
+      }
+
+      m_stale.clear();
+      m_hot.clear();
+      if ( m_anchors.size() != layer.size() * Layer::dimension )
+      {
+        m_anchors.clear();
+        m_stale = m_alive;
+      }
+      else if ( !widen_bounds( layer ) )
+      {
+        m_stale = m_alive;
+      }
+      else
+      {
+        for ( auto i : m_alive )
+        {
+          auto &n = m_nearest[ i ];
+          if ( n.partner == npos || !is_alive( n.partner ) )
+          {
+            m_stale.emplace_back( i );
+            continue;
+          }
+          n.dot = layer.dot( i, n.partner );
+          for ( auto j : m_hot )
+          {
+            if ( j != i && j != n.partner )
+            {
+              consider( i, j, layer.dot( i, j ) );
+            }
+          }
+          if ( !( n.dot > m_bounds[ i ] ) )
+          {
+            m_stale.emplace_back( i );
+          }
+        }
+      }
+      m_rescanned_count = m_stale.size();
+
+      if ( 2u * m_stale.size() >= m_alive.size() )
+      {
+        // most rows affected anyway - symmetric full rescan is cheaper
+        for ( auto i : m_alive )
+        {
+          forget( i );
+        }
+        for ( auto a = std::size_t{ 0 }; a < m_alive.size(); a++ )
+        {
+          auto i = m_alive[ a ];
+          for ( auto b = a + 1u; b < m_alive.size(); b++ )
+          {
+            auto j = m_alive[ b ];
+            auto dot = layer.dot( i, j );
+            consider( i, j, dot );
+            consider( j, i, dot );
+          }
+        }
+        m_rescanned_count = m_alive.size();
+      }
+      else
+      {
+        // valid rows are exact already, so stale ones need not be offered
+        // to them
+        for ( auto r : m_stale )
+        {
+          forget( r );
+          for ( auto j : m_alive )
+          {
+            if ( j != r )
+            {
+              consider( r, j, layer.dot( r, j ) );
+            }
+          }
+        }
+      }
+
+      anchor( layer );
+    }
+
+    // rows recomputed by last refresh (e.g. for benchmarks)
+    std::size_t rescanned_count() const noexcept { return m_rescanned_count; }
+
+    // disjoint pairs of mutually nearest neurons (lower index first), closest
+    // first; the globally closest pair is always among them
+    std::vector< std::pair< std::size_t, std::size_t > >
+    mutual_pairs( std::size_t limit ) const
+    {
+      auto candidates =
+        std::vector< std::tuple< T, std::size_t, std::size_t > >{};
+      for ( auto i : m_alive )
+      {
+        auto j = m_nearest[ i ].partner;
+        if ( j != npos && i < j && m_nearest[ j ].partner == i )
+        {
+          candidates.emplace_back( m_nearest[ i ].dot, i, j );
+        }
+      }
+
+      auto count = std::min( limit, candidates.size() );
+      std::partial_sort(
+        candidates.begin(),
+        candidates.begin() + static_cast< std::ptrdiff_t >( count ),
+        candidates.end(), []( auto &&lhs, auto &&rhs ) {
+          return std::get< 0 >( lhs ) > std::get< 0 >( rhs ) ||
+                 ( std::get< 0 >( lhs ) == std::get< 0 >( rhs ) &&
+                   std::get< 1 >( lhs ) < std::get< 1 >( rhs ) );
+        } );
+
+      auto res = std::vector< std::pair< std::size_t, std::size_t > >{};
+      for ( auto k = std::size_t{ 0 }; k < count; k++ )
+      {
+        res.emplace_back( std::get< 1 >( candidates[ k ] ),
+                          std::get< 2 >( candidates[ k ] ) );
+      }
+      return res;
+    }
+
+  private:
+    static nearest_t unknown() noexcept
+    {
+      return nearest_t{ npos, std::numeric_limits< T >::lowest() };
+    }
+
+    void forget( std::size_t ix )
+    {
+      m_nearest[ ix ] = unknown();
+      m_bounds[ ix ] = std::numeric_limits< T >::lowest();
+    }
+
+    // keeps closer candidate (on ties - one with lower index), the other
+    // one raises bound of non-partners
+    void consider( std::size_t ix, std::size_t candidate, T dot )
+    {
+      auto &n = m_nearest[ ix ];
+      if ( dot > n.dot || ( dot == n.dot && candidate < n.partner ) )
+      {
+        m_bounds[ ix ] = std::max( m_bounds[ ix ], n.dot );
+        n = nearest_t{ candidate, dot };
+      }
+      else
+      {
+        m_bounds[ ix ] = std::max( m_bounds[ ix ], dot );
+      }
+    }
+
+    // dot of neurons i and j changes at most by |shift i| * |j| + |i| *
+    // |shift j|, so bound of every row grows by its own shift plus the
+    // largest one, times the largest norm (plus rounding slack of computed
+    // dot products, which may be off by few ulps of squared norm); usually
+    // few neurons (winners, merged ones) move far while others barely do,
+    // so those with largest shifts are left out of the largest one and
+    // their dots are computed exactly instead - as many as minimizes these
+    // dots plus rescans of rows whose gap (partner dot above bound) is
+    // estimated to be used up; false when symmetric full rescan (half of
+    // all dots) is expected to be cheaper anyway
+    template < typename Layer >
+    bool widen_bounds( Layer const &layer )
+    {
+      m_shifts.assign( layer.size(), T{ 0 } );
+      auto max_sqr_norm = T{ 0 };
+      for ( auto i : m_alive )
+      {
+        auto weights = layer.neuron( i );
+        auto const *anchor = anchor_of( i );
+        auto sqr_shift = T{ 0 };
+        auto sqr_norm = T{ 0 };
+        auto sqr_anchor_norm = T{ 0 };
+        for ( auto d = std::size_t{ 0 }; d < Layer::dimension; d++ )
+        {
+          auto diff = weights[ d ] - anchor[ d ];
+          sqr_shift += diff * diff;
+          sqr_norm += weights[ d ] * weights[ d ];
+          sqr_anchor_norm += anchor[ d ] * anchor[ d ];
+        }
+        m_shifts[ i ] = std::sqrt( sqr_shift );
+        max_sqr_norm =
+          std::max( { max_sqr_norm, sqr_norm, sqr_anchor_norm } );
+      }
+      auto max_norm = std::sqrt( max_sqr_norm );
+      auto slack = T( 8 * ( Layer::dimension + 2u ) ) *
+                   std::numeric_limits< T >::epsilon() * max_sqr_norm;
+
+      m_hot = m_alive;
+      std::sort( m_hot.begin(), m_hot.end(), [this]( auto lhs, auto rhs ) {
+        return m_shifts[ lhs ] > m_shifts[ rhs ] ||
+               ( m_shifts[ lhs ] == m_shifts[ rhs ] && lhs < rhs );
+      } );
+      auto cold_shift = [this]( std::size_t hot_count ) {
+        return hot_count < m_hot.size() ? m_shifts[ m_hot[ hot_count ] ]
+                                        : T{ 0 };
+      };
+      auto full_cost = m_alive.size() * m_alive.size() / 2u;
+      auto best_count = npos;
+      auto best_cost = full_cost;
+      for ( auto k = std::size_t{ 0 }; k <= m_hot.size(); k = 2u * k + 1u )
+      {
+        auto cost = k * m_alive.size();
+        for ( auto i : m_alive )
+        {
+          auto const &n = m_nearest[ i ];
+          if ( n.partner == npos ||
+               !( n.dot - m_bounds[ i ] >
+                  max_norm * ( m_shifts[ i ] + cold_shift( k ) ) + slack ) )
+          {
+            cost += m_alive.size();
+          }
+        }
+        if ( cost < best_cost )
+        {
+          best_count = k;
+          best_cost = cost;
+        }
+      }
+
+      if ( best_count == npos )
+      {
+        return false;
+      }
+
+      auto max_shift = cold_shift( best_count );
+      m_hot.resize( best_count );
+      for ( auto i : m_alive )
+      {
+        m_bounds[ i ] += max_norm * ( m_shifts[ i ] + max_shift ) + slack;
+      }
+      return true;
+    }
+
+    // positions bounds are measured from - current ones (only moved
+    // neurons need update, unless there were none yet)
+    template < typename Layer >
+    void anchor( Layer const &layer )
+    {
+      auto const &updated = m_anchors.empty() ? m_alive : m_moved;
+      m_dimension = Layer::dimension;
+      m_anchors.resize( layer.size() * m_dimension );
+      for ( auto ix : updated )
+      {
+        auto weights = layer.neuron( ix );
+        std::copy( weights.begin(), weights.end(),
+                   m_anchors.begin() +
+                     static_cast< std::ptrdiff_t >( ix * m_dimension ) );
+      }
+
+      for ( auto ix : m_moved )
+      {
+        m_is_moved[ ix ] = false;
+      }
+      m_moved.clear();
+    }
+
+    T const *anchor_of( std::size_t ix ) const
+    {
+      return m_anchors.data() + ix * m_dimension;
+    }
+
+  private:
+    std::vector< nearest_t > m_nearest = std::vector< nearest_t >{};
+    std::vector< T > m_bounds = std::vector< T >{};  // dot of non-partners
+    std::vector< bool > m_is_moved = std::vector< bool >{};
+    std::vector< std::size_t > m_moved = std::vector< std::size_t >{};
+
+    // weights at last refresh, row after row (empty - not known yet)
+    std::vector< T > m_anchors = std::vector< T >{};
+    std::size_t m_dimension = 0u;
+
+    // refresh scratch buffers (alive list is kept for mutual_pairs)
+    std::vector< std::size_t > m_alive = std::vector< std::size_t >{};
+    std::vector< std::size_t > m_stale = std::vector< std::size_t >{};
+    std::vector< T > m_shifts = std::vector< T >{};
+    std::vector< std::size_t > m_hot = std::vector< std::size_t >{};
+    std::size_t m_rescanned_count = 0u;
+  };
+
+  using nearest_pairs_t = basic_nearest_pairs_t< scalar_t >;
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_NEAREST_H_INCLUDED
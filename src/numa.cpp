@@ -0,0 +1,192 @@
+#include "numa.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace isai
+{
+
+  namespace
+  {
+    constexpr auto huge_page_size = std::size_t{ 1 } << 21u;
+
+    std::size_t page_size( bool is_huge )
+    {
+      return is_huge ? huge_page_size
+                     : static_cast< std::size_t >( ::sysconf( _SC_PAGESIZE ) );
+    }
+
+    // parses sysfs cpu list, e.g. "0-3,8-11"
+    std::vector< int > parse_cpu_list( std::string const &text )
+    {
+      auto res = std::vector< int >{};
+      auto pos = std::size_t{ 0 };
+      while ( pos < text.size() )
+      {
+        auto end = text.find( ',', pos );
+        end = end == std::string::npos ? text.size() : end;
+        auto item = text.substr( pos, end - pos );
+        auto first = 0;
+        auto last = 0;
+        auto fields = std::sscanf( item.c_str(), "%d-%d", &first, &last );
+        if ( fields >= 1 )
+        {
+          for ( auto c = first; c <= ( fields == 2 ? last : first ); c++ )
+          {
+            res.emplace_back( c );
+          }
+        }
+        pos = end + 1u;
+      }
+      return res;
+    }
+
+    std::vector< std::vector< int > > read_numa_nodes()
+    {
+      auto allowed = cpu_set_t{};
+      CPU_ZERO( &allowed );
+      if ( ::sched_getaffinity( 0, sizeof( allowed ), &allowed ) != 0 )
+      {
+        for ( auto c = 0; c < CPU_SETSIZE; c++ )
+        {
+          CPU_SET( c, &allowed );
+        }
+      }
+
+      auto res = std::vector< std::vector< int > >{};
+      auto online = std::string{};
+      std::getline( std::ifstream{ "/sys/devices/system/node/online" },
+                    online );
+      for ( auto node : parse_cpu_list( online ) )
+      {
+        auto list = std::string{};
+        std::getline( std::ifstream{ "/sys/devices/system/node/node" +
+                                     std::to_string( node ) + "/cpulist" },
+                      list );
+        auto cpus = parse_cpu_list( list );
+        cpus.erase( std::remove_if( cpus.begin(), cpus.end(),
+                                    [&allowed]( int c ) {
+                                      return c >= CPU_SETSIZE ||
+                                             !CPU_ISSET( c, &allowed );
+                                    } ),
+                    cpus.end() );
+        if ( !cpus.empty() )
+        {
+          res.emplace_back( std::move( cpus ) );
+        }
+      }
+
+      if ( res.empty() )
+      {
+        res.emplace_back();
+        for ( auto c = 0; c < CPU_SETSIZE; c++ )
+        {
+          if ( CPU_ISSET( c, &allowed ) )
+          {
+            res.back().emplace_back( c );
+          }
+        }
+      }
+      return res;
+    }
+  }  // namespace
+
+  std::vector< std::vector< int > > const &numa_nodes()
+  {
+    static auto const nodes = read_numa_nodes();
+    return nodes;
+  }
+
+  int numa_cpu_for( std::size_t ix, std::size_t count )
+  {
+    auto const &nodes = numa_nodes();
+    auto node = ix * nodes.size() / count;
+    // first participant of the same node
+    auto first = ( node * count + nodes.size() - 1u ) / nodes.size();
+    auto const &cpus = nodes[ node ];
+    return cpus.empty() ? -1 : cpus[ ( ix - first ) % cpus.size() ];
+  }
+
+  bool pin_current_thread( int cpu ) noexcept
+  {
+    if ( cpu < 0 || cpu >= CPU_SETSIZE )
+    {
+      return false;
+    }
+    auto set = cpu_set_t{};
+    CPU_ZERO( &set );
+    CPU_SET( cpu, &set );
+    return ::pthread_setaffinity_np( ::pthread_self(), sizeof( set ), &set ) ==
+           0;
+  }
+
+  void *allocate_pages( std::size_t bytes, bool is_huge )
+  {
+    auto page = page_size( is_huge );
+    auto size = ( bytes + page - 1u ) / page * page;
+
+    // huge pages need aligned block - mapping is larger by one huge page,
+    // and the ends outside aligned block are unmapped right away
+    auto mapped = is_huge ? size + huge_page_size : size;
+    auto *addr = ::mmap( nullptr, mapped, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if ( addr == MAP_FAILED )  // NOLINT
+    {
+      throw std::bad_alloc{};
+    }
+    if ( !is_huge )
+    {
+      return addr;
+    }
+
+    auto raw = reinterpret_cast< std::uintptr_t >( addr );
+    auto aligned = ( raw + huge_page_size - 1u ) / huge_page_size *
+                   huge_page_size;
+    if ( aligned > raw )
+    {
+      ::munmap( addr, aligned - raw );
+    }
+    if ( raw + mapped > aligned + size )
+    {
+      ::munmap( reinterpret_cast< void * >( aligned + size ),
+                raw + mapped - aligned - size );
+    }
+    auto *res = reinterpret_cast< void * >( aligned );
+    ::madvise( res, size, MADV_HUGEPAGE );
+    return res;
+  }
+
+  void deallocate_pages( void *ptr, std::size_t bytes, bool is_huge ) noexcept
+  {
+    auto page = page_size( is_huge );
+    ::munmap( ptr, ( bytes + page - 1u ) / page * page );
+  }
+
+  memory_arena_t::memory_arena_t( void *data, std::size_t bytes ) noexcept :
+    m_data( static_cast< char * >( data ) ),
+    m_size( bytes )
+  {
+  }
+
+  void *memory_arena_t::allocate( std::size_t bytes, std::size_t alignment )
+  {
+    auto raw = reinterpret_cast< std::uintptr_t >( m_data ) + m_used;
+    auto begin = ( raw + alignment - 1u ) / alignment * alignment -
+                 reinterpret_cast< std::uintptr_t >( m_data );
+    if ( begin + bytes > m_size )
+    {
+      throw std::bad_alloc{};
+    }
+    m_used = begin + bytes;
+    return m_data + begin;
+  }
+
+}  // namespace isai
@@ -0,0 +1,173 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_NUMA_H_INCLUDED
+#define ISAI_KOHRIS_NUMA_H_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace isai
+{
+
+  // cpus of each numa node the process may run on (read from sysfs once;
+  // without numa support - single node with all allowed cpus)
+  std::vector< std::vector< int > > const &numa_nodes();
+
+  // cpu for participant ix of count - participants are spread over nodes
+  // in contiguous groups (as contiguous shards of thread_pool_t::split),
+  // and over cpus of node within group
+  int numa_cpu_for( std::size_t ix, std::size_t count );
+
+  // binds calling thread to given cpu, returns false if it cannot be done
+  bool pin_current_thread( int cpu ) noexcept;
+
+  // whole pages straight from kernel, not touched until first written (so
+  // each page is placed on numa node of thread writing it first); with
+  // huge flag, block is aligned to huge page and transparent huge pages
+  // are requested for it; throws std::bad_alloc
+  void *allocate_pages( std::size_t bytes, bool is_huge );
+  void deallocate_pages( void *ptr, std::size_t bytes, bool is_huge ) noexcept;
+
+  // carves aligned blocks out of caller's memory region (e.g. shared memory
+  // segment) in allocation order - blocks are never reused, whole region is
+  // released by its owner; throws std::bad_alloc once region is exhausted
+  class memory_arena_t
+  {
+  public:
+    memory_arena_t( void *data, std::size_t bytes ) noexcept;
+
+    void *allocate( std::size_t bytes, std::size_t alignment );
+
+    // constructs object in new block
+    template < typename U, typename... Args >
+    U *create( Args &&... args )
+    {
+      return ::new ( allocate( sizeof( U ), alignof( U ) ) )
+        U( std::forward< Args >( args )... );
+    }
+
+    // value-initialized array
+    template < typename U >
+    U *create_array( std::size_t count )
+    {
+      auto *res = static_cast< U * >(
+        allocate( std::max( count, std::size_t{ 1 } ) * sizeof( U ),
+                  alignof( U ) ) );
+      std::uninitialized_value_construct_n( res, count );
+      return res;
+    }
+
+  private:
+    char *m_data;
+    std::size_t m_size;
+    std::size_t m_used = 0u;
+  };
+
+  // allocator of large weight arrays - blocks of at least page_block_min
+  // bytes are mapped pages (see allocate_pages), smaller ones cache line
+  // aligned heap blocks (with arena given - all blocks come from it);
+  // construct() default-initializes, so growing vector leaves new elements
+  // unwritten (and their pages untouched)
+  template < typename T >
+  class page_allocator_t
+  {
+  public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    static constexpr std::size_t page_block_min = std::size_t{ 1 } << 18u;
+    static constexpr std::size_t small_alignment = 64u;
+
+    explicit page_allocator_t( bool is_huge = false ) noexcept :
+      m_is_huge( is_huge )
+    {
+    }
+
+    explicit page_allocator_t( memory_arena_t &arena ) noexcept :
+      m_is_huge( false ),
+      m_arena( &arena )
+    {
+    }
+
+    template < typename U >
+    explicit page_allocator_t( page_allocator_t< U > const &other ) noexcept :
+      m_is_huge( other.is_huge() ),
+      m_arena( other.arena() )
+    {
+    }
+
+    bool is_huge() const noexcept { return m_is_huge; }
+    memory_arena_t *arena() const noexcept { return m_arena; }
+
+    T *allocate( std::size_t count )
+    {
+      auto bytes = count * sizeof( T );
+      if ( m_arena != nullptr )
+      {
+        return static_cast< T * >(
+          m_arena->allocate( bytes, small_alignment ) );
+      }
+      if ( bytes < page_block_min )
+      {
+        return static_cast< T * >(
+          ::operator new( bytes, std::align_val_t{ small_alignment } ) );
+      }
+      return static_cast< T * >( allocate_pages( bytes, m_is_huge ) );
+    }
+
+    void deallocate( T *ptr, std::size_t count ) noexcept
+    {
+      auto bytes = count * sizeof( T );
+      if ( m_arena != nullptr )
+      {
+        return;
+      }
+      if ( bytes < page_block_min )
+      {
+        ::operator delete( ptr, std::align_val_t{ small_alignment } );
+        return;
+      }
+      deallocate_pages( ptr, bytes, m_is_huge );
+    }
+
+    template < typename U >
+    void construct( U *ptr ) noexcept(
+      std::is_nothrow_default_constructible< U >::value )
+    {
+      ::new ( static_cast< void * >( ptr ) ) U;
+    }
+
+    template < typename U, typename... Args >
+    void construct( U *ptr, Args &&... args )
+    {
+      ::new ( static_cast< void * >( ptr ) )
+        U( std::forward< Args >( args )... );
+    }
+
+    template < typename U >
+    bool operator==( page_allocator_t< U > const &other ) const noexcept
+    {
+      return m_is_huge == other.is_huge() && m_arena == other.arena();
+    }
+
+    template < typename U >
+    bool operator!=( page_allocator_t< U > const &other ) const noexcept
+    {
+      return !( *this == other );
+    }
+
+  private:
+    bool m_is_huge;
+    memory_arena_t *m_arena = nullptr;
+  };
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_NUMA_H_INCLUDED
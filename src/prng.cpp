@@ -2,7 +2,8 @@
 
 namespace isai
 {
-  std::random_device prng_t::s_dev = std::random_device{};  // NOLINT
-  std::default_random_engine prng_t::s_eng =                // NOLINT
-    std::default_random_engine{};                           // NOLINT
+  std::atomic< std::uint64_t > prng_t::s_seed{ 0u };         // NOLINT
+  std::atomic< std::uint64_t > prng_t::s_next_stream{ 0u };  // NOLINT
+  thread_local prng_engine_t prng_t::s_eng =                 // NOLINT
+    prng_t::seeded_engine();
 }  // namespace isai
@@ -5,24 +5,122 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <random>
+#include <sstream>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace isai
 {
 
-  // random number generation utils
+  // xoshiro256** - small and fast generator with period of 2^256 - 1;
+  // independent streams are derived from (seed, stream) pairs, so values
+  // drawn for some part of work depend only on its stream number and never
+  // on which thread happens to draw them
+  class prng_engine_t
+  {
+  public:
+    using result_type = std::uint64_t;
+
+    static constexpr result_type min() noexcept { return 0u; }
+    static constexpr result_type max() noexcept
+    {
+      return std::numeric_limits< result_type >::max();
+    }
+
+    // state is filled from splitmix64 sequence starting at seed, streams
+    // taking disjoint parts of that sequence
+    explicit prng_engine_t( std::uint64_t seed = 0u,
+                            std::uint64_t stream = 0u ) noexcept
+    {
+      auto x = seed + stream * 4u * golden_gamma;
+      for ( auto &&s : m_state )
+      {
+        x += golden_gamma;
+        auto z = x;
+        z = ( z ^ ( z >> 30u ) ) * 0xbf58476d1ce4e5b9ull;
+        z = ( z ^ ( z >> 27u ) ) * 0x94d049bb133111ebull;
+        s = z ^ ( z >> 31u );
+      }
+    }
+
+    result_type operator()() noexcept
+    {
+      auto res = rotl( m_state[ 1 ] * 5u, 7u ) * 9u;
+      auto t = m_state[ 1 ] << 17u;
+      m_state[ 2 ] ^= m_state[ 0 ];
+      m_state[ 3 ] ^= m_state[ 1 ];
+      m_state[ 1 ] ^= m_state[ 2 ];
+      m_state[ 0 ] ^= m_state[ 3 ];
+      m_state[ 2 ] ^= t;
+      m_state[ 3 ] = rotl( m_state[ 3 ], 45u );
+      return res;
+    }
+
+    std::array< std::uint64_t, 4u > const &state() const noexcept
+    {
+      return m_state;
+    }
+    void set_state( std::array< std::uint64_t, 4u > const &state ) noexcept
+    {
+      m_state = state;
+    }
+
+  private:
+    static constexpr std::uint64_t golden_gamma = 0x9e3779b97f4a7c15ull;
+
+    static std::uint64_t rotl( std::uint64_t x, unsigned k ) noexcept
+    {
+      return ( x << k ) | ( x >> ( 64u - k ) );
+    }
+
+  private:
+    std::array< std::uint64_t, 4u > m_state = std::array< std::uint64_t, 4u >{};
+  };
+
+  // random number generation utils - generator of calling thread (each
+  // thread has its own; one not initialized explicitly is seeded on first
+  // use from process-wide seed and next unused stream number, so no two
+  // threads draw the same sequence), plus the same operations on caller's
+  // engines (e.g. one per stream of parallel work);
+  // all results are defined by engine output alone (no standard library
+  // distributions, whose algorithms differ between implementations)
   class prng_t
   {
   private:
     prng_t() noexcept = default;
 
   public:
-    // initializes prng device
-    static void initialize() noexcept
+    // process-wide seed from random device (see below)
+    static void initialize()
     {
-      s_eng = std::default_random_engine{ s_dev() };
+      auto dev = std::random_device{};
+      auto seed = static_cast< std::uint64_t >( dev() ) << 32u;
+      initialize( seed | dev() );
+    }
+
+    // process-wide fixed seed - called once at startup, before other
+    // threads draw (it restarts stream numbering): calling thread gets
+    // stream 0 of seed, threads seeded later on first use get 1, 2, ...
+    static void initialize( std::uint64_t seed ) noexcept
+    {
+      s_eng = prng_engine_t{ seed };
+      s_seed.store( seed, std::memory_order_relaxed );
+      s_next_stream.store( 1u, std::memory_order_relaxed );
+    }
+
+    // generator of calling thread only restarts from given seed (e.g. run
+    // reproducible whichever thread it got) - safe while others draw, as
+    // their streams are left alone
+    static void reseed( std::uint64_t seed ) noexcept
+    {
+      s_eng = prng_engine_t{ seed };
     }
 
     // probability [0,1] to binary success/failure
@@ -30,35 +128,128 @@ namespace isai
     {
       assert( perc >= 0.0 );
       assert( perc <= 1.0 );
-      return perc >= std::generate_canonical< double, 64 >( s_eng );
+      return perc >= canonical( s_eng );
+    }
+
+    // seed for separate generator (e.g. one owned by background thread or
+    // set of streams of parallel work)
+    static std::uint64_t get_seed() noexcept { return s_eng(); }
+
+    // engine state in textual form (e.g. for checkpoints) - restoring it
+    // makes generator continue with the same sequence
+    static std::string get_state()
+    {
+      auto os = std::ostringstream{};
+      for ( auto s : s_eng.state() )
+      {
+        os << s << ' ';
+      }
+      return os.str();
+    }
+
+    static void set_state( std::string const &state )
+    {
+      auto is = std::istringstream{ state };
+      auto s = std::array< std::uint64_t, 4u >{};
+      for ( auto &&v : s )
+      {
+        is >> v;
+      }
+      s_eng.set_state( s );
+    }
+
+    // uniform value from [0, 1)
+    template < typename Engine >
+    static double canonical( Engine &eng ) noexcept
+    {
+      return static_cast< double >( eng() >> 11u ) * 0x1.0p-53;
+    }
+
+    // uniform value from [0, n) - without modulo bias
+    template < typename Engine >
+    static std::uint64_t bounded( Engine &eng, std::uint64_t n ) noexcept
+    {
+      assert( n > 0u );
+      auto threshold = ( 0u - n ) % n;
+      while ( true )
+      {
+        auto r = eng();
+        if ( r >= threshold )
+        {
+          return r % n;
+        }
+      }
     }
 
-    // shuffles elements of given vector
+    // shuffles elements of given vector (fisher-yates)
     template < typename T >
     static void shuffle( std::vector< T > &v )
     {
-      // std::random_shuffle( std::begin( v ), std::end( v ) );
-      std::shuffle( std::begin( v ), std::end( v ), s_eng );
+      shuffle( v, s_eng );
+    }
+
+    template < typename T, typename Engine >
+    static void shuffle( std::vector< T > &v, Engine &eng )
+    {
+      for ( auto i = v.size(); i > 1u; i-- )
+      {
+        auto j = static_cast< std::size_t >( bounded( eng, i ) );
+        using std::swap;
+        swap( v[ i - 1u ], v[ j ] );
+      }
+    }
+
+    // random array to be used as initial weighs of hidden layer (last
+    // coordinate is reserved for projection)
+    template < typename T, std::size_t N >
+    static void init_neuron_weights( std::array< T, N > &weights )
+    {
+      init_neuron_weights( weights, s_eng );
     }
 
-    // random array to be used as initial weighs of hidden layer
-    static auto init_neuron_weights( std::array< double, 5 > &weights )
+    template < typename T, std::size_t N, typename Engine >
+    static void init_neuron_weights( std::array< T, N > &weights,
+                                     Engine &eng )
     {
-      weights[ 0 ] = get_plus_minus_one();
-      weights[ 1 ] = get_plus_minus_one();
-      weights[ 2 ] = get_plus_minus_one();
-      weights[ 3 ] = get_plus_minus_one();
-      weights[ 4 ] = 0.0;
+      for ( auto i = std::size_t{ 0 }; i + 1u < N; i++ )
+      {
+        weights[ i ] = static_cast< T >( canonical( eng ) * 2.0 - 1.0 );
+      }
+      weights[ N - 1u ] = T{ 0 };
+    }
+
+    // random direction (isotropic) - e.g. normal of random hyperplane
+    template < typename T, std::size_t N >
+    static void init_random_direction( std::array< T, N > &dir )
+    {
+      for ( auto &&d : dir )
+      {
+        d = static_cast< T >( normal( s_eng ) );
+      }
+    }
+
+    // standard normal value (box-muller)
+    template < typename Engine >
+    static double normal( Engine &eng ) noexcept
+    {
+      constexpr auto two_pi = 6.283185307179586;
+      auto u = 1.0 - canonical( eng );
+      auto v = canonical( eng );
+      return std::sqrt( -2.0 * std::log( u ) ) * std::cos( two_pi * v );
     }
 
   private:
-    static double get_plus_minus_one()
+    static prng_engine_t seeded_engine() noexcept
     {
-      return std::generate_canonical< double, 64 >( s_eng ) * 2.0 - 1.0;
+      return prng_engine_t{
+        s_seed.load( std::memory_order_relaxed ),
+        s_next_stream.fetch_add( 1u, std::memory_order_relaxed ) };
     }
 
-    static std::random_device s_dev;
-    static std::default_random_engine s_eng;
+  private:
+    static std::atomic< std::uint64_t > s_seed;
+    static std::atomic< std::uint64_t > s_next_stream;
+    static thread_local prng_engine_t s_eng;
   };
 
 }  // namespace isai
@@ -0,0 +1,360 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_QUANTIZED_H_INCLUDED
+#define ISAI_KOHRIS_QUANTIZED_H_INCLUDED
+
+#include "aligned.h"
+#include "simd.h"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace isai
+{
+
+  // fixed point shadow copy of hidden layer weights - coordinates are scaled
+  // so that largest magnitude in layer maps to full range of Q (int8 or
+  // int16); each slot keeps consecutive pairs of coordinates next to each
+  // other, so integer multiply-add sums two products at once, and its bias
+  // -|w|^2 / 2 - the score x * w - |w|^2 / 2 orders neurons as (quantized)
+  // distance from input does, even though they are not of common length
+  template < typename Q, std::size_t N >
+  class basic_quantized_layer_t
+  {
+  public:
+    static_assert( std::is_same< Q, std::int8_t >::value ||
+                     std::is_same< Q, std::int16_t >::value,
+                   "weights are quantized to int8 or int16" );
+
+    static constexpr std::size_t pair_count = ( N + 1u ) / 2u;
+
+    // largest quantized magnitude - 16-bit values keep one bit of headroom,
+    // so scores (at most 1.5 * N * range^2 in magnitude) fit 32 bits
+    static constexpr std::int32_t range =
+      std::is_same< Q, std::int8_t >::value ? 127 : 16383;
+    static_assert( 3u * N * range * range / 2u <
+                     std::numeric_limits< std::int32_t >::max(),
+                   "scores must not overflow" );
+
+    // same padding as hidden layer, so kernels need no tail loops
+    static constexpr std::size_t block_size = 16u;
+
+    // quantized input - each pair of coordinates packed into 16-bit halves
+    // (operand of multiply-add broadcast to all slots)
+    using input_type = std::array< std::int32_t, pair_count >;
+
+    // quantized units per unit of weight - values up to range / scale in
+    // magnitude are represented (larger ones saturate)
+    double scale() const noexcept { return m_scale; }
+    void set_scale( double scale ) noexcept { m_scale = scale; }
+
+    template < typename T >
+    std::int32_t quantize( T value ) const noexcept
+    {
+      auto res = std::lround( static_cast< double >( value ) * m_scale );
+      return static_cast< std::int32_t >(
+        std::min( std::max( res, -long{ range } ), long{ range } ) );
+    }
+
+    template < typename T >
+    input_type quantize_input( basic_features_t< T, N > const &input ) const
+    {
+      auto res = input_type{};
+      for ( auto p = std::size_t{ 0 }; p < pair_count; p++ )
+      {
+        auto lo = static_cast< std::uint16_t >( quantize( input[ 2u * p ] ) );
+        auto hi = static_cast< std::uint16_t >(
+          2u * p + 1u < N ? quantize( input[ 2u * p + 1u ] ) : 0 );
+        res[ p ] = static_cast< std::int32_t >(
+          static_cast< std::uint32_t >( lo ) |
+          static_cast< std::uint32_t >( hi ) << 16u );
+      }
+      return res;
+    }
+
+    // number of neurons and number of slots including (zero) padding
+    std::size_t size() const noexcept { return m_size; }
+    std::size_t padded_size() const noexcept { return m_biases.size(); }
+
+    void resize( std::size_t count )
+    {
+      auto padded = ( count + block_size - 1u ) / block_size * block_size;
+      for ( auto &&col : m_pairs )
+      {
+        col.assign( 2u * padded, Q{ 0 } );
+      }
+      m_biases.assign( padded, 0 );
+      m_size = count;
+    }
+
+    template < typename T >
+    void store( std::size_t pos, basic_features_t< T, N > const &weights )
+    {
+      assert( pos < m_size );
+      auto sqr_norm = std::int32_t{ 0 };
+      static_for< N >( [&]( auto d ) {
+        auto q = quantize( weights[ d ] );
+        m_pairs[ d / 2u ][ 2u * pos + d % 2u ] = static_cast< Q >( q );
+        sqr_norm += q * q;
+      } );
+      m_biases[ pos ] = -sqr_norm / 2;
+    }
+
+    // interleaved coordinates 2p and 2p + 1 of all slots
+    Q const *pairs( std::size_t p ) const { return m_pairs[ p ].data(); }
+    std::int32_t const *biases() const { return m_biases.data(); }
+
+  private:
+    std::array< aligned_vector_t< Q >, pair_count > m_pairs =
+      std::array< aligned_vector_t< Q >, pair_count >{};
+    aligned_vector_t< std::int32_t > m_biases =
+      aligned_vector_t< std::int32_t >{};
+    std::size_t m_size = 0u;
+    double m_scale = static_cast< double >( range );
+  };
+
+  // neurons with highest quantized scores seen so far (unordered)
+  struct quantized_shortlist_t
+  {
+    static constexpr std::size_t max_size = 64u;
+
+    explicit quantized_shortlist_t( std::size_t max_count ) noexcept :
+      capacity( std::min( std::max( max_count, std::size_t{ 1 } ),
+                          max_size ) )
+    {
+    }
+
+    // score candidate has to exceed to get in
+    std::int32_t threshold() const noexcept
+    {
+      return size < capacity ? std::numeric_limits< std::int32_t >::min()
+                             : scores[ weakest ];
+    }
+
+    // once full, candidate replaces the weakest one (on ties, earlier slot
+    // stays)
+    void offer( std::size_t ix, std::int32_t score ) noexcept
+    {
+      if ( size < capacity )
+      {
+        ixs[ size ] = static_cast< std::uint32_t >( ix );
+        scores[ size++ ] = score;
+        if ( size < capacity )
+        {
+          return;
+        }
+      }
+      else if ( score > scores[ weakest ] )
+      {
+        ixs[ weakest ] = static_cast< std::uint32_t >( ix );
+        scores[ weakest ] = score;
+      }
+      else
+      {
+        return;
+      }
+
+      weakest = 0u;
+      for ( auto k = std::size_t{ 1 }; k < size; k++ )
+      {
+        if ( scores[ k ] < scores[ weakest ] )
+        {
+          weakest = k;
+        }
+      }
+    }
+
+    std::size_t capacity;
+    std::size_t size = 0u;
+    std::size_t weakest = 0u;
+    std::array< std::uint32_t, max_size > ixs = {};
+    std::array< std::int32_t, max_size > scores = {};
+  };
+
+  // fills shortlist from all neurons of quantized layer
+  template < typename Q, std::size_t N >
+  using basic_shortlist_kernel_t =
+    void ( * )( basic_quantized_layer_t< Q, N > const &layer,
+                typename basic_quantized_layer_t< Q, N >::input_type const
+                  &input,
+                quantized_shortlist_t &shortlist );
+
+  template < typename Q, std::size_t N >
+  void find_shortlist_scalar(
+    basic_quantized_layer_t< Q, N > const &layer,
+    typename basic_quantized_layer_t< Q, N >::input_type const &input,
+    quantized_shortlist_t &shortlist )
+  {
+    using layer_type = basic_quantized_layer_t< Q, N >;
+
+    for ( auto i = std::size_t{ 0 }; i < layer.size(); i++ )
+    {
+      auto score = layer.biases()[ i ];
+      for ( auto p = std::size_t{ 0 }; p < layer_type::pair_count; p++ )
+      {
+        auto lo = static_cast< std::int16_t >( input[ p ] & 0xffff );
+        auto hi = static_cast< std::int16_t >(
+          static_cast< std::uint32_t >( input[ p ] ) >> 16u );
+        score += layer.pairs( p )[ 2u * i ] * lo +
+               layer.pairs( p )[ 2u * i + 1u ] * hi;
+      }
+      if ( score > shortlist.threshold() )
+      {
+        shortlist.offer( i, score );
+      }
+    }
+  }
+
+  namespace detail
+  {
+
+    // 8 slots worth of interleaved pairs widened to 16-bit lanes
+    ISAI_TARGET_AVX2 inline __m256i load_pairs_avx2( std::int16_t const *p )
+    {
+      return _mm256_load_si256( reinterpret_cast< __m256i const * >( p ) );
+    }
+    ISAI_TARGET_AVX2 inline __m256i load_pairs_avx2( std::int8_t const *p )
+    {
+      return _mm256_cvtepi8_epi16(
+        _mm_load_si128( reinterpret_cast< __m128i const * >( p ) ) );
+    }
+
+    // 16 slots of the same
+    ISAI_TARGET_AVX512BW inline __m512i
+    load_pairs_avx512( std::int16_t const *p )
+    {
+      return _mm512_load_si512( p );
+    }
+    ISAI_TARGET_AVX512BW inline __m512i
+    load_pairs_avx512( std::int8_t const *p )
+    {
+      return _mm512_cvtepi8_epi16(
+        _mm256_load_si256( reinterpret_cast< __m256i const * >( p ) ) );
+    }
+
+    // lanes above threshold are offered one by one (padding lanes are
+    // skipped) - rare once shortlist fills up
+    template < std::size_t Width >
+    inline void offer_lanes( std::size_t begin, std::size_t size,
+                             std::uint32_t mask, std::int32_t const *scores,
+                             quantized_shortlist_t &shortlist )
+    {
+      for ( auto l = std::size_t{ 0 }; l < Width; l++ )
+      {
+        if ( ( mask >> l & 1u ) != 0u && begin + l < size )
+        {
+          shortlist.offer( begin + l, scores[ l ] );
+        }
+      }
+    }
+
+  }  // namespace detail
+
+  template < typename Q, std::size_t N >
+  ISAI_TARGET_AVX2 void find_shortlist_avx2(
+    basic_quantized_layer_t< Q, N > const &layer,
+    typename basic_quantized_layer_t< Q, N >::input_type const &input,
+    quantized_shortlist_t &shortlist )
+  {
+    using layer_type = basic_quantized_layer_t< Q, N >;
+    constexpr auto width = std::size_t{ 8 };
+
+    __m256i in[ layer_type::pair_count ];
+    Q const *cols[ layer_type::pair_count ];
+    for ( auto p = std::size_t{ 0 }; p < layer_type::pair_count; p++ )
+    {
+      in[ p ] = _mm256_set1_epi32( input[ p ] );
+      cols[ p ] = layer.pairs( p );
+    }
+
+    auto threshold = _mm256_set1_epi32( shortlist.threshold() );
+    for ( auto i = std::size_t{ 0 }; i < layer.padded_size(); i += width )
+    {
+      auto score = _mm256_load_si256(
+        reinterpret_cast< __m256i const * >( layer.biases() + i ) );
+      for ( auto p = std::size_t{ 0 }; p < layer_type::pair_count; p++ )
+      {
+        score = _mm256_add_epi32(
+          score, _mm256_madd_epi16(
+                 detail::load_pairs_avx2( cols[ p ] + 2u * i ), in[ p ] ) );
+      }
+      auto mask = static_cast< std::uint32_t >( _mm256_movemask_ps(
+        _mm256_castsi256_ps( _mm256_cmpgt_epi32( score, threshold ) ) ) );
+      if ( mask != 0u )
+      {
+        alignas( 32 ) std::int32_t scores[ width ];
+        _mm256_store_si256( reinterpret_cast< __m256i * >( scores ), score );
+        detail::offer_lanes< width >( i, layer.size(), mask, scores,
+                                      shortlist );
+        threshold = _mm256_set1_epi32( shortlist.threshold() );
+      }
+    }
+  }
+
+  template < typename Q, std::size_t N >
+  ISAI_TARGET_AVX512BW void find_shortlist_avx512(
+    basic_quantized_layer_t< Q, N > const &layer,
+    typename basic_quantized_layer_t< Q, N >::input_type const &input,
+    quantized_shortlist_t &shortlist )
+  {
+    using layer_type = basic_quantized_layer_t< Q, N >;
+    constexpr auto width = std::size_t{ 16 };
+
+    __m512i in[ layer_type::pair_count ];
+    Q const *cols[ layer_type::pair_count ];
+    for ( auto p = std::size_t{ 0 }; p < layer_type::pair_count; p++ )
+    {
+      in[ p ] = _mm512_set1_epi32( input[ p ] );
+      cols[ p ] = layer.pairs( p );
+    }
+
+    auto threshold = _mm512_set1_epi32( shortlist.threshold() );
+    for ( auto i = std::size_t{ 0 }; i < layer.padded_size(); i += width )
+    {
+      auto score = _mm512_load_si512( layer.biases() + i );
+      for ( auto p = std::size_t{ 0 }; p < layer_type::pair_count; p++ )
+      {
+        score = _mm512_add_epi32(
+          score, _mm512_madd_epi16(
+                 detail::load_pairs_avx512( cols[ p ] + 2u * i ), in[ p ] ) );
+      }
+      auto mask = static_cast< std::uint32_t >(
+        _mm512_cmpgt_epi32_mask( score, threshold ) );
+      if ( mask != 0u )
+      {
+        alignas( 64 ) std::int32_t scores[ width ];
+        _mm512_store_si512( scores, score );
+        detail::offer_lanes< width >( i, layer.size(), mask, scores,
+                                      shortlist );
+        threshold = _mm512_set1_epi32( shortlist.threshold() );
+      }
+    }
+  }
+
+  // shortlist kernel for given instruction set (16-bit multiply-add needs
+  // avx-512 bw on top of avx-512 f, avx2 is used without it)
+  template < typename Q, std::size_t N >
+  basic_shortlist_kernel_t< Q, N >
+  get_shortlist_kernel( simd_level_t level ) noexcept
+  {
+    switch ( resolve_simd_level( level ) )
+    {
+      case simd_level_t::avx512:
+        if ( supports_avx512bw() )
+        {
+          return &find_shortlist_avx512< Q, N >;
+        }
+        return &find_shortlist_avx2< Q, N >;
+      case simd_level_t::avx2:
+        return &find_shortlist_avx2< Q, N >;
+      default:
+        return &find_shortlist_scalar< Q, N >;
+    }
+  }
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_QUANTIZED_H_INCLUDED
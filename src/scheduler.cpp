@@ -0,0 +1,107 @@
+#include "scheduler.h"
+
+#include "aligned.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace isai
+{
+
+  namespace
+  {
+    struct task_queue_t
+    {
+      std::mutex mutex;
+      std::deque< std::size_t > tasks;
+    };
+  }  // namespace
+
+  work_stealing_scheduler_t::work_stealing_scheduler_t(
+    std::size_t thread_count ) :
+    m_thread_count( thread_count )
+  {
+    if ( m_thread_count == 0u )
+    {
+      m_thread_count = std::max( 1u, std::thread::hardware_concurrency() );
+    }
+  }
+
+  void work_stealing_scheduler_t::run( std::size_t task_count,
+                                       task_t const &task )
+  {
+    auto worker_count = std::max( std::min( m_thread_count, task_count ),
+                                  std::size_t{ 1 } );
+    auto queues = std::vector< cache_padded_t< task_queue_t > >( worker_count );
+    for ( auto t = std::size_t{ 0 }; t < task_count; t++ )
+    {
+      queues[ t % worker_count ].value.tasks.push_back( t );
+    }
+
+    auto is_failed = std::atomic< bool >{ false };
+    auto error = std::exception_ptr{};
+    auto error_mutex = std::mutex{};
+
+    // own queue first, then steal from others - always earliest task, so
+    // they start in about index order; no tasks are added during run, so
+    // all queues empty means done
+    auto next = [&]( std::size_t worker, std::size_t &task_ix ) {
+      for ( auto k = std::size_t{ 0 }; k < worker_count; k++ )
+      {
+        auto &queue = queues[ ( worker + k ) % worker_count ].value;
+        auto lock = std::unique_lock< std::mutex >{ queue.mutex };
+        if ( queue.tasks.empty() )
+        {
+          continue;
+        }
+        task_ix = queue.tasks.front();
+        queue.tasks.pop_front();
+        return true;
+      }
+      return false;
+    };
+
+    auto work = [&]( std::size_t worker ) {
+      auto task_ix = std::size_t{ 0 };
+      while ( !is_failed.load( std::memory_order_relaxed ) &&
+              next( worker, task_ix ) )
+      {
+        try
+        {
+          task( task_ix, worker );
+        }
+        catch ( ... )
+        {
+          auto lock = std::unique_lock< std::mutex >{ error_mutex };
+          if ( !error )
+          {
+            error = std::current_exception();
+          }
+          is_failed = true;
+        }
+      }
+    };
+
+    auto threads = std::vector< std::thread >{};
+    for ( auto w = std::size_t{ 1 }; w < worker_count; w++ )
+    {
+      threads.emplace_back( work, w );
+    }
+    work( 0u );
+    for ( auto &&t : threads )
+    {
+      t.join();
+    }
+
+    if ( error )
+    {
+      std::rethrow_exception( error );
+    }
+  }
+
+}  // namespace isai
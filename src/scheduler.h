@@ -0,0 +1,39 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_SCHEDULER_H_INCLUDED
+#define ISAI_KOHRIS_SCHEDULER_H_INCLUDED
+
+#include <cstddef>
+#include <functional>
+
+namespace isai
+{
+
+  // runs batch of independent tasks of uneven length - every worker owns
+  // queue of tasks (dealt round robin) and takes them from its front; once
+  // it runs dry, it steals from the front of other queues, so long tasks
+  // do not leave threads idle; tasks start in about index order (callers
+  // put longest ones first)
+  class work_stealing_scheduler_t
+  {
+  public:
+    using task_t =
+      std::function< void( std::size_t task, std::size_t worker ) >;
+
+    // thread count of zero means one worker per hardware thread
+    explicit work_stealing_scheduler_t( std::size_t thread_count );
+
+    std::size_t size() const noexcept { return m_thread_count; }
+
+    // calls task( ix, worker ) for every ix in [0, task_count) and returns
+    // when all are done (calling thread is worker #0); first exception
+    // thrown by any task is rethrown (tasks not started yet are skipped)
+    void run( std::size_t task_count, task_t const &task );
+
+  private:
+    std::size_t m_thread_count;
+  };
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_SCHEDULER_H_INCLUDED
@@ -0,0 +1 @@
+#include "sharded.h"
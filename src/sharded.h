@@ -0,0 +1,1064 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_SHARDED_H_INCLUDED
+#define ISAI_KOHRIS_SHARDED_H_INCLUDED
+
+#include "kohnet.h"
+#include "shm.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <sys/prctl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace isai
+{
+
+  // kohonen network whose hidden layer is split over worker processes -
+  // each one owns contiguous range of neurons (weights, win counts and ids)
+  // placed in its own posix shared memory segment, while calling process
+  // only coordinates: it broadcasts inputs, reduces local winner candidates
+  // in shard order (keeps serial tie-breaking) and lets owner of winner
+  // move it; kill and coalesce are collective steps, after which every
+  // worker compacts its shard; seeded online or batch run gives the same
+  // results as basic_kohonen_network_t (hogwild is run as online, winner
+  // search is always exact, checkpoints are not supported);
+  // workers are forked by constructor (which throws std::system_error when
+  // it cannot create them) and stopped by destructor; death of any worker
+  // is noticed while coordinator waits for it in collective step - all
+  // workers are then killed and step throws std::runtime_error (network
+  // cannot be used any more); workers exit once coordinator dies (they are
+  // sent SIGKILL when thread which forked them ends, and check their
+  // parent while they wait, as that signal may be missed)
+  template < typename T, std::size_t N >
+  class basic_sharded_network_t
+  {
+  public:
+    using neuron_type = basic_kohonen_neuron_t< T, N >;
+    using features_type = basic_features_t< T, N >;
+    using layer_type = basic_hidden_layer_t< T, N >;
+    using winner_type = basic_winner_t< T >;
+
+    // at most settings.training_set_size inputs are passed to run()
+    basic_sharded_network_t( knc_settings_t const &settings,
+                             std::size_t process_count ) :
+      m_settings( settings ),
+      m_process_count( std::max( process_count, std::size_t{ 1 } ) ),
+      m_capacity( settings.training_set_size ),
+      m_winner_kernel( get_winner_kernel< T, N >( settings.simd_level ) ),
+      m_block_winner_kernel(
+        get_block_winner_kernel< T, N >( settings.simd_level ) ),
+      m_seed( prng_t::get_seed() ),
+      m_alive_count( settings.hidden_layer_size )
+    {
+      create_control();
+      for ( auto k = std::size_t{ 0 }; k < m_process_count; k++ )
+      {
+        m_shard_memory.emplace_back(
+          std::make_unique< shared_memory_t >( shard_bytes( k ) ) );
+      }
+
+      for ( auto k = std::size_t{ 0 }; k < m_process_count; k++ )
+      {
+        auto pid = ::fork();
+        if ( pid == 0 )
+        {
+          serve( k );
+        }
+        if ( pid < 0 )
+        {
+          auto err = errno;
+          abandon_workers();
+          throw std::system_error{ err, std::generic_category(),
+                                   "cannot fork shard worker" };
+        }
+        m_workers.emplace_back( pid );
+      }
+
+      try
+      {
+        step( command_t::init );
+      }
+      catch ( ... )
+      {
+        stop_workers();
+        throw;
+      }
+      update_offsets();
+    }
+
+    basic_sharded_network_t( basic_sharded_network_t const & ) = delete;
+    basic_sharded_network_t( basic_sharded_network_t && ) = delete;
+    basic_sharded_network_t &
+    operator=( basic_sharded_network_t const & ) = delete;
+    basic_sharded_network_t &operator=( basic_sharded_network_t && ) = delete;
+
+    ~basic_sharded_network_t() { stop_workers(); }
+
+    template < typename Iterator >
+    void run( Iterator begin, Iterator end )
+    {
+      auto count = static_cast< std::size_t >( std::distance( begin, end ) );
+      if ( count > m_capacity )
+      {
+        throw std::runtime_error{
+          "sharded network: more inputs than training set size" };
+      }
+      auto k = std::size_t{ 0 };
+      for ( auto i = begin; i != end; i++ )
+      {
+        m_control->inputs[ k++ ] = ( *i ).features;
+      }
+
+      while ( !should_stop() )
+      {
+        prepare();
+        process( count );
+        track_convergence();
+        kill();
+        coalesce();
+        print_status();
+      }
+      print_status( true );
+    }
+
+    // runs stop (at the end of iteration) once deadline passes
+    void set_deadline( std::chrono::steady_clock::time_point deadline )
+    {
+      m_deadline = deadline;
+    }
+
+    stop_reason_t stop_reason() const noexcept { return m_stop_reason; }
+    std::size_t iteration_count() const noexcept { return m_iteration_no; }
+    std::size_t alive_count() const noexcept { return m_alive_count; }
+    std::size_t process_count() const noexcept { return m_process_count; }
+
+    double total_displacement() const noexcept { return m_total_displacement; }
+    double max_displacement() const noexcept { return m_max_displacement; }
+
+    // surviving neurons, ordered by their stable ids (read straight from
+    // shards, which stay untouched between collective steps)
+    auto get_results() const
+    {
+      auto res = std::vector< neuron_type >{};
+      for ( auto k = std::size_t{ 0 }; k < m_process_count; k++ )
+      {
+        auto const &shard = m_control->shards[ k ].value;
+        for ( auto i = std::size_t{ 0 }; i < shard.size; i++ )
+        {
+          res.emplace_back( gather( shard, i ) );
+        }
+      }
+
+      assert( res.size() == m_alive_count );
+
+      return res;
+    }
+
+    // stable ids (initial positions in hidden layer) of surviving neurons,
+    // in the same order as get_results()
+    auto get_result_ids() const
+    {
+      auto res = std::vector< std::size_t >{};
+      for ( auto k = std::size_t{ 0 }; k < m_process_count; k++ )
+      {
+        auto const &shard = m_control->shards[ k ].value;
+        res.insert( res.end(), shard.ids, shard.ids + shard.size );
+      }
+      return res;
+    }
+
+  private:
+    using nearest_type = typename basic_nearest_pairs_t< T >::nearest_t;
+
+    static constexpr std::size_t npos =
+      std::numeric_limits< std::size_t >::max();
+
+    // same blocks as basic_kohonen_network_t::init_neurons - shard
+    // boundaries fall on them, so each worker draws its blocks alone
+    static constexpr std::size_t init_block_size = 4096u;
+
+    // how often waiting coordinator checks that workers are alive (and
+    // waiting workers that coordinator is)
+    static constexpr auto worker_poll_interval = std::chrono::milliseconds{
+      100
+    };
+
+    enum class command_t
+    {
+      init,        // draw initial weights of shard
+      prepare,     // clear win counts (and snapshot weights)
+      find,        // move previous winner, find local winner of input
+      find_batch,  // find local winners of all inputs
+      adjust,      // move winners towards means of their inputs
+      measure,     // count winners, measure displacement
+      kill,        // kill first kill_quota neurons without win
+      nearest,     // find nearest partner of each neuron (in all shards)
+      merge,       // coalesce pairs
+      compact,     // remove dead neurons
+      stop
+    };
+
+    // shard as published by its owner (and its per-step arguments)
+    struct shard_state_t
+    {
+      std::array< T const *, N > columns;
+      int const *statuses;
+      std::size_t const *ids;
+      std::size_t size;
+
+      std::size_t offset;      // global index of first neuron
+      std::size_t kill_quota;  // kill argument
+
+      winner_type winner;  // find result (global index)
+      std::size_t zero_count;
+      std::size_t winner_count;
+      double total_displacement;
+      double max_displacement;
+
+      char error[ 128 ];  // what() of exception thrown by last step
+    };
+
+    // mean of inputs won by neuron in batch
+    struct adjustment_t
+    {
+      std::size_t index;
+      features_type mean;
+      int count;
+    };
+
+    // everything shared by coordinator and workers except weights
+    struct control_t
+    {
+      explicit control_t( unsigned process_count ) : barrier( process_count )
+      {
+      }
+
+      process_barrier_t barrier;
+      command_t command = command_t::init;
+
+      // find arguments - input to search for and winner of previous one
+      std::size_t input = npos;
+      std::size_t moved = npos;
+      std::size_t moved_input = npos;
+
+      std::size_t count = 0u;  // inputs, adjustments or merges
+      features_type *inputs = nullptr;
+      winner_type *winners = nullptr;  // find_batch - inputs of each shard
+      adjustment_t *adjustments = nullptr;
+      std::pair< std::size_t, std::size_t > *merges = nullptr;
+      nearest_type *nearest = nullptr;
+      cache_padded_t< shard_state_t > *shards = nullptr;
+    };
+
+    // private state of worker process (weights, win counts and ids live in
+    // arena over its shared memory segment)
+    struct shard_t
+    {
+      shard_t( void *data, std::size_t bytes ) :
+        arena( data, bytes ),
+        layer( 0u, page_allocator_t< T >{ arena } ),
+        statuses( page_allocator_t< int >{ arena } ),
+        ids( page_allocator_t< std::size_t >{ arena } )
+      {
+      }
+
+      memory_arena_t arena;
+      layer_type layer;
+      std::vector< int, page_allocator_t< int > > statuses;
+      std::vector< std::size_t, page_allocator_t< std::size_t > > ids;
+      basic_epoch_start_t< T, N > epoch_start = basic_epoch_start_t< T, N >{};
+    };
+
+    static std::size_t block_bytes( std::size_t bytes, std::size_t count )
+    {
+      return std::max( count, std::size_t{ 1 } ) * bytes + cache_line_size;
+    }
+
+    void create_control()
+    {
+      auto count = m_settings.hidden_layer_size;
+      auto bytes =
+        block_bytes( sizeof( control_t ), 1u ) +
+        block_bytes( sizeof( features_type ), m_capacity ) +
+        block_bytes( sizeof( winner_type ), m_capacity * m_process_count ) +
+        block_bytes( sizeof( adjustment_t ), m_capacity ) +
+        block_bytes( sizeof( std::pair< std::size_t, std::size_t > ),
+                     count / 2u ) +
+        block_bytes( sizeof( nearest_type ), count ) +
+        block_bytes( sizeof( cache_padded_t< shard_state_t > ),
+                     m_process_count );
+      m_control_memory = std::make_unique< shared_memory_t >( bytes );
+
+      auto arena =
+        memory_arena_t{ m_control_memory->data(), m_control_memory->size() };
+      m_control = arena.create< control_t >(
+        static_cast< unsigned >( m_process_count + 1u ) );
+      m_control->inputs = arena.create_array< features_type >( m_capacity );
+      m_control->winners =
+        arena.create_array< winner_type >( m_capacity * m_process_count );
+      m_control->adjustments = arena.create_array< adjustment_t >( m_capacity );
+      m_control->merges =
+        arena.create_array< std::pair< std::size_t, std::size_t > >(
+          count / 2u );
+      m_control->nearest = arena.create_array< nearest_type >( count );
+      m_control->shards =
+        arena.create_array< cache_padded_t< shard_state_t > >(
+          m_process_count );
+    }
+
+    std::pair< std::size_t, std::size_t > shard_range( std::size_t k ) const
+    {
+      return thread_pool_t::split( m_settings.hidden_layer_size,
+                                   m_process_count, k, init_block_size );
+    }
+
+    std::size_t shard_bytes( std::size_t k ) const
+    {
+      auto range = shard_range( k );
+      auto count = range.second - range.first;
+      auto padded = ( count + layer_type::block_size - 1u ) /
+                    layer_type::block_size * layer_type::block_size;
+      return N * block_bytes( sizeof( T ), padded ) +
+             block_bytes( sizeof( int ), count ) +
+             block_bytes( sizeof( std::size_t ), count );
+    }
+
+    void stop_workers() noexcept
+    {
+      if ( m_is_abandoned )
+      {
+        return;
+      }
+      m_control->command = command_t::stop;
+      while ( !m_control->barrier.wait_for( worker_poll_interval ) )
+      {
+        if ( find_dead_worker().first != npos )
+        {
+          abandon_workers();
+          return;
+        }
+      }
+      for ( auto pid : m_workers )
+      {
+        ::waitpid( pid, nullptr, 0 );
+      }
+      m_control->~control_t();
+    }
+
+    // fork failed or worker died - the others cannot complete barrier
+    void abandon_workers() noexcept
+    {
+      for ( auto pid : m_workers )
+      {
+        if ( pid > 0 )
+        {
+          ::kill( pid, SIGKILL );
+          ::waitpid( pid, nullptr, 0 );
+        }
+      }
+      m_control->~control_t();
+      m_is_abandoned = true;
+    }
+
+    // first worker which has already exited and its wait status (npos - all
+    // are running); it is reaped, so its pid is forgotten
+    std::pair< std::size_t, int > find_dead_worker() noexcept
+    {
+      for ( auto k = std::size_t{ 0 }; k < m_workers.size(); k++ )
+      {
+        auto status = 0;
+        if ( ::waitpid( m_workers[ k ], &status, WNOHANG ) == m_workers[ k ] )
+        {
+          m_workers[ k ] = 0;
+          return { k, status };
+        }
+      }
+      return { npos, 0 };
+    }
+
+    // barrier wait of coordinator - checks that all workers are still alive
+    // whenever poll interval passes (dead one would never arrive)
+    void wait_for_workers()
+    {
+      while ( !m_control->barrier.wait_for( worker_poll_interval ) )
+      {
+        auto dead = find_dead_worker();
+        if ( dead.first == npos )
+        {
+          continue;
+        }
+        abandon_workers();
+        auto how = WIFSIGNALED( dead.second )
+                     ? "killed by signal " +
+                         std::to_string( WTERMSIG( dead.second ) )
+                     : "exited with status " +
+                         std::to_string( WEXITSTATUS( dead.second ) );
+        throw std::runtime_error{ "sharded network: worker " +
+                                  std::to_string( dead.first ) + " " + how };
+      }
+    }
+
+    // runs one collective step - workers execute command set in control
+    // block between the two barriers; first error of any of them is thrown
+    void step( command_t command )
+    {
+      if ( m_is_abandoned )
+      {
+        throw std::runtime_error{
+          "sharded network: workers were stopped after failure" };
+      }
+      m_control->command = command;
+      wait_for_workers();
+      wait_for_workers();
+
+      for ( auto k = std::size_t{ 0 }; k < m_process_count; k++ )
+      {
+        auto &shard = m_control->shards[ k ].value;
+        if ( shard.error[ 0 ] != '\0' )
+        {
+          auto what = "shard " + std::to_string( k ) + ": " + shard.error;
+          shard.error[ 0 ] = '\0';
+          throw std::runtime_error{ what };
+        }
+      }
+    }
+
+    // global index of first neuron of each shard
+    void update_offsets()
+    {
+      auto offset = std::size_t{ 0 };
+      for ( auto k = std::size_t{ 0 }; k < m_process_count; k++ )
+      {
+        auto &shard = m_control->shards[ k ].value;
+        shard.offset = offset;
+        offset += shard.size;
+      }
+      assert( offset == m_alive_count );
+    }
+
+    void prepare()
+    {
+      m_kill_count = 0u;
+      m_coalesce_count = 0u;
+      m_iteration_no++;
+      ISAI_TRACE_SCOPE( trace_phase_t::prepare, m_iteration_no );
+      step( command_t::prepare );
+    }
+
+    void process( std::size_t count )
+    {
+      ISAI_TRACE_SCOPE( trace_phase_t::process, m_iteration_no );
+      ISAI_TRACE_COUNT( trace_counter_t::inputs,
+                        static_cast< std::uint64_t >( count ) );
+      if ( m_settings.training_mode == training_mode_t::batch )
+      {
+        process_batch( count );
+        return;
+      }
+
+      // winner of each input is moved by its owner together with search
+      // for winner of next input (other shards are not affected by it)
+      m_control->moved = npos;
+      for ( auto k = std::size_t{ 0 }; k <= count; k++ )
+      {
+        m_control->input = k < count ? k : npos;
+        step( command_t::find );
+
+        auto best = no_winner< T >;
+        for ( auto s = std::size_t{ 0 }; s < m_process_count; s++ )
+        {
+          best = better_of( best, m_control->shards[ s ].value.winner );
+        }
+        m_control->moved = best.index;
+        m_control->moved_input = k;
+      }
+    }
+
+    // winners of all inputs are found by all shards at once, then owners
+    // move them towards means accumulated in input order (as in
+    // basic_kohonen_network_t::process_batch)
+    void process_batch( std::size_t count )
+    {
+      m_control->count = count;
+      step( command_t::find_batch );
+
+      if ( m_batch_sums.size() < m_settings.hidden_layer_size )
+      {
+        m_batch_sums.resize( m_settings.hidden_layer_size );
+        m_batch_counts.resize( m_settings.hidden_layer_size );
+      }
+      m_batch_touched.clear();
+      for ( auto k = std::size_t{ 0 }; k < count; k++ )
+      {
+        auto best = no_winner< T >;
+        for ( auto s = std::size_t{ 0 }; s < m_process_count; s++ )
+        {
+          best = better_of( best, m_control->winners[ s * m_capacity + k ] );
+        }
+        auto w = best.index;
+        auto &sum = m_batch_sums[ w ];
+        if ( m_batch_counts[ w ]++ == 0u )
+        {
+          sum = features_type{};
+          m_batch_touched.emplace_back( w );
+        }
+        static_for< N >(
+          [&]( auto d ) { sum[ d ] += m_control->inputs[ k ][ d ]; } );
+      }
+
+      auto a = std::size_t{ 0 };
+      for ( auto w : m_batch_touched )
+      {
+        auto &adj = m_control->adjustments[ a++ ];
+        adj.index = w;
+        adj.mean = m_batch_sums[ w ];
+        for ( auto &&m : adj.mean )
+        {
+          m /= static_cast< T >( m_batch_counts[ w ] );
+        }
+        adj.count = static_cast< int >( m_batch_counts[ w ] );
+        m_batch_counts[ w ] = 0u;
+      }
+      m_control->count = a;
+      step( command_t::adjust );
+    }
+
+    void track_convergence()
+    {
+      step( command_t::measure );
+
+      auto winners = 0.0;
+      m_total_displacement = 0.0;
+      m_max_displacement = 0.0;
+      for ( auto k = std::size_t{ 0 }; k < m_process_count; k++ )
+      {
+        auto const &shard = m_control->shards[ k ].value;
+        winners += static_cast< double >( shard.winner_count );
+        m_total_displacement += shard.total_displacement;
+        m_max_displacement =
+          std::max( m_max_displacement, shard.max_displacement );
+      }
+      if ( m_settings.displacement_threshold <= 0.0 )
+      {
+        m_max_displacement = std::numeric_limits< double >::infinity();
+      }
+
+      if ( m_settings.plateau_epochs != 0u )
+      {
+        if ( m_plateau_length != 0u &&
+             std::abs( winners - m_plateau_base ) <=
+               m_settings.plateau_tolerance * m_plateau_base )
+        {
+          m_plateau_length++;
+        }
+        else
+        {
+          m_plateau_base = winners;
+          m_plateau_length = 1u;
+        }
+      }
+    }
+
+    // quotas keep serial order - neurons without win are killed from the
+    // lowest index until expected cluster count is reached
+    void kill()
+    {
+      ISAI_TRACE_SCOPE( trace_phase_t::kill, m_iteration_no );
+      auto budget = m_alive_count - m_settings.expected_cluster_count;
+      for ( auto k = std::size_t{ 0 }; k < m_process_count; k++ )
+      {
+        auto &shard = m_control->shards[ k ].value;
+        shard.kill_quota = std::min( shard.zero_count, budget );
+        budget -= shard.kill_quota;
+        m_kill_count += shard.kill_quota;
+      }
+      m_alive_count -= m_kill_count;
+      step( command_t::kill );
+      compact();
+    }
+
+    // nearest partners are recomputed from scratch by owners of neurons
+    // (no cache of moved ones as in basic_kohonen_network_t - it would
+    // live in coordinator, which never sees weights change)
+    void coalesce()
+    {
+      if ( is_completed() ||
+           m_iteration_no % m_settings.coalesce_interval != 0 )
+      {
+        return;
+      }
+      ISAI_TRACE_SCOPE( trace_phase_t::coalesce, m_iteration_no );
+
+      step( command_t::nearest );
+      m_nearest.assign( std::vector< nearest_type >(
+        m_control->nearest, m_control->nearest + m_alive_count ) );
+
+      auto limit =
+        std::min( std::max( m_settings.coalesce_pair_limit, std::size_t{ 1 } ),
+                  m_alive_count - m_settings.expected_cluster_count );
+      auto pairs = m_nearest.mutual_pairs( limit );
+      std::copy( pairs.begin(), pairs.end(), m_control->merges );
+      m_control->count = pairs.size();
+      m_coalesce_count += pairs.size();
+      m_alive_count -= pairs.size();
+      step( command_t::merge );
+      compact();
+    }
+
+    void compact()
+    {
+      step( command_t::compact );
+      update_offsets();
+    }
+
+    // as basic_kohonen_network_t::print_status
+    void print_status( bool is_final = false )
+    {
+      if ( !m_settings.is_verbose || ( is_final && !m_is_status_pending ) )
+      {
+        return;
+      }
+      auto now = std::chrono::steady_clock::now();
+      if ( !is_final && m_settings.status_interval_ms != 0u &&
+           m_alive_count != m_settings.expected_cluster_count &&
+           now - m_last_status <
+             std::chrono::milliseconds( m_settings.status_interval_ms ) )
+      {
+        m_is_status_pending = true;
+        return;
+      }
+      m_last_status = now;
+      m_is_status_pending = false;
+      auto perc = ( static_cast< double >( m_alive_count ) /
+                    static_cast< double >( m_settings.hidden_layer_size ) ) *
+                  100.0;
+      std::printf( "ITERATION #%03lu - live neurons remaining: %lu/%lu "
+                   "(%.2f%%) [killed: %lu, coalesced: %lu]\n",
+                   m_iteration_no, m_alive_count,
+                   m_settings.hidden_layer_size, perc, m_kill_count,
+                   m_coalesce_count );
+    }
+
+    bool should_stop()
+    {
+      if ( is_completed() )
+      {
+        m_stop_reason = stop_reason_t::completed;
+        return true;
+      }
+      if ( m_settings.displacement_threshold > 0.0 &&
+           m_max_displacement < m_settings.displacement_threshold )
+      {
+        m_stop_reason = stop_reason_t::converged;
+        return true;
+      }
+      if ( m_settings.plateau_epochs != 0u &&
+           m_plateau_length >= m_settings.plateau_epochs )
+      {
+        m_stop_reason = stop_reason_t::plateau;
+        return true;
+      }
+      if ( m_deadline != std::chrono::steady_clock::time_point::max() &&
+           std::chrono::steady_clock::now() >= m_deadline )
+      {
+        m_stop_reason = stop_reason_t::deadline;
+        return true;
+      }
+      return false;
+    }
+
+    bool is_completed() const
+    {
+      assert( m_alive_count >= m_settings.expected_cluster_count );
+      return m_alive_count == m_settings.expected_cluster_count;
+    }
+
+    static features_type gather( shard_state_t const &shard, std::size_t i )
+    {
+      auto res = features_type{};
+      static_for< N >( [&]( auto d ) { res[ d ] = shard.columns[ d ][ i ]; } );
+      return res;
+    }
+
+    // worker process main loop - never returns
+    [[noreturn]] void serve( std::size_t k ) noexcept
+    {
+      // coordinator may have died before signal was requested
+      ::prctl( PR_SET_PDEATHSIG, SIGKILL );
+      if ( ::getppid() != m_coordinator )
+      {
+        ::_exit( 1 );
+      }
+
+      auto &state = m_control->shards[ k ].value;
+      auto &memory = *m_shard_memory[ k ];
+      auto shard = shard_t{ memory.data(), memory.size() };
+      while ( true )
+      {
+        wait_for_coordinator();
+        if ( m_control->command == command_t::stop )
+        {
+          ::_exit( 0 );
+        }
+        try
+        {
+          execute( k, shard );
+        }
+        catch ( std::exception const &e )
+        {
+          std::strncpy( state.error, e.what(), sizeof( state.error ) - 1u );
+        }
+        wait_for_coordinator();
+      }
+    }
+
+    // barrier wait of worker - once it is reparented, coordinator is gone
+    // and would never arrive
+    void wait_for_coordinator() noexcept
+    {
+      while ( !m_control->barrier.wait_for( worker_poll_interval ) )
+      {
+        if ( ::getppid() != m_coordinator )
+        {
+          ::_exit( 1 );
+        }
+      }
+    }
+
+    void execute( std::size_t k, shard_t &shard )
+    {
+      auto &state = m_control->shards[ k ].value;
+      auto &layer = shard.layer;
+      switch ( m_control->command )
+      {
+        case command_t::init:
+          init_shard( k, shard );
+          break;
+
+        case command_t::prepare:
+          for ( auto &&s : shard.statuses )
+          {
+            if ( s > 0 )
+            {
+              s = 0;
+            }
+          }
+          if ( m_settings.displacement_threshold > 0.0 )
+          {
+            shard.epoch_start.reset( layer.size() );
+          }
+          break;
+
+        case command_t::find:
+          if ( is_owned( state, m_control->moved ) )
+          {
+            auto i = m_control->moved - state.offset;
+            auto winner = neuron_type{ layer.neuron( i ) };
+            save_epoch_start( shard, i );
+            winner.adjust_to( m_control->inputs[ m_control->moved_input ],
+                              static_cast< T >( m_settings.alpha ) );
+            layer.store( i, winner.weights() );
+            shard.statuses[ i ]++;
+          }
+          state.winner = no_winner< T >;
+          if ( m_control->input != npos && layer.size() != 0u )
+          {
+            state.winner =
+              m_winner_kernel( layer, 0u, layer.padded_size(),
+                               m_control->inputs[ m_control->input ] );
+            state.winner.index += state.offset;
+          }
+          break;
+
+        case command_t::find_batch:
+        {
+          auto winners = m_control->winners + k * m_capacity;
+          std::fill( winners, winners + m_control->count, no_winner< T > );
+          if ( layer.size() != 0u )
+          {
+            m_block_winner_kernel( layer, 0u, layer.padded_size(),
+                                   m_control->inputs, m_control->count,
+                                   winners );
+            for ( auto i = std::size_t{ 0 }; i < m_control->count; i++ )
+            {
+              winners[ i ].index += state.offset;
+            }
+          }
+          break;
+        }
+
+        case command_t::adjust:
+          for ( auto a = std::size_t{ 0 }; a < m_control->count; a++ )
+          {
+            auto const &adj = m_control->adjustments[ a ];
+            if ( is_owned( state, adj.index ) )
+            {
+              auto i = adj.index - state.offset;
+              auto winner = neuron_type{ layer.neuron( i ) };
+              save_epoch_start( shard, i );
+              winner.adjust_to( adj.mean,
+                                static_cast< T >( m_settings.alpha ) );
+              layer.store( i, winner.weights() );
+              shard.statuses[ i ] += adj.count;
+            }
+          }
+          break;
+
+        case command_t::measure:
+          measure( state, shard );
+          break;
+
+        case command_t::kill:
+          for ( auto &&s : shard.statuses )
+          {
+            if ( state.kill_quota == 0u )
+            {
+              break;
+            }
+            if ( s == 0 )
+            {
+              s = -1;
+              state.kill_quota--;
+            }
+          }
+          break;
+
+        case command_t::nearest:
+          find_nearest( state, shard );
+          break;
+
+        case command_t::merge:
+          for ( auto m = std::size_t{ 0 }; m < m_control->count; m++ )
+          {
+            auto pair = m_control->merges[ m ];
+            if ( is_owned( state, pair.second ) )
+            {
+              auto j = pair.second - state.offset;
+              auto merged = neuron_type{ layer.neuron( j ) };
+              merged.average_with( neuron_type{ neuron_at( pair.first ) } );
+              layer.store( j, merged.weights() );
+            }
+            if ( is_owned( state, pair.first ) )
+            {
+              shard.statuses[ pair.first - state.offset ] = -1;
+            }
+          }
+          break;
+
+        case command_t::compact:
+          compact_shard( shard );
+          publish( state, shard );
+          break;
+
+        case command_t::stop:
+          break;
+      }
+    }
+
+    void init_shard( std::size_t k, shard_t &shard )
+    {
+      auto &state = m_control->shards[ k ].value;
+      auto range = shard_range( k );
+      auto count = range.second - range.first;
+      auto radius = static_cast< T >( m_settings.normalization_sphere_radius );
+
+      shard.layer.resize( count );
+      for ( auto b = range.first / init_block_size;
+            b * init_block_size < range.second; b++ )
+      {
+        auto eng = prng_engine_t{ m_seed, b };
+        for ( auto i = b * init_block_size;
+              i < std::min( range.second, ( b + 1u ) * init_block_size ); i++ )
+        {
+          shard.layer.store( i - range.first,
+                             neuron_type{ radius, eng }.weights() );
+        }
+      }
+
+      shard.statuses.assign( count, 0 );
+      shard.ids.resize( count );
+      std::iota( shard.ids.begin(), shard.ids.end(), range.first );
+      publish( state, shard );
+    }
+
+    // before first move of neuron in epoch (it has not won yet)
+    void save_epoch_start( shard_t &shard, std::size_t i ) const
+    {
+      if ( m_settings.displacement_threshold > 0.0 && shard.statuses[ i ] == 0 )
+      {
+        shard.epoch_start.save( i, shard.layer.neuron( i ) );
+      }
+    }
+
+    void measure( shard_state_t &state, shard_t const &shard ) const
+    {
+      auto const &statuses = shard.statuses;
+      state.zero_count = static_cast< std::size_t >(
+        std::count( statuses.begin(), statuses.end(), 0 ) );
+      state.winner_count = static_cast< std::size_t >(
+        std::count_if( statuses.begin(), statuses.end(),
+                       []( int s ) { return s > 0; } ) );
+
+      state.total_displacement = 0.0;
+      state.max_displacement = 0.0;
+      if ( m_settings.displacement_threshold > 0.0 )
+      {
+        for ( auto i = std::size_t{ 0 }; i < shard.layer.size(); i++ )
+        {
+          if ( statuses[ i ] > 0 )
+          {
+            auto d = static_cast< double >(
+              neuron_type{ shard.layer.neuron( i ) }.distance_to(
+                shard.epoch_start[ i ] ) );
+            state.total_displacement += d;
+            state.max_displacement = std::max( state.max_displacement, d );
+          }
+        }
+      }
+    }
+
+    // same dot products and tie-breaking as basic_nearest_pairs_t, so
+    // partners match those of single layer
+    void find_nearest( shard_state_t const &state, shard_t const &shard ) const
+    {
+      for ( auto i = std::size_t{ 0 }; i < shard.layer.size(); i++ )
+      {
+        auto gi = state.offset + i;
+        auto weights = shard.layer.neuron( i );
+        auto best = nearest_type{ npos, std::numeric_limits< T >::lowest() };
+        for ( auto s = std::size_t{ 0 }; s < m_process_count; s++ )
+        {
+          auto const &other = m_control->shards[ s ].value;
+          for ( auto j = std::size_t{ 0 }; j < other.size; j++ )
+          {
+            auto gj = other.offset + j;
+            if ( gj == gi )
+            {
+              continue;
+            }
+            auto dot = weights[ 0 ] * other.columns[ 0 ][ j ];
+            static_for< N - 1u >( [&]( auto d ) {
+              dot += weights[ d + 1u ] * other.columns[ d + 1u ][ j ];
+            } );
+            if ( dot > best.dot )
+            {
+              best = nearest_type{ gj, dot };
+            }
+          }
+        }
+        m_control->nearest[ gi ] = best;
+      }
+    }
+
+    // keeps relative order of alive neurons
+    static void compact_shard( shard_t &shard )
+    {
+      auto kept = std::size_t{ 0 };
+      for ( auto i = std::size_t{ 0 }; i < shard.layer.size(); i++ )
+      {
+        if ( shard.statuses[ i ] < 0 )
+        {
+          continue;
+        }
+        if ( kept != i )
+        {
+          shard.layer.store( kept, shard.layer.neuron( i ) );
+          shard.statuses[ kept ] = shard.statuses[ i ];
+          shard.ids[ kept ] = shard.ids[ i ];
+        }
+        kept++;
+      }
+      shard.layer.resize( kept );
+      shard.statuses.resize( kept );
+      shard.ids.resize( kept );
+    }
+
+    static void publish( shard_state_t &state, shard_t const &shard )
+    {
+      for ( auto d = std::size_t{ 0 }; d < N; d++ )
+      {
+        state.columns[ d ] = shard.layer.column( d );
+      }
+      state.statuses = shard.statuses.data();
+      state.ids = shard.ids.data();
+      state.size = shard.layer.size();
+    }
+
+    static bool is_owned( shard_state_t const &state, std::size_t ix )
+    {
+      return ix != npos && ix >= state.offset &&
+             ix < state.offset + state.size;
+    }
+
+    // weights of any neuron (shards are read only during merge step)
+    features_type neuron_at( std::size_t ix ) const
+    {
+      for ( auto k = std::size_t{ 0 }; k < m_process_count; k++ )
+      {
+        auto const &shard = m_control->shards[ k ].value;
+        if ( is_owned( shard, ix ) )
+        {
+          return gather( shard, ix - shard.offset );
+        }
+      }
+      assert( false );
+      return features_type{};
+    }
+
+  private:
+    knc_settings_t m_settings;
+    std::size_t m_process_count;
+    std::size_t m_capacity;
+    basic_winner_kernel_t< T, N > m_winner_kernel;
+    basic_block_winner_kernel_t< T, N > m_block_winner_kernel;
+    std::uint64_t m_seed;
+
+    std::unique_ptr< shared_memory_t > m_control_memory =
+      std::unique_ptr< shared_memory_t >{};
+    std::vector< std::unique_ptr< shared_memory_t > > m_shard_memory =
+      std::vector< std::unique_ptr< shared_memory_t > >{};
+    control_t *m_control = nullptr;
+    std::vector< pid_t > m_workers = std::vector< pid_t >{};
+    pid_t m_coordinator = ::getpid();
+    bool m_is_abandoned = false;
+
+    std::size_t m_iteration_no = 0u;
+    std::size_t m_alive_count;
+    std::size_t m_kill_count = 0u;
+    std::size_t m_coalesce_count = 0u;
+
+    basic_nearest_pairs_t< T > m_nearest = basic_nearest_pairs_t< T >{};
+
+    // batch mode accumulators (indexed by global position)
+    std::vector< features_type > m_batch_sums =
+      std::vector< features_type >{};
+    std::vector< std::size_t > m_batch_counts = std::vector< std::size_t >{};
+    std::vector< std::size_t > m_batch_touched = std::vector< std::size_t >{};
+
+    // convergence tracking
+    double m_total_displacement = 0.0;
+    double m_max_displacement = std::numeric_limits< double >::infinity();
+    double m_plateau_base = 0.0;
+    std::size_t m_plateau_length = 0u;
+
+    bool m_is_status_pending = false;  // line of last iteration skipped
+    std::chrono::steady_clock::time_point m_last_status =
+      std::chrono::steady_clock::time_point{};
+    std::chrono::steady_clock::time_point m_deadline =
+      std::chrono::steady_clock::time_point::max();
+    stop_reason_t m_stop_reason = stop_reason_t::none;
+  };
+
+  using sharded_network_t =
+    basic_sharded_network_t< scalar_t, iris_dimension >;
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_SHARDED_H_INCLUDED
@@ -0,0 +1,145 @@
+#include "shm.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace isai
+{
+
+  shared_memory_t::shared_memory_t( std::size_t bytes )
+  {
+    static auto s_counter = std::atomic< unsigned >{ 0u };
+    auto name = "/kohris." + std::to_string( ::getpid() ) + "." +
+                std::to_string( s_counter++ );
+
+    auto fd = ::shm_open( name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                          0600 );  // NOLINT
+    if ( fd < 0 )
+    {
+      throw std::system_error{ errno, std::generic_category(),
+                               "cannot create shared memory " + name };
+    }
+    ::shm_unlink( name.c_str() );
+
+    auto page = static_cast< std::size_t >( ::sysconf( _SC_PAGESIZE ) );
+    auto size = ( std::max( bytes, std::size_t{ 1 } ) + page - 1u ) / page *
+                page;
+    if ( ::ftruncate( fd, static_cast< off_t >( size ) ) != 0 )
+    {
+      auto err = errno;
+      ::close( fd );
+      throw std::system_error{ err, std::generic_category(),
+                               "cannot resize shared memory " + name };
+    }
+
+    auto *addr =
+      ::mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if ( addr == MAP_FAILED )  // NOLINT
+    {
+      auto err = errno;
+      ::close( fd );
+      throw std::system_error{ err, std::generic_category(),
+                               "cannot map shared memory " + name };
+    }
+
+    // mapping stays valid after descriptor is closed
+    ::close( fd );
+    m_data = addr;
+    m_size = size;
+  }
+
+  shared_memory_t::~shared_memory_t() { ::munmap( m_data, m_size ); }
+
+  process_barrier_t::process_barrier_t( unsigned count ) : m_count( count )
+  {
+    if ( count == 0u || count > count_mask )
+    {
+      throw std::system_error{ EINVAL, std::generic_category(),
+                               "cannot create process barrier" };
+    }
+  }
+
+  void process_barrier_t::wait() noexcept
+  {
+    while ( !wait_for( std::chrono::hours{ 1 } ) )
+    {
+    }
+  }
+
+  bool process_barrier_t::wait_for( std::chrono::milliseconds timeout ) noexcept
+  {
+    // arrival - last process starts next generation and wakes the others
+    auto state = m_state.load( std::memory_order_relaxed );
+    auto arrived = state;
+    do
+    {
+      arrived = ( state & count_mask ) + 1u == m_count
+                  ? ( state & ~count_mask ) + generation_step
+                  : state + 1u;
+    } while ( !m_state.compare_exchange_weak( state, arrived,
+                                              std::memory_order_acq_rel ) );
+    auto generation = state & ~count_mask;
+    if ( ( arrived & ~count_mask ) != generation )
+    {
+      ::syscall( SYS_futex, &m_state, FUTEX_WAKE, INT_MAX, nullptr, nullptr,
+                 0 );
+      return true;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while ( true )
+    {
+      state = m_state.load( std::memory_order_acquire );
+      if ( ( state & ~count_mask ) != generation )
+      {
+        return true;
+      }
+      auto left = deadline - std::chrono::steady_clock::now();
+      if ( left <= std::chrono::steady_clock::duration::zero() )
+      {
+        break;
+      }
+      auto secs = std::chrono::duration_cast< std::chrono::seconds >( left );
+      auto wait = timespec{};
+      wait.tv_sec = static_cast< time_t >( secs.count() );
+      wait.tv_nsec = static_cast< long >(
+        std::chrono::duration_cast< std::chrono::nanoseconds >( left - secs )
+          .count() );
+      sleep( state, wait );
+    }
+
+    // timed out - withdraw, unless barrier completed meanwhile
+    while ( ( state & ~count_mask ) == generation )
+    {
+      if ( m_state.compare_exchange_weak( state, state - 1u,
+                                          std::memory_order_acq_rel ) )
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void process_barrier_t::sleep( std::uint32_t state,
+                                 timespec const &timeout ) noexcept
+  {
+    // futex is plain 32-bit word of shared mapping (not private to process)
+    static_assert( std::atomic< std::uint32_t >::is_always_lock_free &&
+                     sizeof( m_state ) == sizeof( std::uint32_t ),
+                   "futex needs plain 32-bit atomic" );
+    // returns early when state differs, on wake-up or signal
+    ::syscall( SYS_futex, &m_state, FUTEX_WAIT, state, &timeout, nullptr,
+               0 );
+  }
+
+}  // namespace isai
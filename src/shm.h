@@ -0,0 +1,78 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_SHM_H_INCLUDED
+#define ISAI_KOHRIS_SHM_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include <time.h>
+
+namespace isai
+{
+
+  // posix shared memory segment, zero-filled - its name is unlinked right
+  // after mapping, so segment disappears with last process mapping it;
+  // processes forked later inherit mapping at the same address, so plain
+  // pointers into segment are valid in all of them; throws
+  // std::system_error when segment cannot be created
+  class shared_memory_t
+  {
+  public:
+    explicit shared_memory_t( std::size_t bytes );
+    shared_memory_t( shared_memory_t const & ) = delete;
+    shared_memory_t( shared_memory_t && ) = delete;
+    shared_memory_t &operator=( shared_memory_t const & ) = delete;
+    shared_memory_t &operator=( shared_memory_t && ) = delete;
+    ~shared_memory_t();
+
+    void *data() const noexcept { return m_data; }
+    std::size_t size() const noexcept { return m_size; }
+
+  private:
+    void *m_data = nullptr;
+    std::size_t m_size = 0u;
+  };
+
+  // barrier of fixed number of processes - to be placed in shared memory
+  // (e.g. by memory_arena_t::create) before they are forked; single atomic
+  // word (generation and count of waiting processes) slept on by futex, so
+  // wait can time out and no process holds any lock in it (unlike pthread
+  // barrier or process-shared condition variable, which can block forever
+  // once process waiting in them is killed)
+  class process_barrier_t
+  {
+  public:
+    explicit process_barrier_t( unsigned count );
+    process_barrier_t( process_barrier_t const & ) = delete;
+    process_barrier_t( process_barrier_t && ) = delete;
+    process_barrier_t &operator=( process_barrier_t const & ) = delete;
+    process_barrier_t &operator=( process_barrier_t && ) = delete;
+    ~process_barrier_t() = default;
+
+    // blocks until all processes are waiting (and makes writes done by
+    // any of them before visible to all of them after)
+    void wait() noexcept;
+
+    // as wait, but gives up once timeout passes - returns false then, and
+    // calling process is no longer counted as waiting (so it may e.g. check
+    // that the others are still alive, and wait again)
+    bool wait_for( std::chrono::milliseconds timeout ) noexcept;
+
+  private:
+    static constexpr std::uint32_t count_mask = 0xffffu;
+    static constexpr std::uint32_t generation_step = count_mask + 1u;
+
+    // sleeps while state is unchanged, at most for timeout
+    void sleep( std::uint32_t state, timespec const &timeout ) noexcept;
+
+  private:
+    std::uint32_t m_count;
+    std::atomic< std::uint32_t > m_state = std::atomic< std::uint32_t >{ 0u };
+  };
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_SHM_H_INCLUDED
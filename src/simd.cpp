@@ -0,0 +1,37 @@
+#include "simd.h"
+
+namespace isai
+{
+
+  simd_level_t detect_simd_level() noexcept
+  {
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx512f" ) )
+    {
+      return simd_level_t::avx512;
+    }
+    if ( __builtin_cpu_supports( "avx2" ) )
+    {
+      return simd_level_t::avx2;
+    }
+    return simd_level_t::scalar;
+  }
+
+  simd_level_t resolve_simd_level( simd_level_t requested ) noexcept
+  {
+    auto supported = detect_simd_level();
+    if ( requested == simd_level_t::automatic ||
+         static_cast< int >( requested ) > static_cast< int >( supported ) )
+    {
+      return supported;
+    }
+    return requested;
+  }
+
+  bool supports_avx512bw() noexcept
+  {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports( "avx512bw" );
+  }
+
+}  // namespace isai
@@ -0,0 +1,847 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_SIMD_H_INCLUDED
+#define ISAI_KOHRIS_SIMD_H_INCLUDED
+
+#include "layer.h"
+
+#include <algorithm>
+
+#include <immintrin.h>
+
+// per-function instruction set selection (kernels are picked at runtime)
+#define ISAI_TARGET_AVX2 __attribute__( ( target( "avx2" ) ) )
+#define ISAI_TARGET_AVX512 __attribute__( ( target( "avx512f" ) ) )
+#define ISAI_TARGET_AVX512BW \
+  __attribute__( ( target( "avx512f,avx512bw" ) ) )
+
+namespace isai
+{
+
+  // instruction set used by hot kernels
+  enum class simd_level_t
+  {
+    automatic,
+    scalar,
+    avx2,
+    avx512
+  };
+
+  constexpr char const *const simd_level_strs[] = { "automatic", "scalar",
+                                                    "avx2", "avx512" };
+  constexpr char const *simd_level_to_string( simd_level_t level )
+  {
+    return simd_level_strs[ static_cast< int >( level ) ];
+  }
+
+  // best matching unit found within some range of hidden layer
+  template < typename T >
+  struct basic_winner_t
+  {
+    std::size_t index;
+    T sqr_distance;
+  };
+
+  using winner_t = basic_winner_t< scalar_t >;
+
+  // neither index nor distance - loses to any real candidate
+  template < typename T >
+  constexpr basic_winner_t< T > no_winner = basic_winner_t< T >{
+    std::numeric_limits< std::size_t >::max(), std::numeric_limits< T >::max()
+  };
+
+  // picks better of two candidates (on ties - one with lower index)
+  template < typename T >
+  inline basic_winner_t< T > better_of( basic_winner_t< T > const &lhs,
+                                        basic_winner_t< T > const &rhs )
+  {
+    if ( rhs.sqr_distance < lhs.sqr_distance ||
+         ( rhs.sqr_distance == lhs.sqr_distance && rhs.index < lhs.index ) )
+    {
+      return rhs;
+    }
+    return lhs;
+  }
+
+  // finds neuron closest to input in slots [begin, end) of given layer;
+  // both bounds must be multiples of layer block size
+  template < typename T, std::size_t N >
+  using basic_winner_kernel_t =
+    basic_winner_t< T > ( * )( basic_hidden_layer_t< T, N > const &layer,
+                               std::size_t begin, std::size_t end,
+                               basic_features_t< T, N > const &input );
+
+  using winner_kernel_t = basic_winner_kernel_t< scalar_t, iris_dimension >;
+
+  // finds winners of count inputs in slots [begin, end) of given layer - the
+  // same ones winner kernel finds for each input alone (bounds must be
+  // multiples of layer block size)
+  template < typename T, std::size_t N >
+  using basic_block_winner_kernel_t =
+    void ( * )( basic_hidden_layer_t< T, N > const &layer, std::size_t begin,
+                std::size_t end, basic_features_t< T, N > const *inputs,
+                std::size_t count, basic_winner_t< T > *winners );
+
+  using block_winner_kernel_t =
+    basic_block_winner_kernel_t< scalar_t, iris_dimension >;
+
+  // best instruction set supported by cpu we are running on
+  simd_level_t detect_simd_level() noexcept;
+
+  // resolves 'automatic' and levels not supported by cpu
+  simd_level_t resolve_simd_level( simd_level_t requested ) noexcept;
+
+  // byte and word instructions of avx-512 (integer kernels need them)
+  bool supports_avx512bw() noexcept;
+
+  namespace detail
+  {
+
+    // thin wrappers over intrinsics, so kernels can be written once per
+    // instruction set for both scalar types (winner indices are kept in
+    // lanes of value type for doubles and as 32-bit integers for floats)
+    template < typename T >
+    struct avx2_ops_t;
+
+    template <>
+    struct avx2_ops_t< double >
+    {
+      static constexpr std::size_t width = 4u;
+      using vec_t = __m256d;
+      using mask_t = __m256d;
+      using ix_t = __m256d;
+
+      ISAI_TARGET_AVX2 static vec_t set1( double v )
+      {
+        return _mm256_set1_pd( v );
+      }
+      ISAI_TARGET_AVX2 static vec_t zero() { return _mm256_setzero_pd(); }
+      ISAI_TARGET_AVX2 static vec_t load( double const *p )
+      {
+        return _mm256_load_pd( p );
+      }
+      // lanes p[ 0 ], p[ stride ], p[ 2 * stride ], ...
+      ISAI_TARGET_AVX2 static vec_t gather( double const *p,
+                                            std::size_t stride )
+      {
+        auto s = static_cast< int >( stride );
+        return _mm256_mask_i32gather_pd(
+          zero(), p, _mm_setr_epi32( 0, s, 2 * s, 3 * s ),
+          _mm256_castsi256_pd( _mm256_set1_epi64x( -1 ) ), 8 );
+      }
+      ISAI_TARGET_AVX2 static vec_t sub( vec_t a, vec_t b )
+      {
+        return _mm256_sub_pd( a, b );
+      }
+      ISAI_TARGET_AVX2 static vec_t add( vec_t a, vec_t b )
+      {
+        return _mm256_add_pd( a, b );
+      }
+      ISAI_TARGET_AVX2 static vec_t mul( vec_t a, vec_t b )
+      {
+        return _mm256_mul_pd( a, b );
+      }
+      ISAI_TARGET_AVX2 static mask_t less( vec_t a, vec_t b )
+      {
+        return _mm256_cmp_pd( a, b, _CMP_LT_OQ );
+      }
+      ISAI_TARGET_AVX2 static vec_t blend( mask_t m, vec_t a, vec_t b )
+      {
+        return _mm256_blendv_pd( a, b, m );
+      }
+      ISAI_TARGET_AVX2 static void store( double *p, vec_t v )
+      {
+        _mm256_storeu_pd( p, v );
+      }
+
+      ISAI_TARGET_AVX2 static ix_t ix_set1( std::size_t v )
+      {
+        return _mm256_set1_pd( static_cast< double >( v ) );
+      }
+      ISAI_TARGET_AVX2 static ix_t ix_iota( std::size_t v )
+      {
+        return _mm256_add_pd( ix_set1( v ),
+                              _mm256_setr_pd( 0.0, 1.0, 2.0, 3.0 ) );
+      }
+      ISAI_TARGET_AVX2 static ix_t ix_add( ix_t a, ix_t b )
+      {
+        return _mm256_add_pd( a, b );
+      }
+      ISAI_TARGET_AVX2 static ix_t ix_blend( mask_t m, ix_t a, ix_t b )
+      {
+        return _mm256_blendv_pd( a, b, m );
+      }
+      ISAI_TARGET_AVX2 static void ix_store( std::size_t *p, ix_t v )
+      {
+        double tmp[ width ];
+        _mm256_storeu_pd( tmp, v );
+        for ( auto l = std::size_t{ 0 }; l < width; l++ )
+        {
+          p[ l ] = static_cast< std::size_t >( tmp[ l ] );
+        }
+      }
+    };
+
+    template <>
+    struct avx2_ops_t< float >
+    {
+      static constexpr std::size_t width = 8u;
+      using vec_t = __m256;
+      using mask_t = __m256;
+      using ix_t = __m256i;
+
+      ISAI_TARGET_AVX2 static vec_t set1( float v )
+      {
+        return _mm256_set1_ps( v );
+      }
+      ISAI_TARGET_AVX2 static vec_t zero() { return _mm256_setzero_ps(); }
+      ISAI_TARGET_AVX2 static vec_t load( float const *p )
+      {
+        return _mm256_load_ps( p );
+      }
+      // lanes p[ 0 ], p[ stride ], p[ 2 * stride ], ...
+      ISAI_TARGET_AVX2 static vec_t gather( float const *p,
+                                            std::size_t stride )
+      {
+        auto ix = _mm256_mullo_epi32(
+          _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ),
+          _mm256_set1_epi32( static_cast< int >( stride ) ) );
+        return _mm256_mask_i32gather_ps(
+          zero(), p, ix, _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) ), 4 );
+      }
+      ISAI_TARGET_AVX2 static vec_t sub( vec_t a, vec_t b )
+      {
+        return _mm256_sub_ps( a, b );
+      }
+      ISAI_TARGET_AVX2 static vec_t add( vec_t a, vec_t b )
+      {
+        return _mm256_add_ps( a, b );
+      }
+      ISAI_TARGET_AVX2 static vec_t mul( vec_t a, vec_t b )
+      {
+        return _mm256_mul_ps( a, b );
+      }
+      ISAI_TARGET_AVX2 static mask_t less( vec_t a, vec_t b )
+      {
+        return _mm256_cmp_ps( a, b, _CMP_LT_OQ );
+      }
+      ISAI_TARGET_AVX2 static vec_t blend( mask_t m, vec_t a, vec_t b )
+      {
+        return _mm256_blendv_ps( a, b, m );
+      }
+      ISAI_TARGET_AVX2 static void store( float *p, vec_t v )
+      {
+        _mm256_storeu_ps( p, v );
+      }
+
+      ISAI_TARGET_AVX2 static ix_t ix_set1( std::size_t v )
+      {
+        return _mm256_set1_epi32( static_cast< int >( v ) );
+      }
+      ISAI_TARGET_AVX2 static ix_t ix_iota( std::size_t v )
+      {
+        return _mm256_add_epi32( ix_set1( v ),
+                                 _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ) );
+      }
+      ISAI_TARGET_AVX2 static ix_t ix_add( ix_t a, ix_t b )
+      {
+        return _mm256_add_epi32( a, b );
+      }
+      ISAI_TARGET_AVX2 static ix_t ix_blend( mask_t m, ix_t a, ix_t b )
+      {
+        return _mm256_blendv_epi8( a, b, _mm256_castps_si256( m ) );
+      }
+      ISAI_TARGET_AVX2 static void ix_store( std::size_t *p, ix_t v )
+      {
+        std::int32_t tmp[ width ];
+        _mm256_storeu_si256( reinterpret_cast< __m256i * >( tmp ), v );
+        for ( auto l = std::size_t{ 0 }; l < width; l++ )
+        {
+          p[ l ] = static_cast< std::size_t >( tmp[ l ] );
+        }
+      }
+    };
+
+    template < typename T >
+    struct avx512_ops_t;
+
+    template <>
+    struct avx512_ops_t< double >
+    {
+      static constexpr std::size_t width = 8u;
+      using vec_t = __m512d;
+      using mask_t = __mmask8;
+      using ix_t = __m512d;
+
+      ISAI_TARGET_AVX512 static vec_t set1( double v )
+      {
+        return _mm512_set1_pd( v );
+      }
+      ISAI_TARGET_AVX512 static vec_t zero() { return _mm512_setzero_pd(); }
+      ISAI_TARGET_AVX512 static vec_t load( double const *p )
+      {
+        return _mm512_load_pd( p );
+      }
+      // lanes p[ 0 ], p[ stride ], p[ 2 * stride ], ...
+      ISAI_TARGET_AVX512 static vec_t gather( double const *p,
+                                              std::size_t stride )
+      {
+        auto ix = _mm256_mullo_epi32(
+          _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ),
+          _mm256_set1_epi32( static_cast< int >( stride ) ) );
+        return _mm512_mask_i32gather_pd( zero(), 0xff, ix, p, 8 );
+      }
+      ISAI_TARGET_AVX512 static vec_t sub( vec_t a, vec_t b )
+      {
+        return _mm512_sub_pd( a, b );
+      }
+      ISAI_TARGET_AVX512 static vec_t add( vec_t a, vec_t b )
+      {
+        return _mm512_add_pd( a, b );
+      }
+      ISAI_TARGET_AVX512 static vec_t mul( vec_t a, vec_t b )
+      {
+        return _mm512_mul_pd( a, b );
+      }
+      ISAI_TARGET_AVX512 static mask_t less( vec_t a, vec_t b )
+      {
+        return _mm512_cmp_pd_mask( a, b, _CMP_LT_OQ );
+      }
+      ISAI_TARGET_AVX512 static vec_t blend( mask_t m, vec_t a, vec_t b )
+      {
+        return _mm512_mask_blend_pd( m, a, b );
+      }
+      ISAI_TARGET_AVX512 static void store( double *p, vec_t v )
+      {
+        _mm512_storeu_pd( p, v );
+      }
+
+      ISAI_TARGET_AVX512 static ix_t ix_set1( std::size_t v )
+      {
+        return _mm512_set1_pd( static_cast< double >( v ) );
+      }
+      ISAI_TARGET_AVX512 static ix_t ix_iota( std::size_t v )
+      {
+        return _mm512_add_pd(
+          ix_set1( v ),
+          _mm512_setr_pd( 0.0, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0 ) );
+      }
+      ISAI_TARGET_AVX512 static ix_t ix_add( ix_t a, ix_t b )
+      {
+        return _mm512_add_pd( a, b );
+      }
+      ISAI_TARGET_AVX512 static ix_t ix_blend( mask_t m, ix_t a, ix_t b )
+      {
+        return _mm512_mask_blend_pd( m, a, b );
+      }
+      ISAI_TARGET_AVX512 static void ix_store( std::size_t *p, ix_t v )
+      {
+        double tmp[ width ];
+        _mm512_storeu_pd( tmp, v );
+        for ( auto l = std::size_t{ 0 }; l < width; l++ )
+        {
+          p[ l ] = static_cast< std::size_t >( tmp[ l ] );
+        }
+      }
+    };
+
+    template <>
+    struct avx512_ops_t< float >
+    {
+      static constexpr std::size_t width = 16u;
+      using vec_t = __m512;
+      using mask_t = __mmask16;
+      using ix_t = __m512i;
+
+      ISAI_TARGET_AVX512 static vec_t set1( float v )
+      {
+        return _mm512_set1_ps( v );
+      }
+      ISAI_TARGET_AVX512 static vec_t zero() { return _mm512_setzero_ps(); }
+      ISAI_TARGET_AVX512 static vec_t load( float const *p )
+      {
+        return _mm512_load_ps( p );
+      }
+      // lanes p[ 0 ], p[ stride ], p[ 2 * stride ], ...
+      ISAI_TARGET_AVX512 static vec_t gather( float const *p,
+                                              std::size_t stride )
+      {
+        auto ix = _mm512_mullo_epi32(
+          _mm512_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+                             15 ),
+          _mm512_set1_epi32( static_cast< int >( stride ) ) );
+        return _mm512_mask_i32gather_ps( zero(), 0xffff, ix, p, 4 );
+      }
+      ISAI_TARGET_AVX512 static vec_t sub( vec_t a, vec_t b )
+      {
+        return _mm512_sub_ps( a, b );
+      }
+      ISAI_TARGET_AVX512 static vec_t add( vec_t a, vec_t b )
+      {
+        return _mm512_add_ps( a, b );
+      }
+      ISAI_TARGET_AVX512 static vec_t mul( vec_t a, vec_t b )
+      {
+        return _mm512_mul_ps( a, b );
+      }
+      ISAI_TARGET_AVX512 static mask_t less( vec_t a, vec_t b )
+      {
+        return _mm512_cmp_ps_mask( a, b, _CMP_LT_OQ );
+      }
+      ISAI_TARGET_AVX512 static vec_t blend( mask_t m, vec_t a, vec_t b )
+      {
+        return _mm512_mask_blend_ps( m, a, b );
+      }
+      ISAI_TARGET_AVX512 static void store( float *p, vec_t v )
+      {
+        _mm512_storeu_ps( p, v );
+      }
+
+      ISAI_TARGET_AVX512 static ix_t ix_set1( std::size_t v )
+      {
+        return _mm512_set1_epi32( static_cast< int >( v ) );
+      }
+      ISAI_TARGET_AVX512 static ix_t ix_iota( std::size_t v )
+      {
+        return _mm512_add_epi32(
+          ix_set1( v ), _mm512_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+                                           11, 12, 13, 14, 15 ) );
+      }
+      ISAI_TARGET_AVX512 static ix_t ix_add( ix_t a, ix_t b )
+      {
+        return _mm512_add_epi32( a, b );
+      }
+      ISAI_TARGET_AVX512 static ix_t ix_blend( mask_t m, ix_t a, ix_t b )
+      {
+        return _mm512_mask_blend_epi32( m, a, b );
+      }
+      ISAI_TARGET_AVX512 static void ix_store( std::size_t *p, ix_t v )
+      {
+        std::int32_t tmp[ width ];
+        _mm512_storeu_si512( tmp, v );
+        for ( auto l = std::size_t{ 0 }; l < width; l++ )
+        {
+          p[ l ] = static_cast< std::size_t >( tmp[ l ] );
+        }
+      }
+    };
+
+    // blocked kernels split layer into tiles small enough to stay in l2
+    // cache (128 kb of weights) while all inputs are compared with them, and
+    // compare every vector of weights loaded from tile with group of inputs
+    // held in registers; each tile is reduced separately and merged by
+    // better_of, which keeps lowest index among equal distances
+    template < typename T, std::size_t N >
+    constexpr std::size_t winner_tile_size = std::max(
+      basic_hidden_layer_t< T, N >::block_size,
+      131072u / ( N * sizeof( T ) ) / basic_hidden_layer_t< T, N >::block_size *
+        basic_hidden_layer_t< T, N >::block_size );
+
+    constexpr std::size_t winner_input_group = 4u;
+
+    // picks best of per-lane winners (each lane keeps its earliest minimum,
+    // so lowest index among equal distances is the global earliest one)
+    template < typename T, std::size_t Width >
+    basic_winner_t< T > reduce_lanes( std::size_t begin, T const *vals,
+                                      std::size_t const *ixs )
+    {
+      auto best = basic_winner_t< T >{ begin, std::numeric_limits< T >::max() };
+      for ( auto l = std::size_t{ 0 }; l < Width; l++ )
+      {
+        best = better_of( best, basic_winner_t< T >{ ixs[ l ], vals[ l ] } );
+      }
+      return best;
+    }
+
+  }  // namespace detail
+
+  template < typename T, std::size_t N >
+  basic_winner_t< T >
+  find_winner_scalar( basic_hidden_layer_t< T, N > const &layer,
+                      std::size_t begin, std::size_t end,
+                      basic_features_t< T, N > const &input )
+  {
+    T const *cols[ N ];
+    static_for< N >( [&]( auto d ) { cols[ d ] = layer.column( d ); } );
+
+    auto best = basic_winner_t< T >{ begin, std::numeric_limits< T >::max() };
+
+    for ( auto i = begin; i < end; i++ )
+    {
+      auto res = T{ 0 };
+      static_for< N >( [&]( auto d ) {
+        auto diff = input[ d ] - cols[ d ][ i ];
+        res += diff * diff;
+      } );
+      if ( res < best.sqr_distance )
+      {
+        best = basic_winner_t< T >{ i, res };
+      }
+    }
+
+    return best;
+  }
+
+  // as scalar kernel, but weights are read by relaxed atomic loads - for
+  // scans racing with threads that move neurons (hogwild)
+  template < typename T, std::size_t N >
+  basic_winner_t< T >
+  find_winner_relaxed( basic_hidden_layer_t< T, N > const &layer,
+                       std::size_t begin, std::size_t end,
+                       basic_features_t< T, N > const &input )
+  {
+    auto best = basic_winner_t< T >{ begin, std::numeric_limits< T >::max() };
+
+    for ( auto i = begin; i < end; i++ )
+    {
+      auto weights = layer.neuron_relaxed( i );
+      auto res = T{ 0 };
+      static_for< N >( [&]( auto d ) {
+        auto diff = input[ d ] - weights[ d ];
+        res += diff * diff;
+      } );
+      if ( res < best.sqr_distance )
+      {
+        best = basic_winner_t< T >{ i, res };
+      }
+    }
+
+    return best;
+  }
+
+  // note: distances are accumulated with separate multiply and add (no fma),
+  // in the same order as scalar code, so all kernels agree exactly
+
+  template < typename T, std::size_t N >
+  ISAI_TARGET_AVX2 basic_winner_t< T >
+  find_winner_avx2( basic_hidden_layer_t< T, N > const &layer,
+                    std::size_t begin, std::size_t end,
+                    basic_features_t< T, N > const &input )
+  {
+    using ops = detail::avx2_ops_t< T >;
+    constexpr auto width = ops::width;
+
+    typename ops::vec_t in[ N ];
+    T const *cols[ N ];
+    for ( auto d = std::size_t{ 0 }; d < N; d++ )
+    {
+      in[ d ] = ops::set1( input[ d ] );
+      cols[ d ] = layer.column( d );
+    }
+
+    auto best_val = ops::set1( std::numeric_limits< T >::max() );
+    auto best_ix = ops::ix_set1( begin );
+    auto ix = ops::ix_iota( begin );
+    auto const step = ops::ix_set1( width );
+
+    for ( auto i = begin; i < end; i += width )
+    {
+      auto res = ops::zero();
+      for ( auto d = std::size_t{ 0 }; d < N; d++ )
+      {
+        auto diff = ops::sub( in[ d ], ops::load( cols[ d ] + i ) );
+        res = ops::add( res, ops::mul( diff, diff ) );
+      }
+      auto mask = ops::less( res, best_val );
+      best_val = ops::blend( mask, best_val, res );
+      best_ix = ops::ix_blend( mask, best_ix, ix );
+      ix = ops::ix_add( ix, step );
+    }
+
+    T vals[ width ];
+    std::size_t ixs[ width ];
+    ops::store( vals, best_val );
+    ops::ix_store( ixs, best_ix );
+    return detail::reduce_lanes< T, width >( begin, vals, ixs );
+  }
+
+  template < typename T, std::size_t N >
+  ISAI_TARGET_AVX512 basic_winner_t< T >
+  find_winner_avx512( basic_hidden_layer_t< T, N > const &layer,
+                      std::size_t begin, std::size_t end,
+                      basic_features_t< T, N > const &input )
+  {
+    using ops = detail::avx512_ops_t< T >;
+    constexpr auto width = ops::width;
+
+    typename ops::vec_t in[ N ];
+    T const *cols[ N ];
+    for ( auto d = std::size_t{ 0 }; d < N; d++ )
+    {
+      in[ d ] = ops::set1( input[ d ] );
+      cols[ d ] = layer.column( d );
+    }
+
+    auto best_val = ops::set1( std::numeric_limits< T >::max() );
+    auto best_ix = ops::ix_set1( begin );
+    auto ix = ops::ix_iota( begin );
+    auto const step = ops::ix_set1( width );
+
+    for ( auto i = begin; i < end; i += width )
+    {
+      auto res = ops::zero();
+      for ( auto d = std::size_t{ 0 }; d < N; d++ )
+      {
+        auto diff = ops::sub( in[ d ], ops::load( cols[ d ] + i ) );
+        res = ops::add( res, ops::mul( diff, diff ) );
+      }
+      auto mask = ops::less( res, best_val );
+      best_val = ops::blend( mask, best_val, res );
+      best_ix = ops::ix_blend( mask, best_ix, ix );
+      ix = ops::ix_add( ix, step );
+    }
+
+    T vals[ width ];
+    std::size_t ixs[ width ];
+    ops::store( vals, best_val );
+    ops::ix_store( ixs, best_ix );
+    return detail::reduce_lanes< T, width >( begin, vals, ixs );
+  }
+
+  template < typename T, std::size_t N >
+  void find_winners_scalar( basic_hidden_layer_t< T, N > const &layer,
+                            std::size_t begin, std::size_t end,
+                            basic_features_t< T, N > const *inputs,
+                            std::size_t count, basic_winner_t< T > *winners )
+  {
+    constexpr auto tile = detail::winner_tile_size< T, N >;
+    for ( auto k = std::size_t{ 0 }; k < count; k++ )
+    {
+      winners[ k ] =
+        basic_winner_t< T >{ begin, std::numeric_limits< T >::max() };
+    }
+    for ( auto t = begin; t < end; t += tile )
+    {
+      auto t_end = std::min( end, t + tile );
+      for ( auto k = std::size_t{ 0 }; k < count; k++ )
+      {
+        winners[ k ] = better_of(
+          winners[ k ], find_winner_scalar( layer, t, t_end, inputs[ k ] ) );
+      }
+    }
+  }
+
+  namespace detail
+  {
+    // compares R inputs with slots [begin, end) of single tile
+    template < typename T, std::size_t N, std::size_t R >
+    ISAI_TARGET_AVX2 void scan_tile_avx2(
+      basic_hidden_layer_t< T, N > const &layer, std::size_t begin,
+      std::size_t end, basic_features_t< T, N > const *inputs,
+      basic_winner_t< T > *winners )
+    {
+      using ops = detail::avx2_ops_t< T >;
+      constexpr auto width = ops::width;
+
+      typename ops::vec_t in[ R ][ N ];
+      typename ops::vec_t best_val[ R ];
+      typename ops::ix_t best_ix[ R ];
+      T const *cols[ N ];
+      for ( auto d = std::size_t{ 0 }; d < N; d++ )
+      {
+        cols[ d ] = layer.column( d );
+      }
+      for ( auto r = std::size_t{ 0 }; r < R; r++ )
+      {
+        for ( auto d = std::size_t{ 0 }; d < N; d++ )
+        {
+          in[ r ][ d ] = ops::set1( inputs[ r ][ d ] );
+        }
+        best_val[ r ] = ops::set1( std::numeric_limits< T >::max() );
+        best_ix[ r ] = ops::ix_set1( begin );
+      }
+      auto ix = ops::ix_iota( begin );
+      auto const step = ops::ix_set1( width );
+
+      for ( auto i = begin; i < end; i += width )
+      {
+        typename ops::vec_t w[ N ];
+        for ( auto d = std::size_t{ 0 }; d < N; d++ )
+        {
+          w[ d ] = ops::load( cols[ d ] + i );
+        }
+        for ( auto r = std::size_t{ 0 }; r < R; r++ )
+        {
+          auto res = ops::zero();
+          for ( auto d = std::size_t{ 0 }; d < N; d++ )
+          {
+            auto diff = ops::sub( in[ r ][ d ], w[ d ] );
+            res = ops::add( res, ops::mul( diff, diff ) );
+          }
+          auto mask = ops::less( res, best_val[ r ] );
+          best_val[ r ] = ops::blend( mask, best_val[ r ], res );
+          best_ix[ r ] = ops::ix_blend( mask, best_ix[ r ], ix );
+        }
+        ix = ops::ix_add( ix, step );
+      }
+
+      T vals[ width ];
+      std::size_t ixs[ width ];
+      for ( auto r = std::size_t{ 0 }; r < R; r++ )
+      {
+        ops::store( vals, best_val[ r ] );
+        ops::ix_store( ixs, best_ix[ r ] );
+        winners[ r ] = better_of(
+          winners[ r ], detail::reduce_lanes< T, width >( begin, vals, ixs ) );
+      }
+    }
+
+    template < typename T, std::size_t N, std::size_t R >
+    ISAI_TARGET_AVX512 void scan_tile_avx512(
+      basic_hidden_layer_t< T, N > const &layer, std::size_t begin,
+      std::size_t end, basic_features_t< T, N > const *inputs,
+      basic_winner_t< T > *winners )
+    {
+      using ops = detail::avx512_ops_t< T >;
+      constexpr auto width = ops::width;
+
+      typename ops::vec_t in[ R ][ N ];
+      typename ops::vec_t best_val[ R ];
+      typename ops::ix_t best_ix[ R ];
+      T const *cols[ N ];
+      for ( auto d = std::size_t{ 0 }; d < N; d++ )
+      {
+        cols[ d ] = layer.column( d );
+      }
+      for ( auto r = std::size_t{ 0 }; r < R; r++ )
+      {
+        for ( auto d = std::size_t{ 0 }; d < N; d++ )
+        {
+          in[ r ][ d ] = ops::set1( inputs[ r ][ d ] );
+        }
+        best_val[ r ] = ops::set1( std::numeric_limits< T >::max() );
+        best_ix[ r ] = ops::ix_set1( begin );
+      }
+      auto ix = ops::ix_iota( begin );
+      auto const step = ops::ix_set1( width );
+
+      for ( auto i = begin; i < end; i += width )
+      {
+        typename ops::vec_t w[ N ];
+        for ( auto d = std::size_t{ 0 }; d < N; d++ )
+        {
+          w[ d ] = ops::load( cols[ d ] + i );
+        }
+        for ( auto r = std::size_t{ 0 }; r < R; r++ )
+        {
+          auto res = ops::zero();
+          for ( auto d = std::size_t{ 0 }; d < N; d++ )
+          {
+            auto diff = ops::sub( in[ r ][ d ], w[ d ] );
+            res = ops::add( res, ops::mul( diff, diff ) );
+          }
+          auto mask = ops::less( res, best_val[ r ] );
+          best_val[ r ] = ops::blend( mask, best_val[ r ], res );
+          best_ix[ r ] = ops::ix_blend( mask, best_ix[ r ], ix );
+        }
+        ix = ops::ix_add( ix, step );
+      }
+
+      T vals[ width ];
+      std::size_t ixs[ width ];
+      for ( auto r = std::size_t{ 0 }; r < R; r++ )
+      {
+        ops::store( vals, best_val[ r ] );
+        ops::ix_store( ixs, best_ix[ r ] );
+        winners[ r ] = better_of(
+          winners[ r ], detail::reduce_lanes< T, width >( begin, vals, ixs ) );
+      }
+    }
+  }  // namespace detail
+
+  template < typename T, std::size_t N >
+  ISAI_TARGET_AVX2 void
+  find_winners_avx2( basic_hidden_layer_t< T, N > const &layer,
+                     std::size_t begin, std::size_t end,
+                     basic_features_t< T, N > const *inputs,
+                     std::size_t count, basic_winner_t< T > *winners )
+  {
+    constexpr auto tile = detail::winner_tile_size< T, N >;
+    constexpr auto group = detail::winner_input_group;
+    for ( auto k = std::size_t{ 0 }; k < count; k++ )
+    {
+      winners[ k ] =
+        basic_winner_t< T >{ begin, std::numeric_limits< T >::max() };
+    }
+    for ( auto t = begin; t < end; t += tile )
+    {
+      auto t_end = std::min( end, t + tile );
+      auto k = std::size_t{ 0 };
+      for ( ; k + group <= count; k += group )
+      {
+        detail::scan_tile_avx2< T, N, group >( layer, t, t_end, inputs + k,
+                                               winners + k );
+      }
+      for ( ; k < count; k++ )
+      {
+        detail::scan_tile_avx2< T, N, 1u >( layer, t, t_end, inputs + k,
+                                            winners + k );
+      }
+    }
+  }
+
+  template < typename T, std::size_t N >
+  ISAI_TARGET_AVX512 void
+  find_winners_avx512( basic_hidden_layer_t< T, N > const &layer,
+                       std::size_t begin, std::size_t end,
+                       basic_features_t< T, N > const *inputs,
+                       std::size_t count, basic_winner_t< T > *winners )
+  {
+    constexpr auto tile = detail::winner_tile_size< T, N >;
+    constexpr auto group = detail::winner_input_group;
+    for ( auto k = std::size_t{ 0 }; k < count; k++ )
+    {
+      winners[ k ] =
+        basic_winner_t< T >{ begin, std::numeric_limits< T >::max() };
+    }
+    for ( auto t = begin; t < end; t += tile )
+    {
+      auto t_end = std::min( end, t + tile );
+      auto k = std::size_t{ 0 };
+      for ( ; k + group <= count; k += group )
+      {
+        detail::scan_tile_avx512< T, N, group >( layer, t, t_end, inputs + k,
+                                                 winners + k );
+      }
+      for ( ; k < count; k++ )
+      {
+        detail::scan_tile_avx512< T, N, 1u >( layer, t, t_end, inputs + k,
+                                              winners + k );
+      }
+    }
+  }
+
+  // winner search kernel for given instruction set (or best one supported)
+  template < typename T, std::size_t N >
+  basic_winner_kernel_t< T, N > get_winner_kernel( simd_level_t level ) noexcept
+  {
+    switch ( resolve_simd_level( level ) )
+    {
+      case simd_level_t::avx512:
+        return &find_winner_avx512< T, N >;
+      case simd_level_t::avx2:
+        return &find_winner_avx2< T, N >;
+      default:
+        return &find_winner_scalar< T, N >;
+    }
+  }
+
+  // blocked variant of the above
+  template < typename T, std::size_t N >
+  basic_block_winner_kernel_t< T, N >
+  get_block_winner_kernel( simd_level_t level ) noexcept
+  {
+    switch ( resolve_simd_level( level ) )
+    {
+      case simd_level_t::avx512:
+        return &find_winners_avx512< T, N >;
+      case simd_level_t::avx2:
+        return &find_winners_avx2< T, N >;
+      default:
+        return &find_winners_scalar< T, N >;
+    }
+  }
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_SIMD_H_INCLUDED
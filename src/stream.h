@@ -0,0 +1,453 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_STREAM_H_INCLUDED
+#define ISAI_KOHRIS_STREAM_H_INCLUDED
+
+#include "csv.h"
+#include "dataset.h"
+#include "dataset_cache.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace isai
+{
+
+  // dataset streamed from delimited file in chunks of fixed number of lines,
+  // so it never has to fit into memory - chunks are parsed, balanced and
+  // normalized by background thread, one chunk ahead of consumer (double
+  // buffering); train/test split is done per chunk (random chunks are set
+  // aside for testing) and shuffling permutes chunk order and rows within
+  // each chunk
+  template < typename T, std::size_t N >
+  class basic_chunked_source_t
+  {
+  public:
+    using features_type = basic_features_t< T, N >;
+    using data_point_type = basic_data_point_t< T, N >;
+    using chunk_type = std::vector< data_point_type >;
+    using preprocessing_type = basic_preprocessing_t< T, N >;
+
+    // opening makes one pass over file (chunk boundaries and row counts;
+    // rows are parsed only for feature means when balancing signs, or for
+    // label names unless schema fixes them); chunks are then assigned to
+    // training set until it has training_count rows (last one is cut)
+    basic_chunked_source_t( char const *path, csv_schema_t const &schema,
+                            std::size_t chunk_size, std::size_t training_count,
+                            double proj_sphere_radius = 1.0,
+                            bool do_sign_balancing = false ) :
+      m_file( path ),
+      m_schema( schema ),
+      m_path( path )
+    {
+      m_preprocessing.radius = proj_sphere_radius;
+      m_preprocessing.is_balanced = do_sign_balancing;
+
+      scan( std::max( chunk_size, std::size_t{ 1 } ) );
+      split( training_count );
+
+      m_producer = std::thread{ [this]() { produce(); } };
+    }
+
+    basic_chunked_source_t( basic_chunked_source_t const & ) = delete;
+    basic_chunked_source_t( basic_chunked_source_t && ) = delete;
+    basic_chunked_source_t &
+    operator=( basic_chunked_source_t const & ) = delete;
+    basic_chunked_source_t &operator=( basic_chunked_source_t && ) = delete;
+
+    ~basic_chunked_source_t()
+    {
+      {
+        auto lock = std::unique_lock< std::mutex >{ m_mutex };
+        m_is_stopping = true;
+      }
+      m_cv.notify_all();
+      m_producer.join();
+    }
+
+    std::size_t size() const noexcept { return m_row_count; }
+    std::size_t train_size() const noexcept { return m_train_row_count; }
+    std::size_t test_size() const noexcept
+    {
+      return m_row_count - m_train_row_count;
+    }
+
+    std::size_t chunk_count() const noexcept { return m_chunks.size(); }
+    std::vector< std::size_t > const &train_chunks() const noexcept
+    {
+      return m_train_chunks;
+    }
+    std::vector< std::size_t > const &test_chunks() const noexcept
+    {
+      return m_test_chunks;
+    }
+
+    preprocessing_type const &preprocessing() const noexcept
+    {
+      return m_preprocessing;
+    }
+
+    // names of labels, indexed by label value (all of them are known once
+    // file was scanned)
+    std::vector< std::string > const &label_names() const noexcept
+    {
+      return m_label_names;
+    }
+
+    // starts new pass over given chunks (abandoning current one, if any);
+    // with shuffling, chunk order and rows of each chunk are permuted
+    void start( std::vector< std::size_t > const &chunks, bool is_shuffled )
+    {
+      auto order = chunks;
+      auto seed = prng_t::get_seed();
+      if ( is_shuffled )
+      {
+        auto eng = prng_engine_t{ seed };
+        prng_t::shuffle( order, eng );
+      }
+
+      {
+        auto lock = std::unique_lock< std::mutex >{ m_mutex };
+        m_order = std::move( order );
+        m_seed = is_shuffled ? seed : 0u;
+        m_is_shuffled = is_shuffled;
+        m_produced = 0u;
+        m_released = 0u;
+        m_is_holding = false;
+        m_generation++;
+      }
+      m_cv.notify_all();
+    }
+
+    // next chunk of current pass (valid until next call), null at its end
+    chunk_type const *next()
+    {
+      auto lock = std::unique_lock< std::mutex >{ m_mutex };
+      if ( m_is_holding )
+      {
+        m_is_holding = false;
+        m_released++;
+        m_cv.notify_all();
+      }
+      if ( m_released == m_order.size() )
+      {
+        return nullptr;
+      }
+
+      m_cv.wait( lock, [this]() { return m_produced > m_released; } );
+      auto &slot = m_slots[ m_released % m_slots.size() ];
+      if ( slot.error != nullptr )
+      {
+        throw std::runtime_error{ m_path + ":" +
+                                  std::to_string( slot.error_line ) + ": " +
+                                  slot.error };
+      }
+      m_is_holding = true;
+      return &slot.rows;
+    }
+
+  private:
+    // byte range of file holding one chunk (line number of its first line
+    // is kept for errors)
+    struct chunk_t
+    {
+      std::size_t begin;
+      std::size_t end;
+      std::size_t row_count;
+      std::size_t line_no;
+    };
+
+    struct slot_t
+    {
+      chunk_type rows = chunk_type{};
+      detail::csv_part_t< data_point_type > part =
+        detail::csv_part_t< data_point_type >{};
+      char const *error = nullptr;
+      std::size_t error_line = 0u;
+    };
+
+    void scan( std::size_t chunk_size )
+    {
+      auto text = m_file.view();
+      auto pos = std::size_t{ 0 };
+      auto line_no = std::size_t{ 1 };
+      if ( m_schema.has_header )
+      {
+        auto nl = text.find( '\n' );
+        pos = nl == std::string_view::npos ? text.size() : nl + 1u;
+        line_no++;
+      }
+
+      // label names fixed by schema are checked by parser, others are
+      // collected in file order
+      m_label_names = m_schema.label_names;
+      m_parse_schema = m_schema;
+      m_parse_schema.has_header = false;
+      auto is_parsed =
+        m_preprocessing.is_balanced || m_schema.label_names.empty();
+
+      auto sums = std::array< double, N - 1u >{};
+      auto part = detail::csv_part_t< data_point_type >{};
+      while ( pos < text.size() )
+      {
+        auto chunk = chunk_t{ pos, pos, 0u, line_no };
+        for ( auto l = std::size_t{ 0 };
+              l < chunk_size && chunk.end < text.size(); l++, line_no++ )
+        {
+          auto nl = text.find( '\n', chunk.end );
+          auto line_end = nl == std::string_view::npos ? text.size() : nl;
+          if ( !is_blank_line( chunk.end, line_end ) )
+          {
+            chunk.row_count++;
+          }
+          chunk.end = line_end == text.size() ? line_end : line_end + 1u;
+        }
+
+        if ( is_parsed )
+        {
+          parse( chunk, part );
+          if ( part.error != nullptr )
+          {
+            throw std::runtime_error{
+              m_path + ":" + std::to_string( line_of( chunk, part.error_at ) ) +
+              ": " + part.error };
+          }
+          assert( part.rows.size() == chunk.row_count );
+          for ( auto &&dp : part.rows )
+          {
+            for ( auto d = std::size_t{ 0 }; d + 1u < N; d++ )
+            {
+              sums[ d ] += static_cast< double >( dp.features[ d ] );
+            }
+          }
+        }
+
+        m_chunks.emplace_back( chunk );
+        m_row_count += chunk.row_count;
+        m_file.discard( pos, chunk.end - pos );
+        pos = chunk.end;
+      }
+
+      if ( m_preprocessing.is_balanced && m_row_count > 0u )
+      {
+        auto count = static_cast< double >( m_row_count );
+        for ( auto d = std::size_t{ 0 }; d + 1u < N; d++ )
+        {
+          m_preprocessing.means[ d ] = static_cast< T >( sums[ d ] / count );
+        }
+      }
+    }
+
+    bool is_blank_line( std::size_t begin, std::size_t end ) const noexcept
+    {
+      auto text = m_file.data();
+      return std::all_of( text + begin, text + end, detail::is_blank );
+    }
+
+    std::size_t line_of( chunk_t const &chunk, char const *at ) const
+    {
+      return chunk.line_no + static_cast< std::size_t >( std::count(
+                               m_file.data() + chunk.begin, at, '\n' ) );
+    }
+
+    // random chunks go to training set until it is large enough - the last
+    // one is cut at row boundary, its rest goes to test set as new chunk
+    void split( std::size_t training_count )
+    {
+      auto order = std::vector< std::size_t >( m_chunks.size() );
+      std::iota( order.begin(), order.end(), std::size_t{ 0 } );
+      prng_t::shuffle( order );
+
+      for ( auto c : order )
+      {
+        auto needed = training_count - std::min( training_count,
+                                                  m_train_row_count );
+        if ( needed == 0u )
+        {
+          m_test_chunks.emplace_back( c );
+          continue;
+        }
+        if ( needed < m_chunks[ c ].row_count )
+        {
+          auto rest = cut( m_chunks[ c ], needed );
+          m_test_chunks.emplace_back( m_chunks.size() );
+          m_chunks.emplace_back( rest );
+        }
+        m_train_chunks.emplace_back( c );
+        m_train_row_count += m_chunks[ c ].row_count;
+      }
+      std::sort( m_train_chunks.begin(), m_train_chunks.end() );
+      std::sort( m_test_chunks.begin(), m_test_chunks.end() );
+    }
+
+    // keeps given number of rows in chunk, returns chunk of the others
+    chunk_t cut( chunk_t &chunk, std::size_t row_count )
+    {
+      auto text = m_file.view();
+      auto rest = chunk_t{ chunk.begin, chunk.end,
+                           chunk.row_count - row_count, chunk.line_no };
+      for ( auto rows = std::size_t{ 0 }; rows < row_count; rest.line_no++ )
+      {
+        auto nl = text.find( '\n', rest.begin );
+        auto line_end = nl == std::string_view::npos ? chunk.end : nl;
+        if ( !is_blank_line( rest.begin, line_end ) )
+        {
+          rows++;
+        }
+        rest.begin = std::min( line_end + 1u, chunk.end );
+      }
+      m_file.discard( chunk.begin, chunk.end - chunk.begin );
+
+      chunk.end = rest.begin;
+      chunk.row_count = row_count;
+      return rest;
+    }
+
+    // parses chunk, labels are numbered by global names (unless schema
+    // fixes them, so parser numbers them right away)
+    void parse( chunk_t const &chunk,
+                detail::csv_part_t< data_point_type > &part )
+    {
+      part.rows.clear();
+      part.names.clear();
+      part.error = nullptr;
+      detail::parse_csv_part( m_file.data() + chunk.begin,
+                              m_file.data() + chunk.end, m_parse_schema,
+                              part );
+      if ( part.error != nullptr || !m_schema.label_names.empty() )
+      {
+        return;
+      }
+
+      auto local = std::vector< std::size_t >{};
+      for ( auto &&name : part.names )
+      {
+        auto ix = static_cast< std::size_t >(
+          std::find( m_label_names.begin(), m_label_names.end(), name ) -
+          m_label_names.begin() );
+        if ( ix == m_label_names.size() )
+        {
+          m_label_names.emplace_back( name );
+        }
+        local.emplace_back( ix );
+      }
+      for ( auto &&dp : part.rows )
+      {
+        dp.label = static_cast< label_t >(
+          local[ static_cast< std::size_t >( dp.label ) ] );
+      }
+    }
+
+    // background thread - prepares chunks of current pass in order, at
+    // most one ahead of the one held by consumer
+    void produce()
+    {
+      auto lock = std::unique_lock< std::mutex >{ m_mutex };
+      while ( true )
+      {
+        m_cv.wait( lock, [this]() {
+          return m_is_stopping ||
+                 ( m_produced < m_order.size() &&
+                   m_produced - m_released < m_slots.size() );
+        } );
+        if ( m_is_stopping )
+        {
+          return;
+        }
+
+        auto generation = m_generation;
+        auto pos = m_produced;
+        auto chunk = m_chunks[ m_order[ pos ] ];
+        auto seed = m_seed;
+        auto is_shuffled = m_is_shuffled;
+        auto &slot = m_slots[ pos % m_slots.size() ];
+
+        lock.unlock();
+        prepare( chunk, pos, seed, is_shuffled, slot );
+        lock.lock();
+
+        // results of abandoned pass are dropped
+        if ( generation == m_generation )
+        {
+          m_produced++;
+          m_cv.notify_all();
+        }
+      }
+    }
+
+    void prepare( chunk_t const &chunk, std::size_t pos, std::uint64_t seed,
+                  bool is_shuffled, slot_t &slot )
+    {
+      parse( chunk, slot.part );
+      slot.error = slot.part.error;
+      if ( slot.error != nullptr )
+      {
+        slot.error_line = line_of( chunk, slot.part.error_at );
+      }
+      std::swap( slot.rows, slot.part.rows );
+      m_file.discard( chunk.begin, chunk.end - chunk.begin );
+
+      auto radius = static_cast< T >( m_preprocessing.radius );
+      for ( auto &&dp : slot.rows )
+      {
+        if ( m_preprocessing.is_balanced )
+        {
+          static_for< N - 1u >( [&]( auto d ) {
+            dp.features[ d ] -= m_preprocessing.means[ d ];
+          } );
+        }
+        normalize_stereographic( dp.features, radius );
+      }
+
+      if ( is_shuffled )
+      {
+        auto eng = prng_engine_t{ seed, pos + 1u };
+        prng_t::shuffle( slot.rows, eng );
+      }
+    }
+
+  private:
+    mapped_file_t m_file;
+    csv_schema_t m_schema;
+    csv_schema_t m_parse_schema = csv_schema_t{};
+    std::string m_path;
+    preprocessing_type m_preprocessing = preprocessing_type{};
+
+    std::vector< chunk_t > m_chunks = std::vector< chunk_t >{};
+    std::vector< std::string > m_label_names = std::vector< std::string >{};
+    std::size_t m_row_count = 0u;
+    std::vector< std::size_t > m_train_chunks = std::vector< std::size_t >{};
+    std::vector< std::size_t > m_test_chunks = std::vector< std::size_t >{};
+    std::size_t m_train_row_count = 0u;
+
+    // current pass (guarded by mutex)
+    std::mutex m_mutex = std::mutex{};
+    std::condition_variable m_cv = std::condition_variable{};
+    std::vector< std::size_t > m_order = std::vector< std::size_t >{};
+    std::uint64_t m_seed = 0u;
+    bool m_is_shuffled = false;
+    std::size_t m_produced = 0u;
+    std::size_t m_released = 0u;
+    bool m_is_holding = false;
+    std::size_t m_generation = 0u;
+    bool m_is_stopping = false;
+
+    std::array< slot_t, 2u > m_slots = std::array< slot_t, 2u >{};
+    std::thread m_producer = std::thread{};
+  };
+
+  using chunked_source_t = basic_chunked_source_t< scalar_t, iris_dimension >;
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_STREAM_H_INCLUDED
@@ -0,0 +1,223 @@
+#include "sweep.h"
+
+#include "dataset.h"
+#include "evaluation.h"
+#include "model.h"
+#include "scheduler.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace isai
+{
+
+  namespace
+  {
+    using clock_type = std::chrono::steady_clock;
+
+    double elapsed_ms( clock_type::time_point since )
+    {
+      return std::chrono::duration< double, std::milli >( clock_type::now() -
+                                                          since )
+        .count();
+    }
+
+    // settings that change contents of loaded dataset (schema fields, and
+    // cache directory, which may hold stale copy of file)
+    using dataset_key_t =
+      std::tuple< std::string, std::size_t, double, bool, char, std::size_t,
+                  bool, std::vector< std::string >, std::string >;
+
+    dataset_key_t make_dataset_key( knc_settings_t const &settings )
+    {
+      auto const &schema = settings.dataset_schema;
+      return dataset_key_t{ settings.dataset_path,
+                            settings.training_set_size,
+                            settings.normalization_sphere_radius,
+                            settings.is_feature_sign_balanced,
+                            schema.delimiter,
+                            schema.label_column,
+                            schema.has_header,
+                            schema.label_names,
+                            settings.dataset_cache_dir };
+    }
+
+    void evaluate( kohonen_network_t const &network, dataset_t const &dataset,
+                   sweep_result_t &result )
+    {
+      auto model = model_t{ network.get_results(), network.get_result_ids(),
+                            dataset.preprocessing() };
+      auto evaluator = evaluator_t{ model, result.settings.simd_level, 1u };
+      evaluator.add( dataset.test_begin(), dataset.test_end() );
+      result.evaluation = evaluator.result();
+    }
+  }  // namespace
+
+  std::vector< knc_settings_t > sweep_grid_t::expand() const
+  {
+    auto or_base = []( auto const &values, auto base_value ) {
+      return values.empty()
+               ? std::vector< decltype( base_value ) >{ base_value }
+               : values;
+    };
+    auto res = std::vector< knc_settings_t >{};
+    for ( auto size : or_base( hidden_layer_sizes, base.hidden_layer_size ) )
+    {
+      for ( auto alpha : or_base( alphas, base.alpha ) )
+      {
+        for ( auto radius : or_base( normalization_sphere_radii,
+                                     base.normalization_sphere_radius ) )
+        {
+          for ( auto interval :
+                or_base( coalesce_intervals, base.coalesce_interval ) )
+          {
+            for ( auto seed : or_base( seeds, base.seed ) )
+            {
+              auto settings = base;
+              settings.hidden_layer_size = size;
+              settings.alpha = alpha;
+              settings.normalization_sphere_radius = radius;
+              settings.coalesce_interval = interval;
+              settings.seed = seed;
+              res.emplace_back( settings );
+            }
+          }
+        }
+      }
+    }
+    return res;
+  }
+
+  sweep_report_t run_sweep( std::vector< knc_settings_t > const &runs,
+                            sweep_options_t const &options )
+  {
+    auto start = clock_type::now();
+    auto deadline = options.time_limit.count() > 0
+                      ? start + options.time_limit
+                      : clock_type::time_point::max();
+
+    // datasets are loaded serially (same seed for each, so runs with equal
+    // dataset settings see the same split in any sweep)
+    auto datasets = std::vector< std::unique_ptr< dataset_t > >{};
+    auto dataset_ixs = std::map< dataset_key_t, std::size_t >{};
+    auto run_datasets = std::vector< dataset_t const * >{};
+    for ( auto &&settings : runs )
+    {
+      auto key = make_dataset_key( settings );
+      auto found = dataset_ixs.find( key );
+      if ( found == dataset_ixs.end() )
+      {
+        prng_t::reseed( options.seed );
+        datasets.emplace_back( std::make_unique< dataset_t >(
+          settings.training_set_size, settings.normalization_sphere_radius,
+          settings.is_feature_sign_balanced, settings.dataset_path.c_str(),
+          settings.dataset_schema, settings.thread_count,
+          settings.dataset_cache_dir.c_str() ) );
+        found = dataset_ixs.emplace( key, datasets.size() - 1u ).first;
+      }
+      run_datasets.emplace_back( datasets[ found->second ].get() );
+    }
+
+    auto report = sweep_report_t{};
+    report.results.resize( runs.size() );
+
+    // largest networks first - long tasks start early, short ones fill gaps
+    auto order = std::vector< std::size_t >( runs.size() );
+    std::iota( order.begin(), order.end(), std::size_t{ 0 } );
+    std::stable_sort( order.begin(), order.end(),
+                      [&runs]( std::size_t lhs, std::size_t rhs ) {
+                        return runs[ lhs ].hidden_layer_size >
+                               runs[ rhs ].hidden_layer_size;
+                      } );
+
+    auto scheduler = work_stealing_scheduler_t{ options.thread_count };
+    scheduler.run( runs.size(), [&]( std::size_t task, std::size_t ) {
+      auto ix = order[ task ];
+      auto &result = report.results[ ix ];
+      auto const &dataset = *run_datasets[ ix ];
+
+      // parallelism comes from concurrent runs, outputs are not wanted
+      result.settings = runs[ ix ];
+      auto &settings = result.settings;
+      settings.seed = settings.seed != 0u ? settings.seed : options.seed + ix;
+      settings.thread_count = 1u;
+      settings.is_verbose = false;
+      settings.checkpoint_path.clear();
+      settings.resume_path.clear();
+      settings.model_path.clear();
+      settings.trace_path.clear();
+
+      // generator of this thread - run does not depend on worker it got
+      prng_t::reseed( settings.seed );
+      auto run_start = clock_type::now();
+      auto network = kohonen_network_t{ settings };
+      network.set_deadline( deadline );
+      network.run( dataset.train_begin(), dataset.train_end() );
+      result.train_ms = elapsed_ms( run_start );
+      result.stop_reason = network.stop_reason();
+      result.iterations = network.iteration_count();
+      result.alive_count = network.alive_count();
+
+      result.eval_ms = 0.0;
+      result.evaluation = evaluation_t{};
+      if ( result.stop_reason != stop_reason_t::deadline )
+      {
+        auto eval_start = clock_type::now();
+        evaluate( network, dataset, result );
+        result.eval_ms = elapsed_ms( eval_start );
+      }
+    } );
+
+    report.wall_ms = elapsed_ms( start );
+    return report;
+  }
+
+  void write_sweep_report( std::FILE *out, sweep_report_t const &report )
+  {
+    auto finished = std::size_t{ 0 };
+    auto train_ms = 0.0;
+    for ( auto &&r : report.results )
+    {
+      std::fprintf(
+        out,
+        "{\"hidden_layer_size\":%lu,\"alpha\":%g,\"radius\":%g,"
+        "\"coalesce_interval\":%lu,\"seed\":%llu,\"stop_reason\":\"%s\","
+        "\"iterations\":%lu,\"alive\":%lu,\"train_ms\":%.3f,"
+        "\"eval_ms\":%.3f,\"purity\":%.6f,\"ari\":%.6f,"
+        "\"quantization_error\":%.6f,\"confusion\":[",
+        r.settings.hidden_layer_size, r.settings.alpha,
+        r.settings.normalization_sphere_radius, r.settings.coalesce_interval,
+        static_cast< unsigned long long >( r.settings.seed ),
+        stop_reason_to_string( r.stop_reason ), r.iterations, r.alive_count,
+        r.train_ms, r.eval_ms, r.evaluation.purity,
+        r.evaluation.adjusted_rand_index, r.evaluation.quantization_error );
+      auto const &confusion = r.evaluation.confusion;
+      for ( auto row = std::size_t{ 0 }; row < confusion.size(); row++ )
+      {
+        std::fprintf( out, "%s[", row > 0u ? "," : "" );
+        for ( auto c = std::size_t{ 0 }; c < confusion[ row ].size(); c++ )
+        {
+          std::fprintf( out, "%s%lu", c > 0u ? "," : "",
+                        confusion[ row ][ c ] );
+        }
+        std::fprintf( out, "]" );
+      }
+      std::fprintf( out, "]}\n" );
+
+      finished += r.stop_reason != stop_reason_t::deadline ? 1u : 0u;
+      train_ms += r.train_ms;
+    }
+    std::fprintf( out,
+                  "{\"runs\":%lu,\"finished\":%lu,\"cancelled\":%lu,"
+                  "\"train_ms\":%.3f,\"wall_ms\":%.3f}\n",
+                  report.results.size(), finished,
+                  report.results.size() - finished, train_ms,
+                  report.wall_ms );
+  }
+
+}  // namespace isai
@@ -0,0 +1,69 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_SWEEP_H_INCLUDED
+#define ISAI_KOHRIS_SWEEP_H_INCLUDED
+
+#include "evaluation.h"
+#include "kohnet.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace isai
+{
+
+  // grid of hyperparameters - every combination of listed values (empty
+  // list - value of base settings), each trained once per seed (ensemble)
+  struct sweep_grid_t
+  {
+    knc_settings_t base = knc_settings_t{};
+    std::vector< std::size_t > hidden_layer_sizes = {};
+    std::vector< double > alphas = {};
+    std::vector< double > normalization_sphere_radii = {};
+    std::vector< std::size_t > coalesce_intervals = {};
+    std::vector< std::uint64_t > seeds = {};
+
+    std::vector< knc_settings_t > expand() const;
+  };
+
+  struct sweep_options_t
+  {
+    std::size_t thread_count = 0u;  // concurrent runs, zero - all hardware
+    std::chrono::milliseconds time_limit =
+      std::chrono::milliseconds{ 0 };  // shared by all runs, zero - none
+    std::uint64_t seed = 1u;  // dataset split/order, and runs without seed
+  };
+
+  struct sweep_result_t
+  {
+    knc_settings_t settings;  // as run (with seed actually used)
+    stop_reason_t stop_reason;
+    std::size_t iterations;
+    std::size_t alive_count;
+    double train_ms;
+    double eval_ms;
+
+    // scores on test set, empty for runs cancelled by deadline
+    evaluation_t evaluation;
+  };
+
+  struct sweep_report_t
+  {
+    std::vector< sweep_result_t > results;  // in order of runs
+    double wall_ms;
+  };
+
+  // trains all runs concurrently (each network single threaded) on work
+  // stealing scheduler; runs with the same dataset settings share one
+  // read-only dataset, loaded once up front
+  sweep_report_t run_sweep( std::vector< knc_settings_t > const &runs,
+                            sweep_options_t const &options );
+
+  // one json object per run, then summary line
+  void write_sweep_report( std::FILE *out, sweep_report_t const &report );
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_SWEEP_H_INCLUDED
@@ -1,11 +1,239 @@
+#include "classifier.h"
 #include "kohris.h"
+#include "sharded.h"
+#include "sweep.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <iostream>
 
-int main()
+// usage:
+//   kohris                              - train on iris and evaluate
+//   kohris train <model> [cache]        - same, trained model is exported
+//   kohris cache <dir>                  - train and evaluate, preprocessed
+//                                         dataset is cached in given dir
+//   kohris classify <model> [threads]   - labels points read from stdin
+//   kohris sweep [seconds] [threads]    - hyperparameter sweep, json report
+//   kohris shard [processes] [batch]    - sharded training vs single process
+//   kohris refine [epochs] [prune]      - warm start on test set vs retrain
+int main( int argc, char **argv )
 {
+  if ( argc >= 2 && std::strcmp( argv[ 1 ], "shard" ) == 0 )
+  {
+    auto settings = isai::knc_settings_t{};
+    settings.seed = 1u;
+    settings.is_verbose = false;
+    auto process_count =
+      argc >= 3 ? static_cast< std::size_t >( std::atoi( argv[ 2 ] ) ) : 2u;
+    if ( argc >= 4 && std::strcmp( argv[ 3 ], "batch" ) == 0 )
+    {
+      settings.training_mode = isai::training_mode_t::batch;
+    }
+
+    try
+    {
+      isai::prng_t::initialize( settings.seed );
+      auto dataset = isai::dataset_t{
+        settings.training_set_size, settings.normalization_sphere_radius,
+        settings.is_feature_sign_balanced, settings.dataset_path.c_str(),
+        settings.dataset_schema, 1u, settings.dataset_cache_dir.c_str()
+      };
+      auto state = isai::prng_t::get_state();
+
+      auto start = std::chrono::steady_clock::now();
+      auto single = isai::kohonen_network_t{ settings };
+      single.run( dataset.train_begin(), dataset.train_end() );
+      auto single_ms = std::chrono::duration< double, std::milli >(
+                         std::chrono::steady_clock::now() - start )
+                         .count();
+
+      // same initial weights
+      isai::prng_t::set_state( state );
+      start = std::chrono::steady_clock::now();
+      auto sharded = isai::sharded_network_t{ settings, process_count };
+      sharded.run( dataset.train_begin(), dataset.train_end() );
+      auto sharded_ms = std::chrono::duration< double, std::milli >(
+                          std::chrono::steady_clock::now() - start )
+                          .count();
+
+      auto lhs = single.get_results();
+      auto rhs = sharded.get_results();
+      auto is_same = single.get_result_ids() == sharded.get_result_ids() &&
+                     std::equal( lhs.begin(), lhs.end(), rhs.begin(),
+                                 rhs.end(), []( auto &&l, auto &&r ) {
+                                   return l.weights() == r.weights();
+                                 } );
+      std::printf( "processes: %lu, iterations: %lu, clusters: %lu, "
+                   "single: %.1f ms, sharded: %.1f ms, results %s\n",
+                   sharded.process_count(), sharded.iteration_count(),
+                   sharded.alive_count(), single_ms, sharded_ms,
+                   is_same ? "identical" : "differ" );
+      return is_same ? 0 : 1;
+    }
+    catch ( std::exception const &e )
+    {
+      std::fprintf( stderr, "%s\n", e.what() );
+      return 1;
+    }
+  }
+
+  if ( argc >= 2 && std::strcmp( argv[ 1 ], "refine" ) == 0 )
+  {
+    auto settings = isai::knc_settings_t{};
+    settings.seed = 1u;
+    settings.is_verbose = false;
+    auto refine = isai::refine_settings_t{};
+    if ( argc >= 3 )
+    {
+      refine.epoch_count =
+        static_cast< std::size_t >( std::atoi( argv[ 2 ] ) );
+    }
+    if ( argc >= 4 && std::strcmp( argv[ 3 ], "prune" ) == 0 )
+    {
+      refine.do_kill = true;
+      refine.do_coalesce = true;
+    }
+
+    try
+    {
+      isai::prng_t::initialize( settings.seed );
+      auto dataset = isai::dataset_t{
+        settings.training_set_size, settings.normalization_sphere_radius,
+        settings.is_feature_sign_balanced, settings.dataset_path.c_str(),
+        settings.dataset_schema, 1u, settings.dataset_cache_dir.c_str()
+      };
+      auto state = isai::prng_t::get_state();
+
+      // pruning needs more survivors than clusters - training stops at
+      // twice as many
+      auto trained_settings = settings;
+      if ( refine.do_coalesce )
+      {
+        trained_settings.expected_cluster_count *= 2u;
+      }
+      auto trained = isai::kohonen_network_t{ trained_settings };
+      trained.run( dataset.train_begin(), dataset.train_end() );
+      auto survivors = trained.get_results();
+
+      // test set plays the part of newly arrived data
+      auto start = std::chrono::steady_clock::now();
+      auto warm = isai::kohonen_network_t{ settings, survivors };
+      auto pruned =
+        warm.refine( dataset.test_begin(), dataset.test_end(), refine );
+      auto refine_ms = std::chrono::duration< double, std::milli >(
+                         std::chrono::steady_clock::now() - start )
+                         .count();
+
+      isai::prng_t::set_state( state );
+      start = std::chrono::steady_clock::now();
+      auto full = isai::kohonen_network_t{ settings };
+      full.run( dataset.begin(), dataset.end() );
+      auto full_ms = std::chrono::duration< double, std::milli >(
+                       std::chrono::steady_clock::now() - start )
+                       .count();
+
+      // refined neurons keep ids of their positions among survivors
+      auto moved = 0.0;
+      auto refined = warm.get_results();
+      auto ids = warm.get_result_ids();
+      for ( auto i = std::size_t{ 0 }; i < refined.size(); i++ )
+      {
+        moved = std::max( moved, static_cast< double >(
+                                   refined[ i ].distance_to(
+                                     survivors[ ids[ i ] ].weights() ) ) );
+      }
+
+      std::printf( "refine: %.1f ms (%lu epochs, %s), clusters: %lu -> "
+                   "%lu (killed: %lu, coalesced: %lu), largest move: %.4f; "
+                   "full retrain: %.1f ms (%lu iterations)\n",
+                   refine_ms, warm.iteration_count(),
+                   isai::stop_reason_to_string( warm.stop_reason() ),
+                   survivors.size(), warm.alive_count(), pruned.kill_count,
+                   pruned.coalesce_count, moved, full_ms,
+                   full.iteration_count() );
+      if ( refine.do_coalesce && pruned.coalesce_count == 0u )
+      {
+        std::fprintf( stderr, "refine merged no pair of neurons\n" );
+        return 1;
+      }
+    }
+    catch ( std::exception const &e )
+    {
+      std::fprintf( stderr, "%s\n", e.what() );
+      return 1;
+    }
+    return 0;
+  }
+
+  if ( argc >= 2 && std::strcmp( argv[ 1 ], "sweep" ) == 0 )
+  {
+    auto grid = isai::sweep_grid_t{};
+    grid.base.hidden_layer_size = 1000u;
+    grid.hidden_layer_sizes = { 1000u, 4000u };
+    grid.alphas = { 0.2, 0.3, 0.4 };
+    grid.normalization_sphere_radii = { 2.0, 4.0 };
+    grid.seeds = { 1u, 2u, 3u };
+
+    auto options = isai::sweep_options_t{};
+    if ( argc >= 3 )
+    {
+      options.time_limit = std::chrono::milliseconds{
+        static_cast< long long >( std::atof( argv[ 2 ] ) * 1000.0 ) };
+    }
+    if ( argc >= 4 )
+    {
+      options.thread_count =
+        static_cast< std::size_t >( std::atoi( argv[ 3 ] ) );
+    }
+
+    try
+    {
+      auto report = isai::run_sweep( grid.expand(), options );
+      isai::write_sweep_report( stdout, report );
+    }
+    catch ( std::exception const &e )
+    {
+      std::fprintf( stderr, "%s\n", e.what() );
+      return 1;
+    }
+    return 0;
+  }
+
+  if ( argc >= 3 && std::strcmp( argv[ 1 ], "classify" ) == 0 )
+  {
+    try
+    {
+      auto model = isai::model_t::load( argv[ 2 ] );
+      auto thread_count =
+        argc >= 4 ? static_cast< std::size_t >( std::atoi( argv[ 3 ] ) ) : 1u;
+      isai::classify_stream( model, stdin, stdout,
+                             isai::simd_level_t::automatic, thread_count );
+    }
+    catch ( std::exception const &e )
+    {
+      std::fprintf( stderr, "%s\n", e.what() );
+      return 1;
+    }
+    return 0;
+  }
+
   isai::prng_t::initialize();
   auto settings = isai::knc_settings_t{};
+  if ( argc >= 3 && std::strcmp( argv[ 1 ], "train" ) == 0 )
+  {
+    settings.model_path = argv[ 2 ];
+    if ( argc >= 4 )
+    {
+      settings.dataset_cache_dir = argv[ 3 ];
+    }
+  }
+  if ( argc >= 3 && std::strcmp( argv[ 1 ], "cache" ) == 0 )
+  {
+    settings.dataset_cache_dir = argv[ 2 ];
+  }
   auto clusterizer = isai::iris_clusterizer_t{ settings };
   clusterizer.run();
   return 0;
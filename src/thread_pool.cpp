@@ -0,0 +1,127 @@
+#include "thread_pool.h"
+
+#include "numa.h"
+
+#include <algorithm>
+
+namespace isai
+{
+
+  thread_pool_t::thread_pool_t( std::size_t thread_count, bool is_pinned )
+  {
+    if ( thread_count == 0u )
+    {
+      thread_count = std::max( 1u, std::thread::hardware_concurrency() );
+    }
+
+    if ( is_pinned )
+    {
+      pin_current_thread( numa_cpu_for( 0u, thread_count ) );
+    }
+    m_workers.reserve( thread_count - 1u );
+    for ( auto i = std::size_t{ 1 }; i < thread_count; i++ )
+    {
+      m_workers.emplace_back( [this, i, thread_count, is_pinned]() {
+        if ( is_pinned )
+        {
+          pin_current_thread( numa_cpu_for( i, thread_count ) );
+        }
+        worker_loop( i );
+      } );
+    }
+  }
+
+  thread_pool_t::~thread_pool_t()
+  {
+    {
+      auto lock = std::unique_lock< std::mutex >{ m_mutex };
+      m_is_stopping = true;
+    }
+    m_start_cv.notify_all();
+
+    for ( auto &&w : m_workers )
+    {
+      w.join();
+    }
+  }
+
+  void thread_pool_t::dispatch( void *ctx, trampoline_t fn )
+  {
+    {
+      auto lock = std::unique_lock< std::mutex >{ m_mutex };
+      m_task_ctx = ctx;
+      m_task_fn = fn;
+      m_pending = m_workers.size();
+      m_generation++;
+    }
+    m_start_cv.notify_all();
+
+    // workers still use ctx, so calling thread waits for them even when
+    // its own part throws
+    auto error = std::exception_ptr{};
+    try
+    {
+      fn( ctx, 0u );
+    }
+    catch ( ... )
+    {
+      error = std::current_exception();
+    }
+
+    auto lock = std::unique_lock< std::mutex >{ m_mutex };
+    m_done_cv.wait( lock, [this]() { return m_pending == 0u; } );
+    if ( !error )
+    {
+      error = m_error;
+    }
+    m_error = nullptr;
+    lock.unlock();
+
+    if ( error )
+    {
+      std::rethrow_exception( error );
+    }
+  }
+
+  void thread_pool_t::worker_loop( std::size_t ix )
+  {
+    auto seen_generation = std::size_t{ 0 };
+
+    while ( true )
+    {
+      auto lock = std::unique_lock< std::mutex >{ m_mutex };
+      m_start_cv.wait( lock, [this, seen_generation]() {
+        return m_is_stopping || m_generation != seen_generation;
+      } );
+      if ( m_is_stopping )
+      {
+        return;
+      }
+      seen_generation = m_generation;
+      auto ctx = m_task_ctx;
+      auto fn = m_task_fn;
+      lock.unlock();
+
+      auto error = std::exception_ptr{};
+      try
+      {
+        fn( ctx, ix );
+      }
+      catch ( ... )
+      {
+        error = std::current_exception();
+      }
+
+      lock.lock();
+      if ( error && !m_error )
+      {
+        m_error = error;
+      }
+      if ( --m_pending == 0u )
+      {
+        m_done_cv.notify_one();
+      }
+    }
+  }
+
+}  // namespace isai
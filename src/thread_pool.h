@@ -0,0 +1,92 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_THREAD_POOL_H_INCLUDED
+#define ISAI_KOHRIS_THREAD_POOL_H_INCLUDED
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace isai
+{
+
+  // persistent fork-join pool - every call to run() executes given task once
+  // on each participant (calling thread being participant #0) and returns
+  // when all of them are done
+  class thread_pool_t
+  {
+  public:
+    // thread count of zero means one participant per hardware thread; with
+    // pinning, participants (calling thread too) are bound to cpus of numa
+    // nodes in order (see numa_cpu_for), so that participant scanning given
+    // shard stays on one node
+    explicit thread_pool_t( std::size_t thread_count,
+                            bool is_pinned = false );
+    ~thread_pool_t();
+
+    thread_pool_t( thread_pool_t const & ) = delete;
+    thread_pool_t( thread_pool_t && ) = delete;
+    thread_pool_t &operator=( thread_pool_t const & ) = delete;
+    thread_pool_t &operator=( thread_pool_t && ) = delete;
+
+    // number of participants (including calling thread)
+    std::size_t size() const noexcept { return m_workers.size() + 1u; }
+
+    // calls task( participant_ix ) on all participants concurrently; if any
+    // of them throws, the first exception is rethrown once all are done
+    template < typename Task >
+    void run( Task &&task )
+    {
+      if ( m_workers.empty() )
+      {
+        task( std::size_t{ 0 } );
+        return;
+      }
+      dispatch( &task, []( void *ctx, std::size_t ix ) {
+        ( *static_cast< std::remove_reference_t< Task > * >( ctx ) )( ix );
+      } );
+    }
+
+    // splits range [0, count) into contiguous near-equal parts, each being
+    // multiple of granularity (except possibly the last one)
+    static std::pair< std::size_t, std::size_t >
+    split( std::size_t count, std::size_t parts, std::size_t part_ix,
+           std::size_t granularity = 1u ) noexcept
+    {
+      auto blocks = ( count + granularity - 1u ) / granularity;
+      auto begin = std::min( count, blocks * part_ix / parts * granularity );
+      auto end =
+        std::min( count, blocks * ( part_ix + 1u ) / parts * granularity );
+      return { begin, end };
+    }
+
+  private:
+    using trampoline_t = void ( * )( void *, std::size_t );
+
+    void dispatch( void *ctx, trampoline_t fn );
+    void worker_loop( std::size_t ix );
+
+  private:
+    std::vector< std::thread > m_workers = std::vector< std::thread >{};
+
+    std::mutex m_mutex = std::mutex{};
+    std::condition_variable m_start_cv = std::condition_variable{};
+    std::condition_variable m_done_cv = std::condition_variable{};
+
+    void *m_task_ctx = nullptr;
+    trampoline_t m_task_fn = nullptr;
+    std::size_t m_generation = 0u;
+    std::size_t m_pending = 0u;
+    std::exception_ptr m_error = nullptr;  // first one thrown by task
+    bool m_is_stopping = false;
+  };
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_THREAD_POOL_H_INCLUDED
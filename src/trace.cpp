@@ -0,0 +1,156 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+namespace isai
+{
+
+  namespace
+  {
+    // buffers of all threads that ever traced anything (kept until exit,
+    // so events of finished threads are not lost)
+    struct trace_registry_t
+    {
+      std::mutex mutex;
+      std::vector< std::unique_ptr< detail::trace_buffer_t > > buffers;
+    };
+
+    trace_registry_t &registry()
+    {
+      static auto res = trace_registry_t{};
+      return res;
+    }
+
+    auto const trace_epoch = std::chrono::steady_clock::now();
+  }  // namespace
+
+  namespace detail
+  {
+    trace_buffer_t &trace_buffer()
+    {
+      thread_local trace_buffer_t *buffer = nullptr;
+      if ( buffer == nullptr )
+      {
+        auto &reg = registry();
+        auto lock = std::unique_lock< std::mutex >{ reg.mutex };
+        reg.buffers.emplace_back( std::make_unique< trace_buffer_t >(
+          trace_buffer_t{ static_cast< std::uint32_t >( reg.buffers.size() ),
+                          {},
+                          {},
+                          0u } ) );
+        buffer = reg.buffers.back().get();
+      }
+      return *buffer;
+    }
+
+    std::uint64_t trace_now_ns() noexcept
+    {
+      return static_cast< std::uint64_t >(
+        std::chrono::duration_cast< std::chrono::nanoseconds >(
+          std::chrono::steady_clock::now() - trace_epoch )
+          .count() );
+    }
+  }  // namespace detail
+
+  void trace_write( std::FILE *out, trace_format_t format )
+  {
+    auto &reg = registry();
+    auto lock = std::unique_lock< std::mutex >{ reg.mutex };
+
+    auto events = std::vector< trace_event_t >{};
+    std::uint64_t counters[ trace_counter_count ] = {};
+    auto dropped = std::uint64_t{ 0 };
+    for ( auto &&buffer : reg.buffers )
+    {
+      events.insert( events.end(), buffer->events.begin(),
+                     buffer->events.end() );
+      for ( auto c = std::size_t{ 0 }; c < trace_counter_count; c++ )
+      {
+        counters[ c ] += buffer->counters[ c ];
+      }
+      dropped += buffer->dropped;
+    }
+    std::stable_sort( events.begin(), events.end(),
+                      []( auto &&lhs, auto &&rhs ) {
+                        return lhs.begin_ns < rhs.begin_ns;
+                      } );
+
+    auto is_chrome = format == trace_format_t::chrome;
+    auto end_ns = detail::trace_now_ns();
+    if ( is_chrome )
+    {
+      std::fprintf( out, "{\"traceEvents\":[\n" );
+    }
+    for ( auto &&e : events )
+    {
+      if ( is_chrome )
+      {
+        std::fprintf( out,
+                      "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,"
+                      "\"ts\":%.3f,\"dur\":%.3f,"
+                      "\"args\":{\"iteration\":%llu}},\n",
+                      trace_phase_to_string( e.phase ), e.thread,
+                      static_cast< double >( e.begin_ns ) / 1000.0,
+                      static_cast< double >( e.duration_ns ) / 1000.0,
+                      static_cast< unsigned long long >( e.iteration ) );
+      }
+      else
+      {
+        std::fprintf( out,
+                      "{\"phase\":\"%s\",\"thread\":%u,\"iteration\":%llu,"
+                      "\"begin_us\":%.3f,\"duration_us\":%.3f}\n",
+                      trace_phase_to_string( e.phase ), e.thread,
+                      static_cast< unsigned long long >( e.iteration ),
+                      static_cast< double >( e.begin_ns ) / 1000.0,
+                      static_cast< double >( e.duration_ns ) / 1000.0 );
+      }
+    }
+    for ( auto c = std::size_t{ 0 }; c < trace_counter_count; c++ )
+    {
+      auto name =
+        trace_counter_to_string( static_cast< trace_counter_t >( c ) );
+      auto value = static_cast< unsigned long long >( counters[ c ] );
+      if ( is_chrome )
+      {
+        std::fprintf( out,
+                      "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":0,\"tid\":0,"
+                      "\"ts\":%.3f,\"args\":{\"total\":%llu}},\n",
+                      name, static_cast< double >( end_ns ) / 1000.0, value );
+      }
+      else
+      {
+        std::fprintf( out, "{\"counter\":\"%s\",\"value\":%llu}\n", name,
+                      value );
+      }
+    }
+    if ( is_chrome )
+    {
+      std::fprintf( out,
+                    "{\"name\":\"dropped_events\",\"ph\":\"C\",\"pid\":0,"
+                    "\"tid\":0,\"ts\":%.3f,\"args\":{\"total\":%llu}}\n]}\n",
+                    static_cast< double >( end_ns ) / 1000.0,
+                    static_cast< unsigned long long >( dropped ) );
+    }
+    else
+    {
+      std::fprintf( out, "{\"counter\":\"dropped_events\",\"value\":%llu}\n",
+                    static_cast< unsigned long long >( dropped ) );
+    }
+  }
+
+  void trace_reset()
+  {
+    auto &reg = registry();
+    auto lock = std::unique_lock< std::mutex >{ reg.mutex };
+    for ( auto &&buffer : reg.buffers )
+    {
+      buffer->events.clear();
+      std::fill( std::begin( buffer->counters ), std::end( buffer->counters ),
+                 std::uint64_t{ 0 } );
+      buffer->dropped = 0u;
+    }
+  }
+
+}  // namespace isai
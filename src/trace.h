@@ -0,0 +1,147 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_TRACE_H_INCLUDED
+#define ISAI_KOHRIS_TRACE_H_INCLUDED
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// instrumentation is compiled in only with ISAI_KOHRIS_TRACE defined -
+// otherwise scope and counter macros expand to nothing
+#ifdef ISAI_KOHRIS_TRACE
+#define ISAI_TRACE_CONCAT_IMPL( a, b ) a##b
+#define ISAI_TRACE_CONCAT( a, b ) ISAI_TRACE_CONCAT_IMPL( a, b )
+#define ISAI_TRACE_SCOPE( phase, iteration )                                 \
+  ::isai::trace_scope_t ISAI_TRACE_CONCAT( isai_trace_scope_, __LINE__ )    \
+  {                                                                          \
+    ( phase ), ( iteration )                                                 \
+  }
+#define ISAI_TRACE_COUNT( counter, value )                                   \
+  ::isai::trace_count( ( counter ), ( value ) )
+#else
+#define ISAI_TRACE_SCOPE( phase, iteration ) static_cast< void >( 0 )
+#define ISAI_TRACE_COUNT( counter, value ) static_cast< void >( 0 )
+#endif
+
+namespace isai
+{
+
+  // timed phases of training
+  enum class trace_phase_t
+  {
+    prepare,
+    process,        // winner search and updates for all training inputs
+    kill,
+    coalesce,
+    winner_search,  // share of single thread in parallel batch search
+  };
+
+  constexpr char const *const trace_phase_strs[] = {
+    "prepare", "process", "kill", "coalesce", "winner_search"
+  };
+  constexpr char const *trace_phase_to_string( trace_phase_t phase )
+  {
+    return trace_phase_strs[ static_cast< int >( phase ) ];
+  }
+
+  enum class trace_counter_t
+  {
+    distance_evaluations,  // input to neuron distances computed by search
+    inputs,                // training inputs processed
+  };
+
+  constexpr std::size_t trace_counter_count = 2u;
+  constexpr char const *const trace_counter_strs[] = { "distance_evaluations",
+                                                       "inputs" };
+  constexpr char const *trace_counter_to_string( trace_counter_t counter )
+  {
+    return trace_counter_strs[ static_cast< int >( counter ) ];
+  }
+
+  // output format of collected events
+  enum class trace_format_t
+  {
+    json_lines,  // one object per event and per counter
+    chrome       // chrome://tracing (perfetto) json
+  };
+
+  struct trace_event_t
+  {
+    trace_phase_t phase;
+    std::uint32_t thread;
+    std::uint64_t iteration;
+    std::uint64_t begin_ns;  // since first use of tracing in process
+    std::uint64_t duration_ns;
+  };
+
+  namespace detail
+  {
+    // events and counters of single thread - only owning thread writes to
+    // it, others read it when tracing is flushed
+    struct trace_buffer_t
+    {
+      std::uint32_t thread;
+      std::vector< trace_event_t > events;
+      std::uint64_t counters[ trace_counter_count ];
+      std::uint64_t dropped;
+    };
+
+    // buffer of calling thread (registered on first use)
+    trace_buffer_t &trace_buffer();
+
+    std::uint64_t trace_now_ns() noexcept;
+  }  // namespace detail
+
+  // events past this limit (per thread) are counted, but not stored
+  constexpr std::size_t trace_event_limit = std::size_t{ 1 } << 20u;
+
+  // times enclosing scope (use through ISAI_TRACE_SCOPE)
+  class trace_scope_t
+  {
+  public:
+    trace_scope_t( trace_phase_t phase, std::size_t iteration ) noexcept :
+      m_phase( phase ),
+      m_iteration( iteration ),
+      m_begin( detail::trace_now_ns() )
+    {
+    }
+
+    trace_scope_t( trace_scope_t const & ) = delete;
+    trace_scope_t &operator=( trace_scope_t const & ) = delete;
+
+    ~trace_scope_t()
+    {
+      auto &buffer = detail::trace_buffer();
+      if ( buffer.events.size() == trace_event_limit )
+      {
+        buffer.dropped++;
+        return;
+      }
+      buffer.events.emplace_back(
+        trace_event_t{ m_phase, buffer.thread, m_iteration, m_begin,
+                       detail::trace_now_ns() - m_begin } );
+    }
+
+  private:
+    trace_phase_t m_phase;
+    std::size_t m_iteration;
+    std::uint64_t m_begin;
+  };
+
+  inline void trace_count( trace_counter_t counter, std::uint64_t value )
+  {
+    detail::trace_buffer().counters[ static_cast< int >( counter ) ] += value;
+  }
+
+  // writes events of all threads (ordered by start) and counter totals;
+  // must not run concurrently with traced code
+  void trace_write( std::FILE *out, trace_format_t format );
+
+  // forgets all collected events and counters
+  void trace_reset();
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_TRACE_H_INCLUDED
@@ -0,0 +1,33 @@
+#pragma once
+
+#ifndef ISAI_KOHRIS_UNROLL_H_INCLUDED
+#define ISAI_KOHRIS_UNROLL_H_INCLUDED
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace isai
+{
+
+  namespace detail
+  {
+    template < typename F, std::size_t... I >
+    constexpr void static_for_impl( F &&f, std::index_sequence< I... > )
+    {
+      ( f( std::integral_constant< std::size_t, I >{} ), ... );
+    }
+  }  // namespace detail
+
+  // calls f( 0 ), f( 1 ), ..., f( N - 1 ) in order - loop fully unrolled at
+  // compile time (index is passed as integral constant)
+  template < std::size_t N, typename F >
+  constexpr void static_for( F &&f )
+  {
+    detail::static_for_impl( std::forward< F >( f ),
+                             std::make_index_sequence< N >{} );
+  }
+
+}  // namespace isai
+
+#endif  // !ISAI_KOHRIS_UNROLL_H_INCLUDED